@@ -38,13 +38,12 @@
 #include "vp8_header_structures.hh"
 
 struct ProbabilityTables;
+struct TokenProbabilities;
 struct Quantizer;
 class BoolEncoder;
 
 enum BlockType { Y_after_Y2 = 0, Y2, UV, Y_without_Y2 };
 
-constexpr static int16_t ZERO_REF[ 16 ] = { 0 };
-
 class DCTCoefficients
 {
 private:
@@ -67,6 +66,11 @@ public:
   }
 
   void idct_add( VP8Raster::Block4 & output ) const;
+  void idct_add( uint8_t * output, const unsigned int stride ) const;
+
+  /* four horizontally adjacent blocks at once */
+  static void idct_add_x4( const SafeArray<DCTCoefficients, 4> & blocks,
+                           uint8_t * leftmost_output, const unsigned int stride );
   void iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output ) const;
 
   void subtract_dct( const VP8Raster::Block4 & block, const TwoDSubRange< uint8_t, 4, 4 > & prediction );
@@ -142,6 +146,9 @@ private:
 
   bool has_nonzero_ { false };
 
+  /* one past the last nonzero coefficient, in zigzag order */
+  uint8_t eob_ { 0 };
+
   MotionVector motion_vector_ {};
 
 public:
@@ -158,8 +165,8 @@ public:
 
   const typename TwoD< Block >::Context & context( void ) const { return context_; }
 
-  void set_above( const Optional< const Block * > & s_above ) { context_.above = s_above; }
-  void set_left( const Optional< const Block * > & s_left ) { context_.left = s_left; }
+  void set_above( const Optional< unsigned int > & above_row ) { context_.set_above( above_row ); }
+  void set_left( const Optional< unsigned int > & left_column ) { context_.set_left( left_column ); }
 
   void set_Y_without_Y2( void )
   {
@@ -189,12 +196,13 @@ public:
     }
   }
 
-  void parse_tokens( BoolDecoder & data, const ProbabilityTables & probability_tables );
+  void parse_tokens( BoolDecoder & data, const TokenProbabilities & token_probabilities );
 
   BlockType type( void ) const { return type_; }
   bool coded( void ) const { static_assert( initial_block_type == Y2,
                                             "only Y2 blocks can be omitted" ); return coded_; }
   bool has_nonzero( void ) const { return has_nonzero_; }
+  uint8_t eob( void ) const { return eob_; }
 
   void set_dc_coefficient( const int16_t & val );
   DCTCoefficients dequantize( const Quantizer & quantizer ) const;
@@ -226,15 +234,17 @@ public:
 
   void add_residue( VP8Raster::Block4 & raster ) const;
 
-  void calculate_has_nonzero()
-  {
-    has_nonzero_ = ( memcmp( &coefficients_.at( 0 ), ZERO_REF,
-                             sizeof( ZERO_REF ) ) != 0 );
-  }
+  /* dequantize and add the residue to the 4x4 pixels at `output`, skipping
+     empty blocks and doing only the DC term when that is all there is */
+  void idct_add( const Quantizer & quantizer, uint8_t * output, const unsigned int stride ) const;
+
+  /* recompute has_nonzero() and eob() after the coefficients were changed */
+  void calculate_has_nonzero();
 
   void zero_out()
   {
     has_nonzero_ = false;
+    eob_ = 0;
     coefficients_.zero_out();
   }
 
@@ -29,6 +29,10 @@
 #ifndef BOOL_DECODER_HH
 #define BOOL_DECODER_HH
 
+#include <cstring>
+#include <cstddef>
+#include <endian.h>
+
 #include "chunk.hh"
 #include "safe_array.hh"
 
@@ -42,49 +46,109 @@ typedef uint8_t Probability;
 template < std::size_t alphabet_size >
 using ProbabilityArray = SafeArray< Probability, alphabet_size - 1 >;
 
+/* libvpx lookup table to avoid the need for a loop when normalizing
+ * the range in BoolDecoder::get and BoolEncoder::put. Taken from
+ * libvpx/vp8/common/entropy.c
+ */
+const uint8_t vp8_norm[ 256 ] = {
+    0, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
 class BoolDecoder
 {
 private:
-  Chunk chunk_;
+  typedef uint64_t Value;
+  static constexpr int value_bits = 8 * sizeof( Value );
+
+  const uint8_t *position_, *end_;
+  uint64_t size_;
+
+  /* the next undecoded bits of the stream, most significant bit first */
+  Value value_;
+
+  /* number of valid bits in value_, minus the 8 that get() compares against */
+  int count_;
+
+  uint32_t range_;
 
-  uint32_t range_, value_;
-  char bit_count_;
+  /* octets shifted into value_ so far, counting the zeros read past the end */
+  uint64_t octets_loaded_;
 
-  bool valid_;
   bool complete_chunk_;
 
-  void load_octet( void )
+  /* top up value_ with as many whole octets as fit, eight at a time when
+     the chunk has them. past the end of the chunk, the stream reads as zeros. */
+  void fill( void )
   {
-    if ( chunk_.size() ) {
-      value_ |= chunk_.octet();
-      chunk_ = chunk_( 1 );
-    }
-    else if ( not complete_chunk_ ) {
-      valid_ = false;
+    const int available = count_ + 8;
+    const int octets = ( value_bits - available ) / 8;
+
+    if ( end_ - position_ >= static_cast<ptrdiff_t>( sizeof( Value ) ) ) {
+      Value word;
+      std::memcpy( &word, position_, sizeof( Value ) );
+      word = be64toh( word );
+
+      if ( octets < static_cast<int>( sizeof( Value ) ) ) {
+        word &= ~Value( 0 ) << ( value_bits - 8 * octets );
+      }
+
+      value_ |= word >> available;
+      position_ += octets;
+    } else {
+      int shift = value_bits - 8 - available;
+
+      for ( int i = 0; i < octets; i++, shift -= 8 ) {
+        if ( position_ < end_ ) {
+          value_ |= Value( *position_ ) << shift;
+          position_++;
+        }
+      }
     }
+
+    count_ += 8 * octets;
+    octets_loaded_ += octets;
   }
 
 public:
   BoolDecoder( const Chunk & s_chunk, const bool complete_chunk = true )
-    : chunk_( s_chunk ),
-      range_( 255 ),
+    : position_( s_chunk.buffer() ),
+      end_( s_chunk.buffer() + s_chunk.size() ),
+      size_( s_chunk.size() ),
       value_( 0 ),
-      bit_count_( 0 ),
-      valid_( true ),
+      count_( -8 ),
+      range_( 255 ),
+      octets_loaded_( 0 ),
       complete_chunk_( complete_chunk )
   {
-    load_octet();
-    value_ <<= 8;
-    load_octet();
+    fill();
   }
 
-  /* based on dixie bool_decoder.h */
+  /* based on dixie bool_decoder.h and libvpx dboolhuff.h */
   bool get( const Probability probability = 128 )
   {
     const uint32_t split = 1 + (((range_ - 1) * probability) >> 8);
-    const uint32_t SPLIT = split << 8;
+    const Value SPLIT = Value( split ) << ( value_bits - 8 );
     bool ret;
 
+    if ( count_ < 0 ) {
+      fill();
+    }
+
     if ( value_ >= SPLIT ) { /* encoded a one */
       ret = 1;
       range_ -= split;
@@ -94,23 +158,33 @@ public:
       range_ = split;
     }
 
-    while ( range_ < 128 ) {
-      value_ <<= 1;
-      range_ <<= 1;
-      if ( ++bit_count_ == 8 ) {
-        bit_count_ = 0;
-        load_octet();
-      }
-    }
+    const uint8_t shift = vp8_norm[ range_ ];
+    range_ <<= shift;
+    value_ <<= shift;
+    count_ -= shift;
 
     return ret;
   }
 
-  bool valid() const { return valid_; }
+  /* a decoder over a partial chunk becomes invalid once it has needed more
+     than the chunk holds. this keeps the accounting of the original
+     octet-at-a-time decoder, which always held two octets ahead of the
+     bits it had consumed. */
+  bool valid() const
+  {
+    if ( complete_chunk_ ) {
+      return true;
+    }
+
+    const uint64_t bits_consumed = 8 * octets_loaded_ - ( count_ + 8 );
+    return 2 + bits_consumed / 8 <= size_;
+  }
 
+  /* reads nothing but zeros. decoding still updates its state, and frames
+     can be parsed on several threads at once, so each thread has its own. */
   static BoolDecoder & zero_decoder()
   {
-    static BoolDecoder zd { { nullptr, 0 } };
+    thread_local BoolDecoder zd { { nullptr, 0 } };
     return zd;
   }
 
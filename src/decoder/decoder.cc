@@ -38,16 +38,24 @@ using namespace std;
 
 Decoder::Decoder( const uint16_t width, const uint16_t height )
   : state_( width, height ),
-    references_( width, height )
+    references_( width, height ),
+    state_id_( get_hash().hash() )
 {}
 
 Decoder::Decoder( DecoderState state, References refs )
-  : state_( state ), references_( refs )
+  : state_( state ), references_( refs ),
+    state_id_( get_hash().hash() )
+{}
+
+Decoder::Decoder( DecoderState state, References refs, const size_t state_id )
+  : state_( state ), references_( refs ),
+    state_id_( state_id )
 {}
 
 Decoder::Decoder(EncoderStateDeserializer &idata)
   : state_(move(DecoderState::deserialize(idata)))
-  , references_(move(References::deserialize(idata))) {
+  , references_(move(References::deserialize(idata)))
+  , state_id_(get_hash().hash()) {
   assert(idata.remaining() == 0);
 }
 
@@ -89,7 +97,7 @@ UncompressedChunk Decoder::decompress_frame( const Chunk & compressed_frame ) co
 template<class FrameType>
 FrameType Decoder::parse_frame( const UncompressedChunk & decompressed_frame )
 {
-  return state_.parse_and_apply<FrameType>( decompressed_frame );
+  return state_.parse_and_apply<FrameType>( decompressed_frame, thread_count_ );
 }
 template KeyFrame Decoder::parse_frame<KeyFrame>( const UncompressedChunk & decompressed_frame );
 template InterFrame Decoder::parse_frame<InterFrame>( const UncompressedChunk & decompressed_frame );
@@ -106,9 +114,8 @@ pair<bool, RasterHandle> Decoder::decode_frame( const FrameType & frame )
 
   const bool shown = frame.show_frame();
 
-  frame.decode( state_.segmentation, references_, raster );
-
-  frame.loopfilter( state_.segmentation, state_.filter_adjustments, raster );
+  frame.decode_and_loopfilter( state_.segmentation, state_.filter_adjustments,
+                               references_, raster, thread_count_ );
 
   RasterHandle immutable_raster( move( raster ) );
 
@@ -126,9 +133,13 @@ pair<bool, RasterHandle> Decoder::get_frame_output( const Chunk & compressed_fra
 {
   UncompressedChunk decompressed_frame = decompress_frame( compressed_frame );
   if ( decompressed_frame.key_frame() ) {
-    return decode_frame( parse_frame<KeyFrame>( decompressed_frame ) );
+    auto output = decode_frame( parse_frame<KeyFrame>( decompressed_frame ) );
+    state_id_ = next_state_id( state_id_, compressed_frame );
+    return output;
   } else if ( not decompressed_frame.experimental() ) {
-    return decode_frame( parse_frame<InterFrame>( decompressed_frame ) );
+    auto output = decode_frame( parse_frame<InterFrame>( decompressed_frame ) );
+    state_id_ = next_state_id( state_id_, compressed_frame );
+    return output;
   } else {
     throw Unsupported( "experimental" );
   }
@@ -140,6 +151,17 @@ Optional<RasterHandle> Decoder::parse_and_decode_frame( const Chunk & compressed
   return make_optional( output.first, output.second );
 }
 
+/* the decoder's width and height are the only settings that change what a
+   frame decodes to, and they are already part of the starting state */
+size_t Decoder::next_state_id( const size_t state_id, const Chunk & compressed_frame )
+{
+  size_t hash_val = state_id;
+  boost::hash_combine( hash_val, compressed_frame.size() );
+  boost::hash_range( hash_val, compressed_frame.buffer(),
+                     compressed_frame.buffer() + compressed_frame.size() );
+  return hash_val;
+}
+
 DecoderHash Decoder::get_hash( void ) const
 {
   return DecoderHash( state_.hash(), references_.last.hash(),
@@ -168,6 +190,13 @@ References::References( MutableRasterHandle && raster )
     alternative( last )
 {}
 
+References::References( const RasterHandle & s_last, const RasterHandle & s_golden,
+                        const RasterHandle & s_alternative )
+  : last( s_last ),
+    golden( s_golden ),
+    alternative( s_alternative )
+{}
+
 References::References(EncoderStateDeserializer &idata, const uint16_t width, const uint16_t height)
   : last( move( idata.get_ref( EncoderSerDesTag::REF_LAST, width, height ) ) )
   , golden( last )
@@ -513,9 +542,12 @@ bool DecoderHash::operator!=( const DecoderHash & other ) const
   return not operator==( other );
 }
 
+/* built from the stable raster hashes, since IVF headers store it */
 uint32_t Decoder::minihash() const
 {
-  return static_cast<uint32_t>( get_hash().hash() );
+  return static_cast<uint32_t>( DecoderHash( state_.hash(), references_.last.stable_hash(),
+                                             references_.golden.stable_hash(),
+                                             references_.alternative.stable_hash() ).hash() );
 }
 
 
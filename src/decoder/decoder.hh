@@ -90,6 +90,21 @@ struct ProbabilityTables
   }
 };
 
+/* the coefficient token probabilities of one frame, laid out once per frame
+   by coefficient position instead of by band, so that the token decoder
+   finds the tree probabilities for each position and context without a
+   coefficient_to_band lookup. each context's probabilities are padded to
+   16 bytes, and the whole table is cache-line aligned. */
+struct TokenProbabilities
+{
+  typedef SafeArray< Probability, 16 > Nodes;
+  typedef SafeArray< SafeArray< Nodes, PREV_COEF_CONTEXTS >, 16 > Positions;
+
+  alignas( 64 ) SafeArray< Positions, BLOCK_TYPES > probabilities;
+
+  TokenProbabilities( const ProbabilityTables & tables );
+};
+
 struct FilterAdjustments
 {
   /* Adjustments to the deblocking filter based on the macroblock's reference frame */
@@ -128,6 +143,9 @@ struct References
 
   References( MutableRasterHandle && raster );
 
+  References( const RasterHandle & last, const RasterHandle & golden,
+              const RasterHandle & alternative );
+
   References(EncoderStateDeserializer &idata, const uint16_t width, const uint16_t height);
 
   const VP8Raster & at( const reference_frame reference_id ) const
@@ -195,7 +213,6 @@ struct DecoderState
   Optional<Segmentation> segmentation = {};
   Optional<FilterAdjustments> filter_adjustments = {};
 
-  // testing only
   DecoderState(const unsigned s_width, const unsigned s_height,
                ProbabilityTables &&p, Optional<Segmentation> &&s,
                Optional<FilterAdjustments> &&f);
@@ -209,7 +226,8 @@ struct DecoderState
                 const unsigned int s_height );
 
   template <class FrameType>
-  FrameType parse_and_apply( const UncompressedChunk & uncompressed_chunk );
+  FrameType parse_and_apply( const UncompressedChunk & uncompressed_chunk,
+                             const unsigned int thread_count = 1 );
 
   bool operator==( const DecoderState & other ) const;
 
@@ -247,11 +265,17 @@ private:
   DecoderState state_;
   References references_;
 
+  /* see state_id() */
+  size_t state_id_;
+
   bool error_concealment_ { false };
 
+  unsigned int thread_count_ { 1 };
+
 public:
   Decoder( const uint16_t width, const uint16_t height );
   Decoder( DecoderState state, References references );
+  Decoder( DecoderState state, References references, const size_t state_id );
   Decoder( EncoderStateDeserializer &idata );
 
   const VP8Raster & example_raster( void ) const { return references_.last; }
@@ -273,6 +297,7 @@ public:
   void apply_decoded_frame( const FrameType & frame, const RasterHandle & output, const Decoder & target )
   {
     state_ = target.state_;
+    state_id_ = target.state_id_;
     frame.copy_to( output, references_ );
   }
 
@@ -291,12 +316,27 @@ public:
 
   bool minihash_match( const uint32_t other_minihash ) const;
 
+  /* an identity of the decoder's state that follows from how it was reached
+     rather than from its contents: each frame passed to get_frame_output()
+     turns it into next_state_id( previous id, frame ). decoders that start
+     from the same state and are given the same frames end up with the same
+     id without hashing any pixels. a decoder whose history isn't known
+     (built from a width and height, a state, or serialized data) starts
+     from get_hash(). decode_frame() alone leaves the id behind. */
+  size_t state_id() const { return state_id_; }
+
+  static size_t next_state_id( const size_t state_id, const Chunk & compressed_frame );
+
   size_t serialize(EncoderStateSerializer &odata) const;
 
   static Decoder deserialize(EncoderStateDeserializer &idata);
 
   void set_error_concealment( const bool val ) { error_concealment_ = val; }
   bool error_concealment() const { return error_concealment_; }
+
+  /* number of threads a single frame may be decoded on */
+  void set_thread_count( const unsigned int val ) { thread_count_ = val ? val : 1; }
+  unsigned int thread_count() const { return thread_count_; }
 };
 
 
@@ -70,7 +70,8 @@ template
 void FilterAdjustments::update<InterFrameHeader>(const InterFrameHeader &header);
 
 template <>
-inline KeyFrame DecoderState::parse_and_apply<KeyFrame>( const UncompressedChunk & uncompressed_chunk )
+inline KeyFrame DecoderState::parse_and_apply<KeyFrame>( const UncompressedChunk & uncompressed_chunk,
+                                                         const unsigned int thread_count )
 {
   assert( uncompressed_chunk.key_frame() );
 
@@ -105,13 +106,14 @@ inline KeyFrame DecoderState::parse_and_apply<KeyFrame>( const UncompressedChunk
   }
 
   myframe.parse_tokens( uncompressed_chunk.dct_partitions( myframe.dct_partition_count() ),
-                        frame_probability_tables );
+                        frame_probability_tables, thread_count );
 
   return myframe;
 }
 
 template <>
-inline InterFrame DecoderState::parse_and_apply<InterFrame>( const UncompressedChunk & uncompressed_chunk )
+inline InterFrame DecoderState::parse_and_apply<InterFrame>( const UncompressedChunk & uncompressed_chunk,
+                                                             const unsigned int thread_count )
 {
   assert( not uncompressed_chunk.key_frame() );
 
@@ -161,7 +163,7 @@ inline InterFrame DecoderState::parse_and_apply<InterFrame>( const UncompressedC
   }
 
   myframe.parse_tokens( uncompressed_chunk.dct_partitions( myframe.dct_partition_count() ),
-                        frame_probability_tables );
+                        frame_probability_tables, thread_count );
 
   return myframe;
 }
@@ -183,6 +183,7 @@ class EncoderStateDeserializer : File {
         raster.get().Y().forall([this](uint8_t &f){ f = this->get<uint8_t>(); });
         raster.get().U().forall([this](uint8_t &f){ f = this->get<uint8_t>(); });
         raster.get().V().forall([this](uint8_t &f){ f = this->get<uint8_t>(); });
+        raster.get().extend_borders();
       }
 
       return raster;
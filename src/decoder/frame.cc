@@ -27,6 +27,9 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "frame.hh"
+#include "parallel.hh"
+
+#include <algorithm>
 
 using namespace std;
 
@@ -120,68 +123,111 @@ void Frame<FrameHeaderType, MacroblockType>::update_segmentation( SegmentationMa
 
 template <class FrameHeaderType, class MacroblockType>
 void Frame<FrameHeaderType, MacroblockType>::parse_tokens( vector< Chunk > dct_partitions,
-                                                           const ProbabilityTables & probability_tables )
+                                                           const ProbabilityTables & probability_tables,
+                                                           const unsigned int thread_count )
 {
   vector<BoolDecoder> dct_partition_decoders;
   for ( const auto & x : dct_partitions ) {
     dct_partition_decoders.emplace_back( x );
   }
 
-  /* parse every macroblock's tokens */
-  macroblock_headers_.get().forall_ij( [&]( MacroblockType & macroblock,
-                                            const unsigned int,
-                                            const unsigned int row )
-                                       {
-                                         macroblock.parse_tokens( dct_partition_decoders.at( row % dct_partition_decoders.size() ),
-                                                                  probability_tables ); } );
+  const TokenProbabilities token_probabilities( probability_tables );
+
+  const unsigned int partition_count = dct_partition_decoders.size();
+  const unsigned int worker_count = min( { thread_count, partition_count, macroblock_height_ } );
+
+  if ( worker_count <= 1 ) {
+    /* parse every macroblock's tokens */
+    macroblock_headers_.get().forall_ij( [&]( MacroblockType & macroblock,
+                                              const unsigned int,
+                                              const unsigned int row )
+                                         {
+                                           macroblock.parse_tokens( dct_partition_decoders.at( row % partition_count ),
+                                                                    token_probabilities ); } );
+    return;
+  }
+
+  /* Row r is coded in partition r % N. The only state shared between rows
+     is the nonzero context of the blocks above, so a row can go ahead as
+     soon as the macroblock above the current one has been parsed. Each
+     worker takes every row of its partition(s), in order. */
+  TwoD<MacroblockType> & macroblocks = macroblock_headers_.get();
+  RowProgress progress( macroblock_height_ );
+
+  run_workers( worker_count, progress,
+               [&]( const unsigned int worker )
+               {
+                 for ( unsigned int row = 0; row < macroblock_height_; row++ ) {
+                   const unsigned int partition = row % partition_count;
+                   if ( partition % worker_count != worker ) {
+                     continue;
+                   }
+
+                   BoolDecoder & data = dct_partition_decoders.at( partition );
+
+                   for ( unsigned int column = 0; column < macroblock_width_; column++ ) {
+                     progress.wait( row - 1, column + 1 );
+                     macroblocks.at( column, row ).parse_tokens( data, token_probabilities );
+                     progress.advance( row, column + 1 );
+                   }
+                 }
+               } );
+}
+
+template <class FrameHeaderType, class MacroblockType>
+SafeArray< FilterParameters, num_segments > Frame<FrameHeaderType, MacroblockType>::calculate_segment_loopfilters( const Optional< Segmentation > & segmentation ) const
+{
+  /* calculate per-segment filter adjustments if
+     segmentation is enabled */
+
+  SafeArray< FilterParameters, num_segments > segment_loopfilters;
+
+  if ( segmentation.initialized() ) {
+    for ( uint8_t i = 0; i < num_segments; i++ ) {
+      FilterParameters segment_filter( header_.filter_type,
+                                       header_.loop_filter_level,
+                                       header_.sharpness_level );
+      segment_filter.filter_level = segmentation.get().segment_filter_adjustments.at( i )
+        + ( segmentation.get().absolute_segment_adjustments
+            ? 0
+            : segment_filter.filter_level );
+
+      segment_loopfilters.at( i ) = segment_filter;
+    }
+  }
+
+  return segment_loopfilters;
 }
 
 template <class FrameHeaderType, class MacroblockType>
 void Frame<FrameHeaderType, MacroblockType>::loopfilter( const Optional< Segmentation > & segmentation,
                                                          const Optional< FilterAdjustments > & filter_adjustments,
-                                                         VP8Raster & raster ) const
+                                                         VP8Raster & raster,
+                                                         const unsigned int thread_count ) const
 {
   if ( header_.loop_filter_level ) {
-    /* calculate per-segment filter adjustments if
-       segmentation is enabled */
-
     const FilterParameters frame_loopfilter( header_.filter_type,
                                              header_.loop_filter_level,
                                              header_.sharpness_level );
-
-    SafeArray< FilterParameters, num_segments > segment_loopfilters;
-
-    if ( segmentation.initialized() ) {
-      for ( uint8_t i = 0; i < num_segments; i++ ) {
-        FilterParameters segment_filter( header_.filter_type,
-                                         header_.loop_filter_level,
-                                         header_.sharpness_level );
-        segment_filter.filter_level = segmentation.get().segment_filter_adjustments.at( i )
-          + ( segmentation.get().absolute_segment_adjustments
-              ? 0
-              : segment_filter.filter_level );
-
-        segment_loopfilters.at( i ) = segment_filter;
-      }
-    }
+    const auto segment_loopfilters = calculate_segment_loopfilters( segmentation );
 
     /* the macroblock needs to know whether the mode- and reference-based
        filter adjustments are enabled */
 
-    macroblock_headers_.get().forall_ij( [&]( const MacroblockType & macroblock,
-                                              const unsigned int column,
-                                              const unsigned int row )
-                                         {
-                                           VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                           macroblock.loopfilter( filter_adjustments,
-                                                                  segmentation.initialized()
-                                                                  ? segment_loopfilters.at( macroblock.segment_id() )
-                                                                  : frame_loopfilter,
-                                                                  output ); } );
+    wavefront_forall_ij( thread_count,
+                         [&]( const MacroblockType & macroblock,
+                              const unsigned int column,
+                              const unsigned int row )
+                         {
+                           const VP8Raster::MacroblockView output = raster.macroblock_view( column, row );
+                           macroblock.loopfilter( filter_adjustments,
+                                                  segmentation.initialized()
+                                                  ? segment_loopfilters.at( macroblock.segment_id() )
+                                                  : frame_loopfilter,
+                                                  output ); } );
   }
 }
 
-
 template <class FrameHeaderType, class MacroblockType>
 SafeArray<Quantizer, num_segments> Frame<FrameHeaderType, MacroblockType>::calculate_segment_quantizers( const Optional< Segmentation > & segmentation ) const
 {
@@ -205,65 +251,176 @@ SafeArray<Quantizer, num_segments> Frame<FrameHeaderType, MacroblockType>::calcu
   return segment_quantizers;
 }
 
+template <class FrameHeaderType, class MacroblockType>
+template <class lambda>
+void Frame<FrameHeaderType, MacroblockType>::wavefront_forall_ij( const unsigned int thread_count,
+                                                                  const lambda & f ) const
+{
+  const TwoD<MacroblockType> & macroblocks = macroblock_headers_.get();
+
+  run_wavefront( thread_count, macroblock_width_, macroblock_height_,
+                 [&]( const unsigned int column, const unsigned int row, const unsigned int )
+                 {
+                   f( macroblocks.at( column, row ), column, row );
+                 } );
+}
+
 template <>
-void KeyFrame::decode( const Optional< Segmentation > & segmentation, const References &,
-                       VP8Raster & raster ) const
+void KeyFrame::reconstruct( const KeyFrameMacroblock & macroblock, const Quantizer & quantizer,
+                            const References &, const VP8Raster::MacroblockView & output ) const
+{
+  macroblock.reconstruct_intra( quantizer, output );
+}
+
+template <>
+void InterFrame::reconstruct( const InterFrameMacroblock & macroblock, const Quantizer & quantizer,
+                              const References & references, const VP8Raster::MacroblockView & output ) const
+{
+  if ( macroblock.inter_coded() ) {
+    macroblock.reconstruct_inter( quantizer,
+                                  references,
+                                  output );
+  } else {
+    macroblock.reconstruct_intra( quantizer,
+                                  output );
+  }
+}
+
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::decode( const Optional< Segmentation > & segmentation,
+                                                     const References & references,
+                                                     VP8Raster & raster, const unsigned int thread_count ) const
 {
   const Quantizer frame_quantizer( header_.quant_indices );
   const auto segment_quantizers = calculate_segment_quantizers( segmentation );
 
   /* process each macroblock */
-  macroblock_headers_.get().forall_ij( [&]( const KeyFrameMacroblock & macroblock,
-                                            const unsigned int column,
-                                            const unsigned int row ) {
-                                         const auto & quantizer = segmentation.initialized()
-                                           ? segment_quantizers.at( macroblock.segment_id() )
-                                           : frame_quantizer;
-                                         VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                         macroblock.reconstruct_intra( quantizer, output );
-                                       } );
+  wavefront_forall_ij( thread_count,
+                       [&]( const MacroblockType & macroblock,
+                            const unsigned int column,
+                            const unsigned int row ) {
+                         const auto & quantizer = segmentation.initialized()
+                           ? segment_quantizers.at( macroblock.segment_id() )
+                           : frame_quantizer;
+                         const VP8Raster::MacroblockView output = raster.macroblock_view( column, row );
+                         reconstruct( macroblock, quantizer, references, output );
+                       } );
 }
 
-template <>
-void InterFrame::decode( const Optional<Segmentation> & segmentation, const References & references,
-                         VP8Raster & raster ) const
+/* filtering a macroblock rewrites its own pixels (including its bottom row, which
+   intra prediction in the row below still needs unfiltered) and the edges it
+   shares with the macroblocks to its left and above. so row r - 1 is filtered
+   as soon as row r has been reconstructed, which gives the same result as
+   filtering the whole frame afterwards while the rows are still in cache. */
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::decode_and_loopfilter( const Optional< Segmentation > & segmentation,
+                                                                    const Optional< FilterAdjustments > & filter_adjustments,
+                                                                    const References & references,
+                                                                    HashCachedRaster & raster,
+                                                                    const unsigned int thread_count ) const
 {
+  /* without the loop filter, the bands are left for hash() */
+  if ( not header_.loop_filter_level ) {
+    decode( segmentation, references, raster, thread_count );
+    raster.extend_borders();
+    return;
+  }
+
   const Quantizer frame_quantizer( header_.quant_indices );
   const auto segment_quantizers = calculate_segment_quantizers( segmentation );
 
-  /* process each macroblock */
-  macroblock_headers_.get().forall_ij( [&]( const InterFrameMacroblock & macroblock,
-                                            const unsigned int column,
-                                            const unsigned int row ) {
-                                         const auto & quantizer = segmentation.initialized()
-                                           ? segment_quantizers.at( macroblock.segment_id() )
-                                           : frame_quantizer;
-                                         VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                         if ( macroblock.inter_coded() ) {
-                                           macroblock.reconstruct_inter( quantizer,
-                                                                         references,
-                                                                         output );
-                                         } else {
-                                           macroblock.reconstruct_intra( quantizer,
-                                                                         output );
-                                         } } );
+  const FilterParameters frame_loopfilter( header_.filter_type,
+                                           header_.loop_filter_level,
+                                           header_.sharpness_level );
+  const auto segment_loopfilters = calculate_segment_loopfilters( segmentation );
+
+  const TwoD<MacroblockType> & macroblocks = macroblock_headers_.get();
+
+  /* with several threads, each row waits for the one above as in
+     wavefront_forall_ij, and filtering waits for the previous row's
+     filter to get past the macroblocks whose edges it shares */
+  const unsigned int worker_count = max( 1u, min( thread_count, macroblock_height_ ) );
+  RowProgress reconstructed( macroblock_height_ ), filtered( macroblock_height_ );
+
+  auto process_rows = [&]( const unsigned int worker )
+    {
+      /* the extra pass at row == height just filters the last row */
+      for ( unsigned int row = worker; row <= macroblock_height_; row += worker_count ) {
+        if ( row < macroblock_height_ ) {
+          for ( unsigned int column = 0; column < macroblock_width_; column++ ) {
+            reconstructed.wait( row - 1, min( column + 2, macroblock_width_ ) );
+
+            const MacroblockType & macroblock = macroblocks.at( column, row );
+            const auto & quantizer = segmentation.initialized()
+              ? segment_quantizers.at( macroblock.segment_id() )
+              : frame_quantizer;
+            const VP8Raster::MacroblockView output = raster.macroblock_view( column, row );
+            reconstruct( macroblock, quantizer, references, output );
+
+            reconstructed.advance( row, column + 1 );
+          }
+        }
+
+        if ( row > 0 ) {
+          const unsigned int filter_row = row - 1;
+
+          for ( unsigned int column = 0; column < macroblock_width_; column++ ) {
+            filtered.wait( filter_row - 1, min( column + 2, macroblock_width_ ) );
+
+            const MacroblockType & macroblock = macroblocks.at( column, filter_row );
+            const VP8Raster::MacroblockView output = raster.macroblock_view( column, filter_row );
+            macroblock.loopfilter( filter_adjustments,
+                                   segmentation.initialized()
+                                   ? segment_loopfilters.at( macroblock.segment_id() )
+                                   : frame_loopfilter,
+                                   output );
+
+            filtered.advance( filter_row, column + 1 );
+          }
+
+          /* filtering a row changes the bottom of the one above it, and
+             nothing after that touches either of them */
+          if ( filter_row > 0 ) {
+            raster.freeze_band( filter_row - 1 );
+          }
+
+          if ( filter_row == macroblock_height_ - 1 ) {
+            raster.freeze_band( filter_row );
+          }
+        }
+      }
+    };
+
+  run_workers( worker_count, reconstructed,
+               [&]( const unsigned int worker )
+               {
+                 /* run_workers only aborts the progress it was handed */
+                 try {
+                   process_rows( worker );
+                 } catch ( ... ) {
+                   filtered.abort();
+                   throw;
+                 }
+               } );
+
+  raster.extend_borders();
 }
 
 /* "above" for a Y2 block refers to the first macroblock above that actually has Y2 coded */
-/* here we relink the "above" and "left" pointers after we learn the prediction mode
+/* here we relink the "above" and "left" neighbours after we learn the prediction mode
    for the block */
 template <class FrameHeaderType, class MacroblockType>
 void Frame<FrameHeaderType, MacroblockType>::relink_y2_blocks( void )
 {
-  vector< Optional< const Y2Block * > > above_coded( macroblock_width_ );
-  vector< Optional< const Y2Block * > > left_coded( macroblock_height_ );
+  vector< Optional< unsigned int > > above_coded( macroblock_width_ );
+  vector< Optional< unsigned int > > left_coded( macroblock_height_ );
 
   Y2_.forall_ij( [&]( Y2Block & block, const unsigned int column, const unsigned int row ) {
       block.set_above( above_coded.at( column ) );
       block.set_left( left_coded.at( row ) );
       if ( block.coded() ) {
-        above_coded.at( column ) = &block;
-        left_coded.at( row ) = &block;
+        above_coded.at( column ) = Optional< unsigned int >( true, row );
+        left_coded.at( row ) = Optional< unsigned int >( true, column );
       }
     } );
 }
@@ -64,15 +64,37 @@ class Frame
 
   ProbabilityArray< num_segments > calculate_mb_segment_tree_probs( void ) const;
   SafeArray< Quantizer, num_segments > calculate_segment_quantizers( const Optional< Segmentation > & segmentation ) const;
+  SafeArray< FilterParameters, num_segments > calculate_segment_loopfilters( const Optional< Segmentation > & segmentation ) const;
+
+  void reconstruct( const MacroblockType & macroblock, const Quantizer & quantizer,
+                    const References & references, const VP8Raster::MacroblockView & output ) const;
+
+  /* visit every macroblock in raster order, or as a row wavefront over
+     thread_count threads with each row staying two macroblocks behind the
+     one above (enough for intra prediction's above-right pixels, and for
+     the loop filter's edges shared with the macroblocks above) */
+  template <class lambda>
+  void wavefront_forall_ij( const unsigned int thread_count, const lambda & f ) const;
+
+  void encode_first_partition( BoolEncoder & encoder, const ProbabilityTables & probability_tables ) const;
+
+  template <class DCTPartitions>
+  void encode_tokens( DCTPartitions & dct_partitions, const ProbabilityTables & probability_tables,
+                      const unsigned int thread_count ) const;
 
   std::vector< uint8_t > serialize_first_partition( const ProbabilityTables & probability_tables ) const;
-  std::vector< std::vector< uint8_t > > serialize_tokens( const ProbabilityTables & probability_tables ) const;
+  std::vector< std::vector< uint8_t > > serialize_tokens( const ProbabilityTables & probability_tables,
+                                                         const unsigned int thread_count ) const;
+
+  /* the size of every partition, plus the DCT partition lengths */
+  size_t count_partition_bytes( const ProbabilityTables & probability_tables,
+                                const unsigned int thread_count ) const;
 
  public:
   void relink_y2_blocks( void );
   void loopfilter( const Optional< Segmentation > & segmentation,
                    const Optional< FilterAdjustments > & quantizer_filter_adjustments,
-                   VP8Raster & target ) const;
+                   VP8Raster & target, const unsigned int thread_count = 1 ) const;
 
   Frame( const bool show,
          const unsigned int width,
@@ -91,10 +113,20 @@ class Frame
 
   void update_segmentation( SegmentationMap & mutable_segmentation_map );
 
-  void parse_tokens( std::vector< Chunk > dct_partitions, const ProbabilityTables & probability_tables );
+  /* with thread_count > 1, the DCT partitions are parsed concurrently */
+  void parse_tokens( std::vector< Chunk > dct_partitions, const ProbabilityTables & probability_tables,
+                     const unsigned int thread_count = 1 );
 
   void decode( const Optional< Segmentation > & segmentation, const References & references,
-               VP8Raster & raster ) const;
+               VP8Raster & raster, const unsigned int thread_count = 1 ) const;
+
+  /* same result as decode() followed by loopfilter(), in a single pass over the
+     frame, and then extends the borders so the raster can serve as a reference.
+     each macroblock row is hashed as soon as it is final. */
+  void decode_and_loopfilter( const Optional< Segmentation > & segmentation,
+                              const Optional< FilterAdjustments > & filter_adjustments,
+                              const References & references,
+                              HashCachedRaster & raster, const unsigned int thread_count = 1 ) const;
 
   void copy_to( const RasterHandle & raster, References & references ) const;
 
@@ -102,7 +134,13 @@ class Frame
 
   std::string stats( void ) const;
 
-  std::vector< uint8_t > serialize( const ProbabilityTables & probability_tables ) const;
+  /* with thread_count > 1, the DCT partitions are serialized concurrently */
+  std::vector< uint8_t > serialize( const ProbabilityTables & probability_tables,
+                                    const unsigned int thread_count = 1 ) const;
+
+  /* exactly serialize( ... ).size(), but without producing any bytes */
+  size_t serialized_size( const ProbabilityTables & probability_tables,
+                          const unsigned int thread_count = 1 ) const;
 
   uint8_t dct_partition_count( void ) const { return 1 << header_.log2_number_of_dct_partitions; }
 
@@ -26,37 +26,33 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
-#include "exception.hh"
+#include <initializer_list>
+#include <type_traits>
+
 #include "frame_pool.hh"
 
 using namespace std;
 
-/* helper to dequeue front element from a queue */
-template <typename T>
-static T dequeue( queue<T> & q )
+template<class FrameType>
+size_t FramePool<FrameType>::frame_bytes( const FrameType & frame )
 {
-  T ret { move( q.front() ) };
-  q.pop();
-  return ret;
+  typedef typename decay<decltype( frame.macroblocks().at( 0, 0 ) )>::type MacroblockType;
+
+  const size_t macroblocks = VP8Raster::macroblock_dimension( frame.display_width() )
+    * VP8Raster::macroblock_dimension( frame.display_height() );
+
+  return sizeof( FrameType ) + macroblocks * ( sizeof( MacroblockType ) + sizeof( Y2Block )
+                                               + 16 * sizeof( YBlock ) + 8 * sizeof( UVBlock ) );
 }
 
 template<class FrameType>
 typename FramePool<FrameType>::FrameHolder FramePool<FrameType>::make_frame( const uint16_t width,
                                                                              const uint16_t height )
 {
-  unique_lock<mutex> lock { mutex_ };
-
-  FrameHolder ret;
+  FrameHolder ret { unused_frames_.take( width, height ) };
 
-  if ( unused_frames_.empty() ) {
+  if ( not ret ) {
     ret.reset( new FrameType( width, height ) );
-  } else {
-    if ( (unused_frames_.front()->display_width() != width )
-         or (unused_frames_.front()->display_height() != height ) ) {
-      throw Unsupported( "frame size has changed" );
-    } else {
-      ret = dequeue( unused_frames_ );
-    }
   }
 
   ret.get_deleter().set_frame_pool( this );
@@ -67,10 +63,8 @@ typename FramePool<FrameType>::FrameHolder FramePool<FrameType>::make_frame( con
 template<class FrameType>
 void FramePool<FrameType>::free_frame( FrameType * frame )
 {
-  unique_lock<mutex> lock { mutex_ };
-
   assert( frame );
-  unused_frames_.emplace( frame );
+  unused_frames_.give( frame );
 }
 
 template<class FrameType>
@@ -103,6 +97,47 @@ static FramePool<FrameType> & global_frame_pool()
   return pool;
 }
 
+template<class FrameType>
+FramePool<FrameType> & subsampled_frame_pool()
+{
+  static FramePool<FrameType> pool;
+  return pool;
+}
+
+template FramePool<KeyFrame> & subsampled_frame_pool();
+template FramePool<InterFrame> & subsampled_frame_pool();
+
+PoolStats frame_pool_stats( void )
+{
+  PoolStats total { 0, 0 };
+
+  for ( const PoolStats & counts : { global_frame_pool<KeyFrame>().stats(),
+                                     global_frame_pool<InterFrame>().stats(),
+                                     subsampled_frame_pool<KeyFrame>().stats(),
+                                     subsampled_frame_pool<InterFrame>().stats() } ) {
+    total.hits += counts.hits;
+    total.misses += counts.misses;
+  }
+
+  return total;
+}
+
+void set_frame_pool_budget( const size_t bytes )
+{
+  global_frame_pool<KeyFrame>().set_budget( bytes );
+  global_frame_pool<InterFrame>().set_budget( bytes );
+  subsampled_frame_pool<KeyFrame>().set_budget( bytes );
+  subsampled_frame_pool<InterFrame>().set_budget( bytes );
+}
+
+void trim_frame_pools( void )
+{
+  global_frame_pool<KeyFrame>().trim();
+  global_frame_pool<InterFrame>().trim();
+  subsampled_frame_pool<KeyFrame>().trim();
+  subsampled_frame_pool<InterFrame>().trim();
+}
+
 template<class FrameType>
 FrameHandle<FrameType>::FrameHandle( const uint16_t width,
                                      const uint16_t height )
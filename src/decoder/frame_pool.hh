@@ -29,11 +29,10 @@
 #ifndef FRAME_POOL_HH
 #define FRAME_POOL_HH
 
-#include <mutex>
-#include <queue>
 #include <memory>
 
 #include "frame.hh"
+#include "free_list.hh"
 
 template <class FrameType> class FramePool;
 
@@ -57,15 +56,23 @@ public:
   typedef std::unique_ptr<FrameType, FrameDeleter<FrameType>> FrameHolder;
 
 private:
-  std::queue<FrameHolder> unused_frames_ {};
+  static size_t frame_bytes( const FrameType & frame );
 
-  std::mutex mutex_ {};
+  SizeClassPool<FrameType> unused_frames_ { frame_bytes };
 
 public:
   FrameHolder make_frame( const uint16_t width,
                           const uint16_t height );
 
   void free_frame( FrameType * frame );
+
+  PoolStats stats( void ) const { return unused_frames_.stats(); }
+
+  /* unused frames beyond the budget (unlimited by default) are freed,
+     least recently used sizes first; trim() frees all of them except
+     the few other threads keep cached */
+  void set_budget( const size_t bytes ) { unused_frames_.set_budget( bytes ); }
+  void trim( void ) { unused_frames_.trim(); }
 };
 
 template<class FrameType>
@@ -89,4 +96,15 @@ public:
 using KeyFrameHandle = FrameHandle<KeyFrame>;
 using InterFrameHandle = FrameHandle<InterFrame>;
 
+/* a pool of its own for the encoder's subsampled frames, so they don't
+   push the full-size ones out of the pool behind FrameHandle */
+template<class FrameType>
+FramePool<FrameType> & subsampled_frame_pool();
+
+/* these cover the key frame and inter frame pools behind FrameHandle and
+   the subsampled ones; the budget applies to each of the four */
+PoolStats frame_pool_stats( void );
+void set_frame_pool_budget( const size_t bytes );
+void trim_frame_pools( void );
+
 #endif /* FRAME_POOL_HH */
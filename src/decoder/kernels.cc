@@ -0,0 +1,849 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "config.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "kernels.hh"
+#include "vp8_raster.hh"
+#include "loopfilter_filters.hh"
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+
+#include "predictor_sse.hh"
+#include "transform_sse.hh"
+#include "sad_sse.hh"
+#include "intrapred_sse.hh"
+#include "dct_sse.hh"
+#include "variance_sse.hh"
+#endif
+
+#ifdef HAVE_AVX2
+#include "kernels_avx2.hh"
+#endif
+
+const SafeArray<SafeArray<int16_t, 6>, 8> sixtap_filters =
+  {{ { { 0,  0,  128,    0,   0,  0 } },
+     { { 0, -6,  123,   12,  -1,  0 } },
+     { { 2, -11, 108,   36,  -8,  1 } },
+     { { 0, -9,   93,   50,  -6,  0 } },
+     { { 3, -16,  77,   77, -16,  3 } },
+     { { 0, -6,   50,   93,  -9,  0 } },
+     { { 1, -8,   36,  108, -11,  2 } },
+     { { 0, -1,   12,  123,  -6,  0 } } }};
+
+/* SIX-TAP PREDICTION */
+
+template <unsigned int width>
+static void sixtap_horizontal_c( const uint8_t * src, const unsigned int src_stride,
+                                 uint8_t * dst, const unsigned int dst_stride,
+                                 const unsigned int height, const unsigned int filter_index )
+{
+  const auto & filter = sixtap_filters.at( filter_index );
+
+  for ( unsigned int row = 0; row < height; row++ ) {
+    for ( unsigned int column = 0; column < width; column++ ) {
+      const uint8_t * taps = src + column - 2;
+      dst[ column ] = clamp255( ( ( taps[ 0 ] * filter.at( 0 ) )
+                                  + ( taps[ 1 ] * filter.at( 1 ) )
+                                  + ( taps[ 2 ] * filter.at( 2 ) )
+                                  + ( taps[ 3 ] * filter.at( 3 ) )
+                                  + ( taps[ 4 ] * filter.at( 4 ) )
+                                  + ( taps[ 5 ] * filter.at( 5 ) )
+                                  + 64 ) >> 7 );
+    }
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+template <unsigned int width>
+static void sixtap_vertical_c( const uint8_t * src, const unsigned int src_stride,
+                               uint8_t * dst, const unsigned int dst_stride,
+                               const unsigned int height, const unsigned int filter_index )
+{
+  const auto & filter = sixtap_filters.at( filter_index );
+
+  for ( unsigned int row = 0; row < height; row++ ) {
+    for ( unsigned int column = 0; column < width; column++ ) {
+      const uint8_t * taps = src + column;
+      dst[ column ] = clamp255( ( ( taps[ 0 ]              * filter.at( 0 ) )
+                                  + ( taps[ src_stride ]     * filter.at( 1 ) )
+                                  + ( taps[ src_stride * 2 ] * filter.at( 2 ) )
+                                  + ( taps[ src_stride * 3 ] * filter.at( 3 ) )
+                                  + ( taps[ src_stride * 4 ] * filter.at( 4 ) )
+                                  + ( taps[ src_stride * 5 ] * filter.at( 5 ) )
+                                  + 64 ) >> 7 );
+    }
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+/* INVERSE DCT */
+
+static inline int MUL_20091( const int a ) { return ((((a)*20091) >> 16) + (a)); }
+static inline int MUL_35468( const int a ) { return (((a)*35468) >> 16); }
+
+static void idct_add_c( const int16_t * coefficients, uint8_t * dst, const int stride )
+{
+  SafeArray< int16_t, 16 > intermediate;
+
+  /* Based on libav/ffmpeg vp8_idct_add_c */
+
+  for ( int i = 0; i < 4; i++ ) {
+    int t0 = coefficients[ i + 0 ] + coefficients[ i + 8 ];
+    int t1 = coefficients[ i + 0 ] - coefficients[ i + 8 ];
+    int t2 = MUL_35468( coefficients[ i + 4 ] ) - MUL_20091( coefficients[ i + 12 ] );
+    int t3 = MUL_20091( coefficients[ i + 4 ] ) + MUL_35468( coefficients[ i + 12 ] );
+
+    intermediate.at( i * 4 + 0 ) = t0 + t3;
+    intermediate.at( i * 4 + 1 ) = t1 + t2;
+    intermediate.at( i * 4 + 2 ) = t1 - t2;
+    intermediate.at( i * 4 + 3 ) = t0 - t3;
+  }
+
+  for ( int i = 0; i < 4; i++ ) {
+    int t0 = intermediate.at( i + 0 ) + intermediate.at( i + 8 );
+    int t1 = intermediate.at( i + 0 ) - intermediate.at( i + 8 );
+    int t2 = MUL_35468( intermediate.at( i + 4 ) ) - MUL_20091( intermediate.at( i + 12 ) );
+    int t3 = MUL_20091( intermediate.at( i + 4 ) ) + MUL_35468( intermediate.at( i + 12 ) );
+
+    uint8_t *target = dst + i * stride;
+
+    *target = clamp255( *target + ((t0 + t3 + 4) >> 3) );
+    target++;
+    *target = clamp255( *target + ((t1 + t2 + 4) >> 3) );
+    target++;
+    *target = clamp255( *target + ((t1 - t2 + 4) >> 3) );
+    target++;
+    *target = clamp255( *target + ((t0 - t3 + 4) >> 3) );
+  }
+}
+
+static void idct_dc_add_c( const int16_t dc, uint8_t * dst, const int stride )
+{
+  const int delta = ( dc + 4 ) >> 3;
+
+  for ( int row = 0; row < 4; row++ ) {
+    for ( int column = 0; column < 4; column++ ) {
+      dst[ column ] = clamp255( dst[ column ] + delta );
+    }
+    dst += stride;
+  }
+}
+
+/* four blocks, one at a time */
+template <Kernels::InverseDCTAdd single>
+static void idct_add_x4_loop( const int16_t * coefficients, uint8_t * dst, const int stride )
+{
+  for ( unsigned int block = 0; block < 4; block++ ) {
+    single( coefficients + 16 * block, dst + 4 * block, stride );
+  }
+}
+
+#ifdef HAVE_SSE2
+static void idct_add_mmx( const int16_t * coefficients, uint8_t * dst, const int stride )
+{
+  vp8_short_idct4x4llm_mmx( coefficients, dst, stride, dst, stride );
+}
+
+static void idct_dc_add_mmx( const int16_t dc, uint8_t * dst, const int stride )
+{
+  vp8_dc_only_idct_add_mmx( dc, dst, stride, dst, stride );
+}
+#endif
+
+/* INTRA PREDICTION */
+
+template <unsigned int size>
+static constexpr unsigned int log2_size()
+{
+  static_assert( size == 4 or size == 8 or size == 16, "invalid block size" );
+  return size == 4 ? 2 : size == 8 ? 3 : 4;
+}
+
+template <unsigned int size>
+static void fill_c( uint8_t * dst, const ptrdiff_t stride, const uint8_t value )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memset( dst, value, size );
+  }
+}
+
+template <unsigned int size>
+static unsigned int edge_sum( const uint8_t * edge )
+{
+  unsigned int sum = 0;
+  for ( unsigned int i = 0; i < size; i++ ) {
+    sum += edge[ i ];
+  }
+  return sum;
+}
+
+template <unsigned int size>
+static void tm_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                          const uint8_t * above, const uint8_t * left )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      dst[ column ] = clamp255( left[ row ] + above[ column ] - above[ -1 ] );
+    }
+  }
+}
+
+template <unsigned int size>
+static void h_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                         const uint8_t *, const uint8_t * left )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memset( dst, left[ row ], size );
+  }
+}
+
+template <unsigned int size>
+static void v_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                         const uint8_t * above, const uint8_t * )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memcpy( dst, above, size );
+  }
+}
+
+template <unsigned int size>
+static void dc_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                          const uint8_t * above, const uint8_t * left )
+{
+  const unsigned int sum = edge_sum<size>( above ) + edge_sum<size>( left );
+  fill_c<size>( dst, stride, ( sum + size ) >> ( log2_size<size>() + 1 ) );
+}
+
+template <unsigned int size>
+static void dc_top_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                              const uint8_t * above, const uint8_t * )
+{
+  fill_c<size>( dst, stride, ( edge_sum<size>( above ) + size / 2 ) >> log2_size<size>() );
+}
+
+template <unsigned int size>
+static void dc_left_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                               const uint8_t *, const uint8_t * left )
+{
+  fill_c<size>( dst, stride, ( edge_sum<size>( left ) + size / 2 ) >> log2_size<size>() );
+}
+
+template <unsigned int size>
+static void dc_128_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                              const uint8_t *, const uint8_t * )
+{
+  fill_c<size>( dst, stride, 128 );
+}
+
+static inline uint8_t avg3( const uint8_t x, const uint8_t y, const uint8_t z )
+{
+  return ( x + 2 * y + z + 2 ) >> 2;
+}
+
+static inline uint8_t avg2( const uint8_t x, const uint8_t y )
+{
+  return ( x + y + 1 ) >> 1;
+}
+
+static void hd_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                          const uint8_t * above, const uint8_t * left )
+{
+  /* up the left column, through the corner and along the row above */
+  const uint8_t east[ 8 ] = { left[ 3 ], left[ 2 ], left[ 1 ], left[ 0 ],
+                              above[ -1 ], above[ 0 ], above[ 1 ], above[ 2 ] };
+
+  auto at = [&] ( const unsigned int column, const unsigned int row ) -> uint8_t &
+    { return dst[ row * stride + column ]; };
+
+  at( 0, 3 ) =             avg2( east[ 0 ], east[ 1 ] );
+  at( 1, 3 ) =             avg3( east[ 0 ], east[ 1 ], east[ 2 ] );
+  at( 0, 2 ) = at( 2, 3 ) = avg2( east[ 1 ], east[ 2 ] );
+  at( 1, 2 ) = at( 3, 3 ) = avg3( east[ 1 ], east[ 2 ], east[ 3 ] );
+  at( 2, 2 ) = at( 0, 1 ) = avg2( east[ 2 ], east[ 3 ] );
+  at( 3, 2 ) = at( 1, 1 ) = avg3( east[ 2 ], east[ 3 ], east[ 4 ] );
+  at( 2, 1 ) = at( 0, 0 ) = avg2( east[ 3 ], east[ 4 ] );
+  at( 3, 1 ) = at( 1, 0 ) = avg3( east[ 3 ], east[ 4 ], east[ 5 ] );
+  at( 2, 0 ) =             avg3( east[ 4 ], east[ 5 ], east[ 6 ] );
+  at( 3, 0 ) =             avg3( east[ 5 ], east[ 6 ], east[ 7 ] );
+}
+
+static void hu_predict_c( uint8_t * dst, const ptrdiff_t stride,
+                          const uint8_t *, const uint8_t * left )
+{
+  auto at = [&] ( const unsigned int column, const unsigned int row ) -> uint8_t &
+    { return dst[ row * stride + column ]; };
+
+  at( 0, 0 ) =             avg2( left[ 0 ], left[ 1 ] );
+  at( 1, 0 ) =             avg3( left[ 0 ], left[ 1 ], left[ 2 ] );
+  at( 2, 0 ) = at( 0, 1 ) = avg2( left[ 1 ], left[ 2 ] );
+  at( 3, 0 ) = at( 1, 1 ) = avg3( left[ 1 ], left[ 2 ], left[ 3 ] );
+  at( 2, 1 ) = at( 0, 2 ) = avg2( left[ 2 ], left[ 3 ] );
+  at( 3, 1 ) = at( 1, 2 ) = avg3( left[ 2 ], left[ 3 ], left[ 3 ] );
+  at( 2, 2 ) = at( 3, 2 ) = at( 0, 3 ) = at( 1, 3 ) = at( 2, 3 ) = at( 3, 3 ) = left[ 3 ];
+}
+
+/* WALSH-HADAMARD TRANSFORMS AND QUANTIZATION */
+
+static void iwht_c( const int16_t * input, int16_t * output )
+{
+  SafeArray< int16_t, 16 > intermediate;
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    int a1 = input[ i + 0 ] + input[ i + 12 ];
+    int b1 = input[ i + 4 ] + input[ i + 8  ];
+    int c1 = input[ i + 4 ] - input[ i + 8  ];
+    int d1 = input[ i + 0 ] - input[ i + 12 ];
+
+    intermediate.at( i + 0  ) = a1 + b1;
+    intermediate.at( i + 4  ) = c1 + d1;
+    intermediate.at( i + 8  ) = a1 - b1;
+    intermediate.at( i + 12 ) = d1 - c1;
+  }
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    const uint8_t offset = i * 4;
+    int a1 = intermediate.at( offset + 0 ) + intermediate.at( offset + 3 );
+    int b1 = intermediate.at( offset + 1 ) + intermediate.at( offset + 2 );
+    int c1 = intermediate.at( offset + 1 ) - intermediate.at( offset + 2 );
+    int d1 = intermediate.at( offset + 0 ) - intermediate.at( offset + 3 );
+
+    int a2 = a1 + b1;
+    int b2 = c1 + d1;
+    int c2 = a1 - b1;
+    int d2 = d1 - c1;
+
+    output[ ( offset + 0 ) * 16 ] = ( a2 + 3 ) >> 3;
+    output[ ( offset + 1 ) * 16 ] = ( b2 + 3 ) >> 3;
+    output[ ( offset + 2 ) * 16 ] = ( c2 + 3 ) >> 3;
+    output[ ( offset + 3 ) * 16 ] = ( d2 + 3 ) >> 3;
+  }
+}
+
+static void dequantize_c( const int16_t * input, int16_t * output,
+                          const uint16_t dc_factor, const uint16_t ac_factor )
+{
+  output[ 0 ] = input[ 0 ] * dc_factor;
+  for ( unsigned int i = 1; i < 16; i++ ) {
+    output[ i ] = input[ i ] * ac_factor;
+  }
+}
+
+/* Based on libvpx vp8_short_fdct4x4_c, after subtracting the prediction */
+static void subtract_fdct_c( const uint8_t * src, const int src_stride,
+                             const uint8_t * pred, const int pred_stride,
+                             int16_t * output )
+{
+  SafeArray< int16_t, 16 > input;
+
+  for ( size_t row = 0; row < 4; row++ ) {
+    for ( size_t column = 0; column < 4; column++ ) {
+      input.at( row * 4 + column ) = src[ row * src_stride + column ]
+                                   - pred[ row * pred_stride + column ];
+    }
+  }
+
+  int a1, b1, c1, d1;
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    a1 = ( input.at( i * 4 + 0 ) + input.at( i * 4 + 3 ) ) * 8;
+    b1 = ( input.at( i * 4 + 1 ) + input.at( i * 4 + 2 ) ) * 8;
+    c1 = ( input.at( i * 4 + 1 ) - input.at( i * 4 + 2 ) ) * 8;
+    d1 = ( input.at( i * 4 + 0 ) - input.at( i * 4 + 3 ) ) * 8;
+
+    output[ i * 4 + 0 ] = a1 + b1;
+    output[ i * 4 + 2 ] = a1 - b1;
+
+    output[ i * 4 + 1 ] = (c1 * 2217 + d1 * 5352 +  14500) >> 12;
+    output[ i * 4 + 3 ] = (d1 * 2217 - c1 * 5352 +   7500) >> 12;
+  }
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    a1 = output[ i + 0 ] + output[ i + 12 ];
+    b1 = output[ i + 4 ] + output[ i +  8 ];
+    c1 = output[ i + 4 ] - output[ i +  8 ];
+    d1 = output[ i + 0 ] - output[ i + 12 ];
+
+    output[ i + 0 ]  = ( a1 + b1 + 7 ) >> 4;
+    output[ i + 8 ]  = ( a1 - b1 + 7 ) >> 4;
+
+    output[ i +  4 ] = ( ( c1 * 2217 + d1 * 5352 + 12000) >> 16 ) + ( d1 != 0 );
+    output[ i + 12 ] =   ( d1 * 2217 - c1 * 5352 + 51000) >> 16;
+  }
+}
+
+/* Based on libvpx vp8_short_walsh4x4_c */
+static void fwht_c( const int16_t * input, int16_t * output )
+{
+  int a1, b1, c1, d1;
+  int a2, b2, c2, d2;
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    a1 = ( input[ i * 4 + 0 ] + input[ i * 4 + 2 ] ) * 4;
+    d1 = ( input[ i * 4 + 1 ] + input[ i * 4 + 3 ] ) * 4;
+    c1 = ( input[ i * 4 + 1 ] - input[ i * 4 + 3 ] ) * 4;
+    b1 = ( input[ i * 4 + 0 ] - input[ i * 4 + 2 ] ) * 4;
+
+    output[ i * 4 + 0 ] = a1 + d1 + ( a1 != 0 );
+    output[ i * 4 + 1 ] = b1 + c1;
+    output[ i * 4 + 2 ] = b1 - c1;
+    output[ i * 4 + 3 ] = a1 - d1;
+  }
+
+  for ( size_t i = 0; i < 4; i++ ) {
+    a1 = output[ i + 0 ] + output[ i +  8 ];
+    d1 = output[ i + 4 ] + output[ i + 12 ];
+    c1 = output[ i + 4 ] - output[ i + 12 ];
+    b1 = output[ i + 0 ] - output[ i +  8 ];
+
+    a2 = a1 + d1;
+    b2 = b1 + c1;
+    c2 = b1 - c1;
+    d2 = a1 - d1;
+
+    a2 += a2 < 0;
+    b2 += b2 < 0;
+    c2 += c2 < 0;
+    d2 += d2 < 0;
+
+    output[ i +  0 ] = ( a2 + 3 ) >> 3;
+    output[ i +  4 ] = ( b2 + 3 ) >> 3;
+    output[ i +  8 ] = ( c2 + 3 ) >> 3;
+    output[ i + 12 ] = ( d2 + 3 ) >> 3;
+  }
+}
+
+#ifdef HAVE_SSE2
+static void dequantize_sse2( const int16_t * input, int16_t * output,
+                             const uint16_t dc_factor, const uint16_t ac_factor )
+{
+  const int16_t q0 = static_cast<int16_t>( dc_factor );
+  const int16_t q1 = static_cast<int16_t>( ac_factor );
+
+  __m128i coeffs_0 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input ) );
+  __m128i coeffs_1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input + 8 ) );
+
+  const __m128i factors_0 = _mm_set_epi16( q1, q1, q1, q1, q1, q1, q1, q0 );
+  const __m128i factors_1 = _mm_set1_epi16( q1 );
+
+  coeffs_0 = _mm_mullo_epi16( coeffs_0, factors_0 );
+  coeffs_1 = _mm_mullo_epi16( coeffs_1, factors_1 );
+
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( output ), coeffs_0 );
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( output + 8 ), coeffs_1 );
+}
+
+static void subtract_fdct_sse2( const uint8_t * src, const int src_stride,
+                                const uint8_t * pred, const int pred_stride,
+                                int16_t * output )
+{
+  alignas( 16 ) int16_t residual[ 16 ];
+
+  vpx_subtract_block_sse2( 4, 4, residual, 4, src, src_stride, pred, pred_stride );
+  vp8_short_fdct4x4_sse2( residual, output, 8 );
+}
+
+static void fwht_sse2( const int16_t * input, int16_t * output )
+{
+  /* the assembly only reads its input */
+  vp8_short_walsh4x4_sse2( const_cast<int16_t *>( input ), output, 8 );
+}
+#endif
+
+/* SUM OF ABSOLUTE DIFFERENCES */
+
+static unsigned int sad16x16_c( const uint8_t * src, const int src_stride,
+                                const uint8_t * ref, const int ref_stride )
+{
+  unsigned int sad = 0;
+
+  for ( unsigned int row = 0; row < 16; row++ ) {
+    for ( unsigned int column = 0; column < 16; column++ ) {
+      sad += abs( src[ column ] - ref[ column ] );
+    }
+    src += src_stride;
+    ref += ref_stride;
+  }
+
+  return sad;
+}
+
+/* SQUARED ERROR AND VARIANCE */
+
+template <unsigned int size>
+static unsigned int sse_c( const uint8_t * src, const int src_stride,
+                           const uint8_t * ref, const int ref_stride )
+{
+  unsigned int sse = 0;
+
+  for ( unsigned int row = 0; row < size; row++ ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      const int diff = src[ column ] - ref[ column ];
+      sse += diff * diff;
+    }
+    src += src_stride;
+    ref += ref_stride;
+  }
+
+  return sse;
+}
+
+template <unsigned int size>
+static unsigned int variance_c( const uint8_t * src, const int src_stride,
+                                const uint8_t * ref, const int ref_stride )
+{
+  unsigned int sse = 0;
+  int sum = 0;
+
+  for ( unsigned int row = 0; row < size; row++ ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      const int diff = src[ column ] - ref[ column ];
+      sum += diff;
+      sse += diff * diff;
+    }
+    src += src_stride;
+    ref += ref_stride;
+  }
+
+  return sse - ( static_cast<int64_t>( sum ) * sum ) / ( size * size );
+}
+
+#ifdef HAVE_SSE2
+typedef void GetVariance( const uint8_t * src, int src_stride,
+                          const uint8_t * ref, int ref_stride,
+                          unsigned int * sse, int * sum );
+
+template <GetVariance get_variance>
+static unsigned int sse_sse2( const uint8_t * src, const int src_stride,
+                              const uint8_t * ref, const int ref_stride )
+{
+  unsigned int sse;
+  get_variance( src, src_stride, ref, ref_stride, &sse, nullptr );
+  return sse;
+}
+
+typedef unsigned int VarianceWithSSE( const uint8_t * src, int src_stride,
+                                      const uint8_t * ref, int ref_stride,
+                                      unsigned int * sse );
+
+template <VarianceWithSSE vpx_variance>
+static unsigned int variance_sse2( const uint8_t * src, const int src_stride,
+                                   const uint8_t * ref, const int ref_stride )
+{
+  unsigned int sse;
+  return vpx_variance( src, src_stride, ref, ref_stride, &sse );
+}
+#endif
+
+/* LOOP FILTER */
+
+/* Roughly the same as vp8_mbloop_filter_horizontal_edge_c. `step` is the
+   distance between pixels across the edge, `pitch` the distance along it. */
+template <unsigned int size>
+static void mb_edge_c( uint8_t * central, const int step, const int pitch,
+                       const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int i = 0; i < size; i++, central += pitch ) {
+    const int8_t mask = vp8_filter_mask( *limit, *blimit,
+                                         *(central - 4 * step),
+                                         *(central - 3 * step),
+                                         *(central - 2 * step),
+                                         *(central - step),
+                                         *(central),
+                                         *(central + step),
+                                         *(central + 2 * step),
+                                         *(central + 3 * step) );
+
+    const int8_t hev = vp8_hevmask( *thresh,
+                                    *(central - 2 * step),
+                                    *(central - step),
+                                    *(central),
+                                    *(central + step) );
+
+    vp8_mbfilter( mask, hev,
+                  *(central - 3 * step),
+                  *(central - 2 * step),
+                  *(central - step),
+                  *(central),
+                  *(central + step),
+                  *(central + 2 * step) );
+  }
+}
+
+/* the subblock edges of a size x size block */
+template <unsigned int size>
+static void sb_edges_c( uint8_t * block, const int step, const int pitch,
+                        const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int edge = 4; edge < size; edge += 4 ) {
+    uint8_t *central = block + edge * step;
+
+    for ( unsigned int i = 0; i < size; i++, central += pitch ) {
+      const int8_t mask = vp8_filter_mask( *limit, *blimit,
+                                           *(central - 4 * step),
+                                           *(central - 3 * step),
+                                           *(central - 2 * step),
+                                           *(central - step),
+                                           *(central),
+                                           *(central + step),
+                                           *(central + 2 * step),
+                                           *(central + 3 * step) );
+
+      const int8_t hev = vp8_hevmask( *thresh,
+                                      *(central - 2 * step),
+                                      *(central - step),
+                                      *(central),
+                                      *(central + step) );
+
+      vp8_filter( mask, hev,
+                  *(central - 2 * step),
+                  *(central - step),
+                  *(central),
+                  *(central + step) );
+    }
+  }
+}
+
+static void mb_vertical_edge_c( uint8_t * y, uint8_t * u, uint8_t * v,
+                                const int y_stride, const int uv_stride,
+                                const uint8_t * blimit, const uint8_t * limit,
+                                const uint8_t * thresh )
+{
+  mb_edge_c<16>( y, 1, y_stride, blimit, limit, thresh );
+  mb_edge_c<8>( u, 1, uv_stride, blimit, limit, thresh );
+  mb_edge_c<8>( v, 1, uv_stride, blimit, limit, thresh );
+}
+
+static void mb_horizontal_edge_c( uint8_t * y, uint8_t * u, uint8_t * v,
+                                  const int y_stride, const int uv_stride,
+                                  const uint8_t * blimit, const uint8_t * limit,
+                                  const uint8_t * thresh )
+{
+  mb_edge_c<16>( y, y_stride, 1, blimit, limit, thresh );
+  mb_edge_c<8>( u, uv_stride, 1, blimit, limit, thresh );
+  mb_edge_c<8>( v, uv_stride, 1, blimit, limit, thresh );
+}
+
+static void sb_vertical_edges_c( uint8_t * y, uint8_t * u, uint8_t * v,
+                                 const int y_stride, const int uv_stride,
+                                 const uint8_t * blimit, const uint8_t * limit,
+                                 const uint8_t * thresh )
+{
+  sb_edges_c<16>( y, 1, y_stride, blimit, limit, thresh );
+  sb_edges_c<8>( u, 1, uv_stride, blimit, limit, thresh );
+  sb_edges_c<8>( v, 1, uv_stride, blimit, limit, thresh );
+}
+
+static void sb_horizontal_edges_c( uint8_t * y, uint8_t * u, uint8_t * v,
+                                   const int y_stride, const int uv_stride,
+                                   const uint8_t * blimit, const uint8_t * limit,
+                                   const uint8_t * thresh )
+{
+  sb_edges_c<16>( y, y_stride, 1, blimit, limit, thresh );
+  sb_edges_c<8>( u, uv_stride, 1, blimit, limit, thresh );
+  sb_edges_c<8>( v, uv_stride, 1, blimit, limit, thresh );
+}
+
+#ifdef HAVE_SSE2
+static void mb_vertical_edge_sse2( uint8_t * y, uint8_t * u, uint8_t * v,
+                                   const int y_stride, const int uv_stride,
+                                   const uint8_t * blimit, const uint8_t * limit,
+                                   const uint8_t * thresh )
+{
+  vp8_mbloop_filter_vertical_edge_sse2( y, y_stride, blimit, limit, thresh );
+  vp8_mbloop_filter_vertical_edge_uv_sse2( u, uv_stride, blimit, limit, thresh, v );
+}
+
+static void mb_horizontal_edge_sse2( uint8_t * y, uint8_t * u, uint8_t * v,
+                                     const int y_stride, const int uv_stride,
+                                     const uint8_t * blimit, const uint8_t * limit,
+                                     const uint8_t * thresh )
+{
+  vp8_mbloop_filter_horizontal_edge_sse2( y, y_stride, blimit, limit, thresh );
+  vp8_mbloop_filter_horizontal_edge_uv_sse2( u, uv_stride, blimit, limit, thresh, v );
+}
+
+static void sb_vertical_edges_sse2( uint8_t * y, uint8_t * u, uint8_t * v,
+                                    const int y_stride, const int uv_stride,
+                                    const uint8_t * blimit, const uint8_t * limit,
+                                    const uint8_t * thresh )
+{
+#ifdef ARCH_X86_64
+  vp8_loop_filter_bv_y_sse2( y, y_stride, blimit, limit, thresh, 2 );
+#else
+  vp8_loop_filter_vertical_edge_sse2( y + 4, y_stride, blimit, limit, thresh );
+  vp8_loop_filter_vertical_edge_sse2( y + 8, y_stride, blimit, limit, thresh );
+  vp8_loop_filter_vertical_edge_sse2( y + 12, y_stride, blimit, limit, thresh );
+#endif
+
+  vp8_loop_filter_vertical_edge_uv_sse2( u + 4, uv_stride, blimit, limit, thresh, v + 4 );
+}
+
+static void sb_horizontal_edges_sse2( uint8_t * y, uint8_t * u, uint8_t * v,
+                                      const int y_stride, const int uv_stride,
+                                      const uint8_t * blimit, const uint8_t * limit,
+                                      const uint8_t * thresh )
+{
+#ifdef ARCH_X86_64
+  vp8_loop_filter_bh_y_sse2( y, y_stride, blimit, limit, thresh, 2 );
+#else
+  vp8_loop_filter_horizontal_edge_sse2( y + 4 * y_stride, y_stride, blimit, limit, thresh );
+  vp8_loop_filter_horizontal_edge_sse2( y + 8 * y_stride, y_stride, blimit, limit, thresh );
+  vp8_loop_filter_horizontal_edge_sse2( y + 12 * y_stride, y_stride, blimit, limit, thresh );
+#endif
+
+  vp8_loop_filter_horizontal_edge_uv_sse2( u + 4 * uv_stride, uv_stride, blimit, limit, thresh,
+                                           v + 4 * uv_stride );
+}
+#endif
+
+/* DISPATCH */
+
+Kernels::Kernels( const SIMDLevel s_level )
+  : level( SIMDLevel::C ),
+    sixtap_horizontal { sixtap_horizontal_c<4>, sixtap_horizontal_c<8>, sixtap_horizontal_c<16> },
+    sixtap_vertical { sixtap_vertical_c<4>, sixtap_vertical_c<8>, sixtap_vertical_c<16> },
+    idct_add( idct_add_c ),
+    idct_add_x4( idct_add_x4_loop<idct_add_c> ),
+    idct_dc_add( idct_dc_add_c ),
+    sad16x16( sad16x16_c ),
+    mb_vertical_edge( mb_vertical_edge_c ),
+    mb_horizontal_edge( mb_horizontal_edge_c ),
+    sb_vertical_edges( sb_vertical_edges_c ),
+    sb_horizontal_edges( sb_horizontal_edges_c ),
+    tm_predict { tm_predict_c<4>, tm_predict_c<8>, tm_predict_c<16> },
+    h_predict { h_predict_c<4>, h_predict_c<8>, h_predict_c<16> },
+    v_predict { v_predict_c<4>, v_predict_c<8>, v_predict_c<16> },
+    dc_predict { dc_predict_c<4>, dc_predict_c<8>, dc_predict_c<16> },
+    dc_top_predict { dc_top_predict_c<4>, dc_top_predict_c<8>, dc_top_predict_c<16> },
+    dc_left_predict { dc_left_predict_c<4>, dc_left_predict_c<8>, dc_left_predict_c<16> },
+    dc_128_predict { dc_128_predict_c<4>, dc_128_predict_c<8>, dc_128_predict_c<16> },
+    hd_predict( hd_predict_c ),
+    hu_predict( hu_predict_c ),
+    iwht( iwht_c ),
+    dequantize( dequantize_c ),
+    subtract_fdct( subtract_fdct_c ),
+    fwht( fwht_c ),
+    sse { sse_c<4>, sse_c<8>, sse_c<16> },
+    variance { variance_c<4>, variance_c<8>, variance_c<16> }
+{
+  (void) s_level;   // unused when the build has no SIMD code
+
+  /* each tier starts from the one below it, and only tiers this
+     build has code for are used */
+
+#ifdef HAVE_SSE2
+  if ( s_level >= SIMDLevel::SSE2 ) {
+    level = SIMDLevel::SSE2;
+
+    idct_add = idct_add_mmx;
+    idct_add_x4 = idct_add_x4_loop<idct_add_mmx>;
+    idct_dc_add = idct_dc_add_mmx;
+    sad16x16 = vpx_sad16x16_sse2;
+    mb_vertical_edge = mb_vertical_edge_sse2;
+    mb_horizontal_edge = mb_horizontal_edge_sse2;
+    sb_vertical_edges = sb_vertical_edges_sse2;
+    sb_horizontal_edges = sb_horizontal_edges_sse2;
+
+    tm_predict[ 0 ] = vpx_tm_predictor_4x4_sse2;
+    tm_predict[ 1 ] = vpx_tm_predictor_8x8_sse2;
+    tm_predict[ 2 ] = vpx_tm_predictor_16x16_sse2;
+    h_predict[ 0 ] = vpx_h_predictor_4x4_sse2;
+    h_predict[ 1 ] = vpx_h_predictor_8x8_sse2;
+    h_predict[ 2 ] = vpx_h_predictor_16x16_sse2;
+    v_predict[ 0 ] = vpx_v_predictor_4x4_sse2;
+    v_predict[ 1 ] = vpx_v_predictor_8x8_sse2;
+    v_predict[ 2 ] = vpx_v_predictor_16x16_sse2;
+    dc_predict[ 0 ] = vpx_dc_predictor_4x4_sse2;
+    dc_predict[ 1 ] = vpx_dc_predictor_8x8_sse2;
+    dc_predict[ 2 ] = vpx_dc_predictor_16x16_sse2;
+    dc_top_predict[ 0 ] = vpx_dc_top_predictor_4x4_sse2;
+    dc_top_predict[ 1 ] = vpx_dc_top_predictor_8x8_sse2;
+    dc_top_predict[ 2 ] = vpx_dc_top_predictor_16x16_sse2;
+    dc_left_predict[ 0 ] = vpx_dc_left_predictor_4x4_sse2;
+    dc_left_predict[ 1 ] = vpx_dc_left_predictor_8x8_sse2;
+    dc_left_predict[ 2 ] = vpx_dc_left_predictor_16x16_sse2;
+    dc_128_predict[ 0 ] = vpx_dc_128_predictor_4x4_sse2;
+    dc_128_predict[ 1 ] = vpx_dc_128_predictor_8x8_sse2;
+    dc_128_predict[ 2 ] = vpx_dc_128_predictor_16x16_sse2;
+    hu_predict = vpx_d207_predictor_4x4_sse2;
+
+    iwht = vp8_short_inv_walsh4x4_sse2;
+    dequantize = dequantize_sse2;
+    subtract_fdct = subtract_fdct_sse2;
+    fwht = fwht_sse2;
+
+    sse[ 0 ] = sse_sse2<vpx_get4x4var_sse2>;
+    sse[ 1 ] = sse_sse2<vpx_get8x8var_sse2>;
+    sse[ 2 ] = sse_sse2<vpx_get16x16var_sse2>;
+    variance[ 0 ] = variance_sse2<vpx_variance4x4_sse2>;
+    variance[ 1 ] = variance_sse2<vpx_variance8x8_sse2>;
+    variance[ 2 ] = variance_sse2<vpx_variance16x16_sse2>;
+  }
+
+  if ( s_level >= SIMDLevel::SSSE3 ) {
+    level = SIMDLevel::SSSE3;
+
+    hd_predict = vpx_d153_predictor_4x4_ssse3;
+
+    sixtap_horizontal[ 0 ] = vp8_filter_block1d4_h6_ssse3;
+    sixtap_horizontal[ 1 ] = vp8_filter_block1d8_h6_ssse3;
+    sixtap_horizontal[ 2 ] = vp8_filter_block1d16_h6_ssse3;
+    sixtap_vertical[ 0 ] = vp8_filter_block1d4_v6_ssse3;
+    sixtap_vertical[ 1 ] = vp8_filter_block1d8_v6_ssse3;
+    sixtap_vertical[ 2 ] = vp8_filter_block1d16_v6_ssse3;
+  }
+#endif
+
+#ifdef HAVE_AVX2
+  if ( s_level >= SIMDLevel::AVX2 ) {
+    level = SIMDLevel::AVX2;
+
+    sixtap_horizontal[ 2 ] = avx2::sixtap_horizontal_16;
+    sixtap_vertical[ 2 ] = avx2::sixtap_vertical_16;
+    idct_add_x4 = avx2::idct_add_x4;
+    sad16x16 = avx2::sad16x16;
+    mb_vertical_edge = avx2::mb_vertical_edge;
+    mb_horizontal_edge = avx2::mb_horizontal_edge;
+    sb_vertical_edges = avx2::sb_vertical_edges;
+    sb_horizontal_edges = avx2::sb_horizontal_edges;
+  }
+#endif
+}
+
+const Kernels & kernels()
+{
+  static const Kernels table { cpu_features::selected_level() };
+  return table;
+}
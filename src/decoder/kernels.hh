@@ -0,0 +1,146 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef KERNELS_HH
+#define KERNELS_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_features.hh"
+#include "safe_array.hh"
+
+/* taps of the six-tap sub-pixel interpolation filter, by eighth-pixel offset */
+extern const SafeArray<SafeArray<int16_t, 6>, 8> sixtap_filters;
+
+/* the innermost pixel loops of the codec, picked once per process from the
+   C, SSE2, SSSE3 and AVX2 implementations according to what the CPU supports */
+struct Kernels
+{
+  /* six-tap sub-pixel filter over `height` rows of a 4, 8 or 16-wide block.
+     the horizontal pass reads two pixels left and three right of each output;
+     the vertical pass expects `src` to point two rows above the first output. */
+  typedef void SixtapFilter( const uint8_t * src, const unsigned int src_stride,
+                             uint8_t * dst, const unsigned int dst_stride,
+                             const unsigned int height, const unsigned int filter_index );
+
+  /* add the inverse DCT of 16 coefficients to the 4x4 block at `dst`. the
+     batched version does four horizontally adjacent blocks (64 coefficients). */
+  typedef void InverseDCTAdd( const int16_t * coefficients, uint8_t * dst, const int stride );
+
+  /* the same for a block whose only nonzero coefficient is the DC */
+  typedef void InverseDCTAddDC( const int16_t dc, uint8_t * dst, const int stride );
+
+  typedef unsigned int SumOfAbsoluteDifferences( const uint8_t * src, const int src_stride,
+                                                 const uint8_t * ref, const int ref_stride );
+
+  /* filter one kind of edge of a macroblock in all three planes. the limits
+     are 16-byte vectors with every entry equal, as the libvpx routines expect. */
+  typedef void EdgeFilter( uint8_t * y, uint8_t * u, uint8_t * v,
+                           const int y_stride, const int uv_stride,
+                           const uint8_t * blimit, const uint8_t * limit,
+                           const uint8_t * thresh );
+
+  /* fill a block from the row above it (with above[ -1 ] the corner pixel)
+     and the column to its left, using libvpx's calling convention */
+  typedef void IntraPredictor( uint8_t * dst, const ptrdiff_t stride,
+                               const uint8_t * above, const uint8_t * left );
+
+  /* inverse Walsh-Hadamard transform of a Y2 block. each of the 16 outputs
+     is the DC of one of 16 consecutive 16-coefficient blocks. */
+  typedef void InverseWHT( const int16_t * input, int16_t * output );
+
+  /* multiply 16 coefficients by their factors (the DC's first) */
+  typedef void Dequantize( const int16_t * input, int16_t * output,
+                           const uint16_t dc_factor, const uint16_t ac_factor );
+
+  /* the forward transforms of the encoder: the DCT of the difference between
+     a 4x4 block and its prediction, and the WHT of 16 Y DC coefficients */
+  typedef void ForwardDCT( const uint8_t * src, const int src_stride,
+                           const uint8_t * pred, const int pred_stride,
+                           int16_t * output );
+  typedef void ForwardWHT( const int16_t * input, int16_t * output );
+
+  /* the variance is the sum of squared errors minus the squared sum of
+     the differences over the pixel count */
+  typedef unsigned int SumOfSquaredErrors( const uint8_t * src, const int src_stride,
+                                           const uint8_t * ref, const int ref_stride );
+  typedef unsigned int Variance( const uint8_t * src, const int src_stride,
+                                 const uint8_t * ref, const int ref_stride );
+
+  SIMDLevel level;
+
+  /* indexed by block width: 4, 8, 16 */
+  SixtapFilter * sixtap_horizontal[ 3 ];
+  SixtapFilter * sixtap_vertical[ 3 ];
+
+  InverseDCTAdd * idct_add;
+  InverseDCTAdd * idct_add_x4;
+  InverseDCTAddDC * idct_dc_add;
+
+  SumOfAbsoluteDifferences * sad16x16;
+
+  EdgeFilter * mb_vertical_edge;     /* left edge of the macroblock */
+  EdgeFilter * mb_horizontal_edge;   /* top edge of the macroblock */
+  EdgeFilter * sb_vertical_edges;    /* vertical edges between subblocks */
+  EdgeFilter * sb_horizontal_edges;  /* horizontal edges between subblocks */
+
+  /* indexed by block width */
+  IntraPredictor * tm_predict[ 3 ];
+  IntraPredictor * h_predict[ 3 ];
+  IntraPredictor * v_predict[ 3 ];
+  IntraPredictor * dc_predict[ 3 ];       /* both edges available */
+  IntraPredictor * dc_top_predict[ 3 ];   /* only the row above */
+  IntraPredictor * dc_left_predict[ 3 ];  /* only the left column */
+  IntraPredictor * dc_128_predict[ 3 ];   /* neither */
+
+  IntraPredictor * hd_predict;  /* B_HD_PRED (d153), 4x4 only */
+  IntraPredictor * hu_predict;  /* B_HU_PRED (d207), 4x4 only */
+
+  InverseWHT * iwht;
+  Dequantize * dequantize;
+
+  ForwardDCT * subtract_fdct;
+  ForwardWHT * fwht;
+
+  /* indexed by block width */
+  SumOfSquaredErrors * sse[ 3 ];
+  Variance * variance[ 3 ];
+
+  Kernels( const SIMDLevel s_level );
+
+  static constexpr unsigned int width_index( const unsigned int width )
+  {
+    return width == 4 ? 0 : width == 8 ? 1 : 2;
+  }
+};
+
+/* the table for cpu_features::selected_level(), built on first use */
+const Kernels & kernels();
+
+#endif /* KERNELS_HH */
@@ -0,0 +1,632 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* AVX2 kernels. this file is compiled for AVX2 through a target pragma
+   (instead of the build passing -mavx2) so that only these functions use
+   it, and they run only when the dispatch table picked them. each one
+   gives bit-identical results to its C counterpart in kernels.cc. */
+
+#include "config.h"
+
+#ifdef HAVE_AVX2
+
+#include <immintrin.h>
+
+#include "kernels_avx2.hh"
+
+#pragma GCC push_options
+#pragma GCC target( "avx2" )
+
+/* SIX-TAP PREDICTION */
+
+/* the six taps as three pairs of 16-bit coefficients, for madd */
+struct SixtapPairs
+{
+  __m256i taps01, taps23, taps45;
+};
+
+static inline SixtapPairs sixtap_pairs( const unsigned int filter_index )
+{
+  const auto & filter = sixtap_filters.at( filter_index );
+
+  auto pair = [&]( const unsigned int first )
+    {
+      return _mm256_set1_epi32( static_cast<uint16_t>( filter.at( first ) )
+                                | ( static_cast<uint32_t>( static_cast<uint16_t>( filter.at( first + 1 ) ) ) << 16 ) );
+    };
+
+  return { pair( 0 ), pair( 2 ), pair( 4 ) };
+}
+
+/* eight 32-bit sums of a * taps.first + b * taps.second, from the
+   interleaved low or high halves of 16-byte vectors a and b */
+static inline __m256i madd_pair( const __m128i interleaved, const __m256i taps )
+{
+  return _mm256_madd_epi16( _mm256_cvtepu8_epi16( interleaved ), taps );
+}
+
+/* filter 16 pixels, given for each tap k the 16 input pixels it multiplies */
+static inline __m128i sixtap_16( const __m128i s0, const __m128i s1,
+                                 const __m128i s2, const __m128i s3,
+                                 const __m128i s4, const __m128i s5,
+                                 const SixtapPairs & pairs )
+{
+  const __m256i rounding = _mm256_set1_epi32( 64 );
+
+  __m256i low = _mm256_add_epi32( madd_pair( _mm_unpacklo_epi8( s0, s1 ), pairs.taps01 ),
+                                  madd_pair( _mm_unpacklo_epi8( s2, s3 ), pairs.taps23 ) );
+  low = _mm256_add_epi32( low, madd_pair( _mm_unpacklo_epi8( s4, s5 ), pairs.taps45 ) );
+  low = _mm256_srai_epi32( _mm256_add_epi32( low, rounding ), 7 );
+
+  __m256i high = _mm256_add_epi32( madd_pair( _mm_unpackhi_epi8( s0, s1 ), pairs.taps01 ),
+                                   madd_pair( _mm_unpackhi_epi8( s2, s3 ), pairs.taps23 ) );
+  high = _mm256_add_epi32( high, madd_pair( _mm_unpackhi_epi8( s4, s5 ), pairs.taps45 ) );
+  high = _mm256_srai_epi32( _mm256_add_epi32( high, rounding ), 7 );
+
+  /* packs works within 128-bit lanes, which leaves the 64-bit quarters out of order */
+  const __m256i words = _mm256_permute4x64_epi64( _mm256_packs_epi32( low, high ), 0xD8 );
+
+  return _mm_packus_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) );
+}
+
+void avx2::sixtap_horizontal_16( const uint8_t * src, const unsigned int src_stride,
+                                 uint8_t * dst, const unsigned int dst_stride,
+                                 const unsigned int height, const unsigned int filter_index )
+{
+  const SixtapPairs pairs = sixtap_pairs( filter_index );
+
+  for ( unsigned int row = 0; row < height; row++ ) {
+    auto load = [&]( const int offset )
+      {
+        return _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + offset ) );
+      };
+
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( dst ),
+                      sixtap_16( load( -2 ), load( -1 ), load( 0 ),
+                                 load( 1 ), load( 2 ), load( 3 ), pairs ) );
+
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void avx2::sixtap_vertical_16( const uint8_t * src, const unsigned int src_stride,
+                               uint8_t * dst, const unsigned int dst_stride,
+                               const unsigned int height, const unsigned int filter_index )
+{
+  const SixtapPairs pairs = sixtap_pairs( filter_index );
+
+  auto load = [&]( const unsigned int row )
+    {
+      return _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + row * src_stride ) );
+    };
+
+  /* a sliding window of the six rows that feed the current output row */
+  __m128i r0 = load( 0 ), r1 = load( 1 ), r2 = load( 2 ), r3 = load( 3 ), r4 = load( 4 );
+
+  for ( unsigned int row = 0; row < height; row++ ) {
+    const __m128i r5 = load( row + 5 );
+
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( dst ),
+                      sixtap_16( r0, r1, r2, r3, r4, r5, pairs ) );
+
+    r0 = r1; r1 = r2; r2 = r3; r3 = r4; r4 = r5;
+    dst += dst_stride;
+  }
+}
+
+/* INVERSE DCT */
+
+/* transpose the 4x4 matrix of 16-bit values held in the same 64-bit quarter
+   of a, b, c and d, for all four quarters at once */
+static inline void transpose_4x4_blocks( __m256i & a, __m256i & b,
+                                         __m256i & c, __m256i & d )
+{
+  const __m256i ab_even = _mm256_unpacklo_epi16( a, b ), ab_odd = _mm256_unpackhi_epi16( a, b );
+  const __m256i cd_even = _mm256_unpacklo_epi16( c, d ), cd_odd = _mm256_unpackhi_epi16( c, d );
+
+  const __m256i even_01 = _mm256_unpacklo_epi32( ab_even, cd_even );
+  const __m256i even_23 = _mm256_unpackhi_epi32( ab_even, cd_even );
+  const __m256i odd_01 = _mm256_unpacklo_epi32( ab_odd, cd_odd );
+  const __m256i odd_23 = _mm256_unpackhi_epi32( ab_odd, cd_odd );
+
+  a = _mm256_unpacklo_epi64( even_01, odd_01 );
+  b = _mm256_unpackhi_epi64( even_01, odd_01 );
+  c = _mm256_unpacklo_epi64( even_23, odd_23 );
+  d = _mm256_unpackhi_epi64( even_23, odd_23 );
+}
+
+/* one pass of the 1-D transform on 16 columns at once, with the same 16-bit
+   arithmetic as the MMX version. 35468 doesn't fit in a signed 16-bit
+   multiplier, so x * 35468 >> 16 is computed as ( x * ( 35468 - 65536 ) >> 16 ) + x. */
+static inline void idct_pass( __m256i & i0, __m256i & i1, __m256i & i2, __m256i & i3,
+                              const __m256i rounding )
+{
+  const __m256i c20091 = _mm256_set1_epi16( 20091 );
+  const __m256i c35468 = _mm256_set1_epi16( static_cast<int16_t>( 35468 - 65536 ) );
+
+  auto mul_20091 = [&]( const __m256i x ) { return _mm256_add_epi16( _mm256_mulhi_epi16( x, c20091 ), x ); };
+  auto mul_35468 = [&]( const __m256i x ) { return _mm256_add_epi16( _mm256_mulhi_epi16( x, c35468 ), x ); };
+
+  const __m256i t0 = _mm256_add_epi16( _mm256_add_epi16( i0, i2 ), rounding );
+  const __m256i t1 = _mm256_add_epi16( _mm256_sub_epi16( i0, i2 ), rounding );
+  const __m256i t2 = _mm256_sub_epi16( mul_35468( i1 ), mul_20091( i3 ) );
+  const __m256i t3 = _mm256_add_epi16( mul_20091( i1 ), mul_35468( i3 ) );
+
+  i0 = _mm256_add_epi16( t0, t3 );
+  i1 = _mm256_add_epi16( t1, t2 );
+  i2 = _mm256_sub_epi16( t1, t2 );
+  i3 = _mm256_sub_epi16( t0, t3 );
+}
+
+void avx2::idct_add_x4( const int16_t * coefficients, uint8_t * dst, const int stride )
+{
+  /* one block per register */
+  auto load = [&]( const unsigned int block )
+    {
+      return _mm256_loadu_si256( reinterpret_cast<const __m256i *>( coefficients + 16 * block ) );
+    };
+
+  const __m256i block0 = load( 0 ), block1 = load( 1 ), block2 = load( 2 ), block3 = load( 3 );
+
+  /* regroup so that register k holds coefficient row k of every block */
+  const __m256i rows01_02 = _mm256_unpacklo_epi64( block0, block1 );
+  const __m256i rows13_02 = _mm256_unpackhi_epi64( block0, block1 );
+  const __m256i rows01_13 = _mm256_unpacklo_epi64( block2, block3 );
+  const __m256i rows13_13 = _mm256_unpackhi_epi64( block2, block3 );
+
+  __m256i i0 = _mm256_permute2x128_si256( rows01_02, rows01_13, 0x20 );
+  __m256i i1 = _mm256_permute2x128_si256( rows13_02, rows13_13, 0x20 );
+  __m256i i2 = _mm256_permute2x128_si256( rows01_02, rows01_13, 0x31 );
+  __m256i i3 = _mm256_permute2x128_si256( rows13_02, rows13_13, 0x31 );
+
+  /* vertical pass, then horizontal (with rounding) */
+  idct_pass( i0, i1, i2, i3, _mm256_setzero_si256() );
+  transpose_4x4_blocks( i0, i1, i2, i3 );
+  idct_pass( i0, i1, i2, i3, _mm256_set1_epi16( 4 ) );
+
+  i0 = _mm256_srai_epi16( i0, 3 );
+  i1 = _mm256_srai_epi16( i1, 3 );
+  i2 = _mm256_srai_epi16( i2, 3 );
+  i3 = _mm256_srai_epi16( i3, 3 );
+
+  /* back to pixel order: register k is row k of the 16x4 output */
+  transpose_4x4_blocks( i0, i1, i2, i3 );
+
+  auto add_row = [&]( const __m256i residue, uint8_t * row )
+    {
+      const __m128i prediction = _mm_loadu_si128( reinterpret_cast<const __m128i *>( row ) );
+      const __m256i sum = _mm256_adds_epi16( _mm256_cvtepu8_epi16( prediction ), residue );
+      _mm_storeu_si128( reinterpret_cast<__m128i *>( row ),
+                        _mm_packus_epi16( _mm256_castsi256_si128( sum ),
+                                          _mm256_extracti128_si256( sum, 1 ) ) );
+    };
+
+  add_row( i0, dst );
+  add_row( i1, dst + stride );
+  add_row( i2, dst + 2 * stride );
+  add_row( i3, dst + 3 * stride );
+}
+
+/* SUM OF ABSOLUTE DIFFERENCES */
+
+unsigned int avx2::sad16x16( const uint8_t * src, const int src_stride,
+                             const uint8_t * ref, const int ref_stride )
+{
+  auto load_two_rows = [&]( const uint8_t * first, const int stride )
+    {
+      return _mm256_inserti128_si256(
+        _mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( first ) ) ),
+        _mm_loadu_si128( reinterpret_cast<const __m128i *>( first + stride ) ), 1 );
+    };
+
+  __m256i sums = _mm256_setzero_si256();
+
+  for ( unsigned int row = 0; row < 16; row += 2 ) {
+    sums = _mm256_add_epi64( sums, _mm256_sad_epu8( load_two_rows( src, src_stride ),
+                                                    load_two_rows( ref, ref_stride ) ) );
+    src += 2 * src_stride;
+    ref += 2 * ref_stride;
+  }
+
+  const __m128i halves = _mm_add_epi64( _mm256_castsi256_si128( sums ),
+                                        _mm256_extracti128_si256( sums, 1 ) );
+
+  return _mm_cvtsi128_si32( _mm_add_epi64( halves, _mm_unpackhi_epi64( halves, halves ) ) );
+}
+
+/* LOOP FILTER */
+
+/* the eight pixels on either side of an edge, p3 farthest from it on one
+   side and q3 on the other. the low lane of each vector holds 16 luma
+   pixels and the high lane 8 U then 8 V pixels, so that one pass filters
+   the same edge in all three planes. */
+struct EdgePixels
+{
+  __m256i p3, p2, p1, p0, q0, q1, q2, q3;
+};
+
+struct EdgeLimits
+{
+  __m256i blimit, limit, thresh;
+};
+
+static inline __m256i broadcast( const uint8_t * vector )
+{
+  return _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( vector ) ) );
+}
+
+static inline EdgeLimits edge_limits( const uint8_t * blimit, const uint8_t * limit,
+                                      const uint8_t * thresh )
+{
+  return { broadcast( blimit ), broadcast( limit ), broadcast( thresh ) };
+}
+
+static inline __m256i abs_diff( const __m256i a, const __m256i b )
+{
+  return _mm256_or_si256( _mm256_subs_epu8( a, b ), _mm256_subs_epu8( b, a ) );
+}
+
+/* 0xff where the edge should be filtered, as in vp8_filter_mask */
+static inline __m256i filter_mask( const EdgePixels & px, const EdgeLimits & limits )
+{
+  __m256i interior = _mm256_max_epu8( abs_diff( px.p3, px.p2 ), abs_diff( px.p2, px.p1 ) );
+  interior = _mm256_max_epu8( interior, abs_diff( px.p1, px.p0 ) );
+  interior = _mm256_max_epu8( interior, abs_diff( px.q1, px.q0 ) );
+  interior = _mm256_max_epu8( interior, abs_diff( px.q2, px.q1 ) );
+  interior = _mm256_max_epu8( interior, abs_diff( px.q3, px.q2 ) );
+
+  /* abs( p0 - q0 ) * 2 + abs( p1 - q1 ) / 2, saturated; blimit is well below 255 */
+  const __m256i half_p1_q1 = _mm256_srli_epi16( _mm256_and_si256( abs_diff( px.p1, px.q1 ),
+                                                                   _mm256_set1_epi8( static_cast<char>( 0xfe ) ) ), 1 );
+  const __m256i p0_q0 = abs_diff( px.p0, px.q0 );
+  const __m256i edge = _mm256_adds_epu8( _mm256_adds_epu8( p0_q0, p0_q0 ), half_p1_q1 );
+
+  const __m256i over = _mm256_or_si256( _mm256_subs_epu8( interior, limits.limit ),
+                                        _mm256_subs_epu8( edge, limits.blimit ) );
+
+  return _mm256_cmpeq_epi8( over, _mm256_setzero_si256() );
+}
+
+/* 0xff where the edge has high variance, as in vp8_hevmask */
+static inline __m256i hev_mask( const EdgePixels & px, const EdgeLimits & limits )
+{
+  const __m256i variance = _mm256_max_epu8( abs_diff( px.p1, px.p0 ), abs_diff( px.q1, px.q0 ) );
+  const __m256i within = _mm256_cmpeq_epi8( _mm256_subs_epu8( variance, limits.thresh ),
+                                            _mm256_setzero_si256() );
+
+  return _mm256_xor_si256( within, _mm256_set1_epi8( static_cast<char>( 0xff ) ) );
+}
+
+static inline __m256i flip_sign( const __m256i x )
+{
+  return _mm256_xor_si256( x, _mm256_set1_epi8( static_cast<char>( 0x80 ) ) );
+}
+
+/* arithmetic right shift of signed bytes */
+template <int shift>
+static inline __m256i srai_epi8( const __m256i x )
+{
+  const __m256i low = _mm256_srai_epi16( _mm256_unpacklo_epi8( _mm256_setzero_si256(), x ), 8 + shift );
+  const __m256i high = _mm256_srai_epi16( _mm256_unpackhi_epi8( _mm256_setzero_si256(), x ), 8 + shift );
+
+  return _mm256_packs_epi16( low, high );
+}
+
+/* clamp( ( 63 + x * multiplier ) >> 7 ) of signed bytes */
+template <int16_t multiplier>
+static inline __m256i scaled_tap( const __m256i x )
+{
+  const __m256i m = _mm256_set1_epi16( multiplier );
+  const __m256i rounding = _mm256_set1_epi16( 63 );
+
+  auto scale = [&]( const __m256i words )
+    {
+      return _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( _mm256_srai_epi16( words, 8 ), m ),
+                                                  rounding ), 7 );
+    };
+
+  return _mm256_packs_epi16( scale( _mm256_unpacklo_epi8( _mm256_setzero_si256(), x ) ),
+                             scale( _mm256_unpackhi_epi8( _mm256_setzero_si256(), x ) ) );
+}
+
+/* ps1 - qs1 (if `hev`) + 3 * ( qs0 - ps0 ), saturated at every step. the
+   partial sums move monotonically, so this matches clamping once at the end. */
+static inline __m256i common_adjustment( const __m256i ps1, const __m256i ps0,
+                                         const __m256i qs0, const __m256i qs1 )
+{
+  const __m256i step = _mm256_subs_epi8( qs0, ps0 );
+  __m256i value = _mm256_subs_epi8( ps1, qs1 );
+  value = _mm256_adds_epi8( value, step );
+  value = _mm256_adds_epi8( value, step );
+  return _mm256_adds_epi8( value, step );
+}
+
+/* vp8_filter */
+static inline void subblock_filter( EdgePixels & px, const EdgeLimits & limits )
+{
+  const __m256i mask = filter_mask( px, limits );
+  const __m256i hev = hev_mask( px, limits );
+
+  const __m256i ps1 = flip_sign( px.p1 ), ps0 = flip_sign( px.p0 );
+  const __m256i qs0 = flip_sign( px.q0 ), qs1 = flip_sign( px.q1 );
+
+  const __m256i value = _mm256_and_si256( common_adjustment( _mm256_and_si256( ps1, hev ),
+                                                             ps0, qs0,
+                                                             _mm256_and_si256( qs1, hev ) ),
+                                          mask );
+
+  const __m256i filter1 = srai_epi8<3>( _mm256_adds_epi8( value, _mm256_set1_epi8( 4 ) ) );
+  const __m256i filter2 = srai_epi8<3>( _mm256_adds_epi8( value, _mm256_set1_epi8( 3 ) ) );
+
+  px.q0 = flip_sign( _mm256_subs_epi8( qs0, filter1 ) );
+  px.p0 = flip_sign( _mm256_adds_epi8( ps0, filter2 ) );
+
+  /* filter1 is in [-16, 15], so adding one cannot overflow */
+  const __m256i outer = _mm256_andnot_si256( hev, srai_epi8<1>( _mm256_add_epi8( filter1, _mm256_set1_epi8( 1 ) ) ) );
+
+  px.q1 = flip_sign( _mm256_subs_epi8( qs1, outer ) );
+  px.p1 = flip_sign( _mm256_adds_epi8( ps1, outer ) );
+}
+
+/* vp8_mbfilter */
+static inline void macroblock_filter( EdgePixels & px, const EdgeLimits & limits )
+{
+  const __m256i mask = filter_mask( px, limits );
+  const __m256i hev = hev_mask( px, limits );
+
+  const __m256i ps2 = flip_sign( px.p2 ), ps1 = flip_sign( px.p1 ), ps0 = flip_sign( px.p0 );
+  const __m256i qs0 = flip_sign( px.q0 ), qs1 = flip_sign( px.q1 ), qs2 = flip_sign( px.q2 );
+
+  const __m256i value = _mm256_and_si256( common_adjustment( ps1, ps0, qs0, qs1 ), mask );
+
+  /* high edge variance: adjust only p0 and q0 */
+  const __m256i sharp = _mm256_and_si256( value, hev );
+  const __m256i filter1 = srai_epi8<3>( _mm256_adds_epi8( sharp, _mm256_set1_epi8( 4 ) ) );
+  const __m256i filter2 = srai_epi8<3>( _mm256_adds_epi8( sharp, _mm256_set1_epi8( 3 ) ) );
+
+  const __m256i sharp_qs0 = _mm256_subs_epi8( qs0, filter1 );
+  const __m256i sharp_ps0 = _mm256_adds_epi8( ps0, filter2 );
+
+  /* otherwise, spread 3/7, 2/7 and 1/7 of the difference over three pixels */
+  const __m256i wide = _mm256_andnot_si256( hev, value );
+
+  const __m256i tap27 = scaled_tap<27>( wide );
+  const __m256i tap18 = scaled_tap<18>( wide );
+  const __m256i tap9 = scaled_tap<9>( wide );
+
+  px.q0 = flip_sign( _mm256_subs_epi8( sharp_qs0, tap27 ) );
+  px.p0 = flip_sign( _mm256_adds_epi8( sharp_ps0, tap27 ) );
+  px.q1 = flip_sign( _mm256_subs_epi8( qs1, tap18 ) );
+  px.p1 = flip_sign( _mm256_adds_epi8( ps1, tap18 ) );
+  px.q2 = flip_sign( _mm256_subs_epi8( qs2, tap9 ) );
+  px.p2 = flip_sign( _mm256_adds_epi8( ps2, tap9 ) );
+}
+
+/* the planes that an edge runs through. without chroma, the high lane is
+   zero on the way in and dropped on the way out. */
+struct EdgePlanes
+{
+  uint8_t * y;
+  uint8_t * u;
+  uint8_t * v;
+  int y_stride;
+  int uv_stride;
+};
+
+/* a horizontal edge: each vector is one row, starting four rows above `planes` */
+
+static inline __m256i load_row( const EdgePlanes & planes, const int row )
+{
+  const __m128i y = _mm_loadu_si128( reinterpret_cast<const __m128i *>( planes.y + row * planes.y_stride ) );
+  const __m128i uv = planes.u
+    ? _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( planes.u + row * planes.uv_stride ) ),
+                          _mm_loadl_epi64( reinterpret_cast<const __m128i *>( planes.v + row * planes.uv_stride ) ) )
+    : _mm_setzero_si128();
+
+  return _mm256_inserti128_si256( _mm256_castsi128_si256( y ), uv, 1 );
+}
+
+static inline void store_row( const EdgePlanes & planes, const int row, const __m256i pixels )
+{
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( planes.y + row * planes.y_stride ),
+                    _mm256_castsi256_si128( pixels ) );
+
+  if ( planes.u ) {
+    const __m128i uv = _mm256_extracti128_si256( pixels, 1 );
+    _mm_storel_epi64( reinterpret_cast<__m128i *>( planes.u + row * planes.uv_stride ), uv );
+    _mm_storel_epi64( reinterpret_cast<__m128i *>( planes.v + row * planes.uv_stride ),
+                      _mm_unpackhi_epi64( uv, uv ) );
+  }
+}
+
+static inline EdgePixels load_rows( const EdgePlanes & planes )
+{
+  return { load_row( planes, -4 ), load_row( planes, -3 ), load_row( planes, -2 ), load_row( planes, -1 ),
+           load_row( planes, 0 ), load_row( planes, 1 ), load_row( planes, 2 ), load_row( planes, 3 ) };
+}
+
+/* only p2 through q2 can have changed */
+static inline void store_rows( const EdgePlanes & planes, const EdgePixels & px )
+{
+  store_row( planes, -3, px.p2 );
+  store_row( planes, -2, px.p1 );
+  store_row( planes, -1, px.p0 );
+  store_row( planes, 0, px.q0 );
+  store_row( planes, 1, px.q1 );
+  store_row( planes, 2, px.q2 );
+}
+
+/* a vertical edge: the eight columns around it are transposed into
+   vectors, with luma rows 0-15 in the low lane and chroma U rows 0-7
+   then V rows 0-7 in the high lane */
+
+static inline EdgePixels load_columns( const EdgePlanes & planes )
+{
+  auto row = [&]( const int index )
+    {
+      const __m128i y = _mm_loadl_epi64( reinterpret_cast<const __m128i *>( planes.y - 4 + index * planes.y_stride ) );
+      const __m128i uv = not planes.u ? _mm_setzero_si128()
+        : _mm_loadl_epi64( reinterpret_cast<const __m128i *>( ( index < 8 ? planes.u : planes.v ) - 4
+                                                              + ( index % 8 ) * planes.uv_stride ) );
+      return _mm256_inserti128_si256( _mm256_castsi128_si256( y ), uv, 1 );
+    };
+
+  /* 16x8 transpose within each lane: bytes, then words, dwords and qwords */
+  __m256i pairs[ 8 ];
+  for ( unsigned int i = 0; i < 8; i++ ) {
+    pairs[ i ] = _mm256_unpacklo_epi8( row( 2 * i ), row( 2 * i + 1 ) );
+  }
+
+  __m256i quads_low[ 4 ], quads_high[ 4 ];
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    quads_low[ i ] = _mm256_unpacklo_epi16( pairs[ 2 * i ], pairs[ 2 * i + 1 ] );
+    quads_high[ i ] = _mm256_unpackhi_epi16( pairs[ 2 * i ], pairs[ 2 * i + 1 ] );
+  }
+
+  /* columns 0-1, 2-3, 4-5 and 6-7 of rows 0-7 and of rows 8-15 */
+  const __m256i c01_top = _mm256_unpacklo_epi32( quads_low[ 0 ], quads_low[ 1 ] );
+  const __m256i c23_top = _mm256_unpackhi_epi32( quads_low[ 0 ], quads_low[ 1 ] );
+  const __m256i c45_top = _mm256_unpacklo_epi32( quads_high[ 0 ], quads_high[ 1 ] );
+  const __m256i c67_top = _mm256_unpackhi_epi32( quads_high[ 0 ], quads_high[ 1 ] );
+  const __m256i c01_bottom = _mm256_unpacklo_epi32( quads_low[ 2 ], quads_low[ 3 ] );
+  const __m256i c23_bottom = _mm256_unpackhi_epi32( quads_low[ 2 ], quads_low[ 3 ] );
+  const __m256i c45_bottom = _mm256_unpacklo_epi32( quads_high[ 2 ], quads_high[ 3 ] );
+  const __m256i c67_bottom = _mm256_unpackhi_epi32( quads_high[ 2 ], quads_high[ 3 ] );
+
+  return { _mm256_unpacklo_epi64( c01_top, c01_bottom ), _mm256_unpackhi_epi64( c01_top, c01_bottom ),
+           _mm256_unpacklo_epi64( c23_top, c23_bottom ), _mm256_unpackhi_epi64( c23_top, c23_bottom ),
+           _mm256_unpacklo_epi64( c45_top, c45_bottom ), _mm256_unpackhi_epi64( c45_top, c45_bottom ),
+           _mm256_unpacklo_epi64( c67_top, c67_bottom ), _mm256_unpackhi_epi64( c67_top, c67_bottom ) };
+}
+
+static inline void store_columns( const EdgePlanes & planes, const EdgePixels & px )
+{
+  /* the transpose back: rows 0-7 come from the low halves of each lane, rows 8-15 from the high */
+  const __m256i c01_top = _mm256_unpacklo_epi8( px.p3, px.p2 ), c01_bottom = _mm256_unpackhi_epi8( px.p3, px.p2 );
+  const __m256i c23_top = _mm256_unpacklo_epi8( px.p1, px.p0 ), c23_bottom = _mm256_unpackhi_epi8( px.p1, px.p0 );
+  const __m256i c45_top = _mm256_unpacklo_epi8( px.q0, px.q1 ), c45_bottom = _mm256_unpackhi_epi8( px.q0, px.q1 );
+  const __m256i c67_top = _mm256_unpacklo_epi8( px.q2, px.q3 ), c67_bottom = _mm256_unpackhi_epi8( px.q2, px.q3 );
+
+  /* each 64-bit quarter of `rows[ i ]` is one whole row: rows 2i and 2i + 1 */
+  __m256i rows[ 8 ];
+
+  auto interleave = [&]( const __m256i c01, const __m256i c23, const __m256i c45, const __m256i c67,
+                         __m256i * out )
+    {
+      const __m256i left_0_3 = _mm256_unpacklo_epi16( c01, c23 ), left_4_7 = _mm256_unpackhi_epi16( c01, c23 );
+      const __m256i right_0_3 = _mm256_unpacklo_epi16( c45, c67 ), right_4_7 = _mm256_unpackhi_epi16( c45, c67 );
+
+      out[ 0 ] = _mm256_unpacklo_epi32( left_0_3, right_0_3 );
+      out[ 1 ] = _mm256_unpackhi_epi32( left_0_3, right_0_3 );
+      out[ 2 ] = _mm256_unpacklo_epi32( left_4_7, right_4_7 );
+      out[ 3 ] = _mm256_unpackhi_epi32( left_4_7, right_4_7 );
+    };
+
+  interleave( c01_top, c23_top, c45_top, c67_top, rows );
+  interleave( c01_bottom, c23_bottom, c45_bottom, c67_bottom, rows + 4 );
+
+  for ( unsigned int i = 0; i < 8; i++ ) {
+    const __m128i y = _mm256_castsi256_si128( rows[ i ] );
+    _mm_storel_epi64( reinterpret_cast<__m128i *>( planes.y - 4 + ( 2 * i ) * planes.y_stride ), y );
+    _mm_storel_epi64( reinterpret_cast<__m128i *>( planes.y - 4 + ( 2 * i + 1 ) * planes.y_stride ),
+                      _mm_unpackhi_epi64( y, y ) );
+
+    if ( planes.u ) {
+      const __m128i uv = _mm256_extracti128_si256( rows[ i ], 1 );
+      uint8_t * chroma = ( i < 4 ? planes.u : planes.v ) - 4 + ( 2 * ( i % 4 ) ) * planes.uv_stride;
+      _mm_storel_epi64( reinterpret_cast<__m128i *>( chroma ), uv );
+      _mm_storel_epi64( reinterpret_cast<__m128i *>( chroma + planes.uv_stride ),
+                        _mm_unpackhi_epi64( uv, uv ) );
+    }
+  }
+}
+
+void avx2::mb_vertical_edge( uint8_t * y, uint8_t * u, uint8_t * v,
+                             const int y_stride, const int uv_stride,
+                             const uint8_t * blimit, const uint8_t * limit,
+                             const uint8_t * thresh )
+{
+  const EdgePlanes planes { y, u, v, y_stride, uv_stride };
+  EdgePixels px = load_columns( planes );
+  macroblock_filter( px, edge_limits( blimit, limit, thresh ) );
+  store_columns( planes, px );
+}
+
+void avx2::mb_horizontal_edge( uint8_t * y, uint8_t * u, uint8_t * v,
+                               const int y_stride, const int uv_stride,
+                               const uint8_t * blimit, const uint8_t * limit,
+                               const uint8_t * thresh )
+{
+  const EdgePlanes planes { y, u, v, y_stride, uv_stride };
+  EdgePixels px = load_rows( planes );
+  macroblock_filter( px, edge_limits( blimit, limit, thresh ) );
+  store_rows( planes, px );
+}
+
+/* chroma has a single interior edge, which rides along with the first luma one */
+
+void avx2::sb_vertical_edges( uint8_t * y, uint8_t * u, uint8_t * v,
+                              const int y_stride, const int uv_stride,
+                              const uint8_t * blimit, const uint8_t * limit,
+                              const uint8_t * thresh )
+{
+  const EdgeLimits limits = edge_limits( blimit, limit, thresh );
+
+  for ( unsigned int column = 4; column < 16; column += 4 ) {
+    const EdgePlanes planes = column == 4
+      ? EdgePlanes { y + 4, u + 4, v + 4, y_stride, uv_stride }
+      : EdgePlanes { y + column, nullptr, nullptr, y_stride, uv_stride };
+
+    EdgePixels px = load_columns( planes );
+    subblock_filter( px, limits );
+    store_columns( planes, px );
+  }
+}
+
+void avx2::sb_horizontal_edges( uint8_t * y, uint8_t * u, uint8_t * v,
+                                const int y_stride, const int uv_stride,
+                                const uint8_t * blimit, const uint8_t * limit,
+                                const uint8_t * thresh )
+{
+  const EdgeLimits limits = edge_limits( blimit, limit, thresh );
+
+  for ( unsigned int row = 4; row < 16; row += 4 ) {
+    const EdgePlanes planes = row == 4
+      ? EdgePlanes { y + 4 * y_stride, u + 4 * uv_stride, v + 4 * uv_stride, y_stride, uv_stride }
+      : EdgePlanes { y + row * y_stride, nullptr, nullptr, y_stride, uv_stride };
+
+    EdgePixels px = load_rows( planes );
+    subblock_filter( px, limits );
+    store_rows( planes, px );
+  }
+}
+
+#pragma GCC pop_options
+
+#endif /* HAVE_AVX2 */
@@ -26,37 +26,27 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
-#include "vp8_raster.hh"
-#include "decoder.hh"
-#include "encoder.hh"
+#ifndef KERNELS_AVX2_HH
+#define KERNELS_AVX2_HH
 
-using namespace std;
+#include "kernels.hh"
 
-SafeReferences::SafeReferences( const uint16_t width, const uint16_t height )
-  : last( move ( MutableSafeRasterHandle( width, height ) ) ),
-    golden( move ( MutableSafeRasterHandle( width, height ) ) ),
-    alternative( move ( MutableSafeRasterHandle( width, height ) ) )
-{}
+/* AVX2 versions of the kernels that benefit from 256-bit vectors.
+   they are compiled for AVX2 regardless of the build flags, so they
+   may only be called once the CPU is known to support it. */
+namespace avx2
+{
+  Kernels::SixtapFilter sixtap_horizontal_16;
+  Kernels::SixtapFilter sixtap_vertical_16;
 
-SafeReferences::SafeReferences( const References & references )
-  : last( move ( load( references.last ) ) ),
-    golden( move ( load( references.golden ) ) ),
-    alternative( move ( load( references.alternative ) ) )
-{}
+  Kernels::InverseDCTAdd idct_add_x4;
 
-const SafeRaster & SafeReferences::get( reference_frame reference_id ) const
-{
-  switch ( reference_id ) {
-  case LAST_FRAME: return last.get();
-  case GOLDEN_FRAME: return golden.get();
-  case ALTREF_FRAME: return alternative.get();
-  default: throw LogicError();
-  }
-}
+  Kernels::SumOfAbsoluteDifferences sad16x16;
 
-MutableSafeRasterHandle SafeReferences::load( const VP8Raster & source )
-{
-  MutableSafeRasterHandle target( source.display_width(), source.display_height() );
-  target.get().copy_raster( source );
-  return target;
+  Kernels::EdgeFilter mb_vertical_edge;
+  Kernels::EdgeFilter mb_horizontal_edge;
+  Kernels::EdgeFilter sb_vertical_edges;
+  Kernels::EdgeFilter sb_horizontal_edges;
 }
+
+#endif /* KERNELS_AVX2_HH */
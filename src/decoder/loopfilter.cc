@@ -30,7 +30,7 @@
 #include "frame_header.hh"
 #include "macroblock.hh"
 #include "vp8_raster.hh"
-#include "loopfilter_filters.hh"
+#include "kernels.hh"
 #include "decoder.hh"
 
 static inline uint8_t clamp63( const int input )
@@ -124,16 +124,16 @@ NormalLoopFilter::NormalLoopFilter( const bool key_frame,
 
 }
 
-void SimpleLoopFilter::filter( VP8Raster::Macroblock & , const bool )
+void SimpleLoopFilter::filter( const VP8Raster::MacroblockView &, const bool )
 {
   throw Unsupported( "VP8 'simple' in-loop deblocking filter" );
 }
 
 // Corresponds roughly to vp8_loop_filter_mbh_c combined with vp8_loop_filter_row_normal
-void NormalLoopFilter::filter( VP8Raster::Macroblock & raster, const bool skip_subblock_edges )
+void NormalLoopFilter::filter( const VP8Raster::MacroblockView & raster, const bool skip_subblock_edges )
 {
   /* 1: filter the left inter-macroblock edge */
-  if ( raster.Y.column() > 0 ) {
+  if ( raster.column > 0 ) {
     filter_mb_vertical( raster );
   }
 
@@ -143,7 +143,7 @@ void NormalLoopFilter::filter( VP8Raster::Macroblock & raster, const bool skip_s
   }
 
   /* 3: filter the top inter-macroblock edge */
-  if ( raster.Y.row() > 0 ) {
+  if ( raster.row > 0 ) {
     filter_mb_horizontal( raster );
   }
 
@@ -153,245 +153,38 @@ void NormalLoopFilter::filter( VP8Raster::Macroblock & raster, const bool skip_s
   }
 }
 
-// Roughly the same as filter_mbloop_filter_horizontal_edge_c
-template <class BlockType>
-void NormalLoopFilter::filter_mb_vertical_c( BlockType & block )
+void NormalLoopFilter::filter_mb_vertical( const VP8Raster::MacroblockView & raster )
 {
-  const uint8_t size = BlockType::dimension;
-
-  for ( unsigned int row = 0; row < size; row++ ) {
-    uint8_t *central = &block.at( 0, row );
-
-    const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                         simple_.macroblock_edge_limit(),
-                                         *(central - 4),
-                                         *(central - 3),
-                                         *(central - 2),
-                                         *(central - 1),
-                                         *(central),
-                                         *(central + 1),
-                                         *(central + 2),
-                                         *(central + 3) );
-
-    const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                    *(central - 2),
-                                    *(central - 1),
-                                    *(central),
-                                    *(central + 1) );
-
-    vp8_mbfilter( mask, hev,
-                  *(central - 3), *(central - 2), *(central - 1),
-                  *(central), *(central + 1), *(central + 2) );
-  }
-}
-
-void NormalLoopFilter::filter_mb_vertical( VP8Raster::Macroblock & raster )
-{
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.macroblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-  vp8_mbloop_filter_vertical_edge_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-  vp8_mbloop_filter_vertical_edge_uv_sse2(u_ptr, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(),
-                                          v_ptr);
-#else
-  filter_mb_vertical_c( raster.Y );
-  filter_mb_vertical_c( raster.U );
-  filter_mb_vertical_c( raster.V );
-#endif
-}
-
-template <class BlockType>
-void NormalLoopFilter::filter_mb_horizontal_c( BlockType & block )
-{
-  const uint8_t size = BlockType::dimension;
-
-  const unsigned int stride = block.stride();
-
-  for ( unsigned int column = 0; column < size; column++ ) {
-    uint8_t *central = &block.at( column, 0 );
-
-    const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                         simple_.macroblock_edge_limit(),
-                                         *(central - 4 * stride ),
-                                         *(central - 3 * stride ),
-                                         *(central - 2 * stride ),
-                                         *(central - stride ),
-                                         *(central),
-                                         *(central + stride ),
-                                         *(central + 2 * stride ),
-                                         *(central + 3 * stride ) );
-
-    const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                    *(central - 2 * stride ),
-                                    *(central - stride ),
-                                    *(central),
-                                    *(central + stride ) );
-
-    vp8_mbfilter( mask, hev,
-                  *(central - 3 * stride ),
-                  *(central - 2 * stride ),
-                  *(central - stride ),
-                  *(central),
-                  *(central + stride ),
-                  *(central + 2 * stride ) );
-  }
-}
-
-void NormalLoopFilter::filter_mb_horizontal( VP8Raster::Macroblock & raster )
-{
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.macroblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-  vp8_mbloop_filter_horizontal_edge_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-  vp8_mbloop_filter_horizontal_edge_uv_sse2(u_ptr, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(),
-                                          v_ptr);
-#else
-  filter_mb_horizontal_c( raster.Y );
-  filter_mb_horizontal_c( raster.U );
-  filter_mb_horizontal_c( raster.V );
-#endif
+  kernels().mb_vertical_edge( raster.Y, raster.U, raster.V,
+                              raster.Y_stride, raster.UV_stride,
+                              simple_.macroblock_limit_vector().data(),
+                              simple_.interior_limit_vector().data(),
+                              hev_threshold_vector_.data() );
 }
 
-template <class BlockType>
-void NormalLoopFilter::filter_sb_vertical_c( BlockType & block )
+void NormalLoopFilter::filter_mb_horizontal( const VP8Raster::MacroblockView & raster )
 {
-  const uint8_t size = BlockType::dimension;
-
-  for ( unsigned int center_column = 4; center_column < size; center_column += 4 ) {
-    for ( unsigned int row = 0; row < size; row++ ) {
-      uint8_t *central = &block.at( center_column, row );
-
-      const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                           simple_.subblock_edge_limit(),
-                                           *(central - 4),
-                                           *(central - 3),
-                                           *(central - 2),
-                                           *(central - 1),
-                                           *(central),
-                                           *(central + 1),
-                                           *(central + 2),
-                                           *(central + 3) );
-
-      const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                      *(central - 2),
-                                      *(central - 1),
-                                      *(central),
-                                      *(central + 1) );
-
-      vp8_filter( mask, hev,
-                  *(central - 2), *(central - 1),
-                  *(central), *(central + 1) );
-    }
-  }
+  kernels().mb_horizontal_edge( raster.Y, raster.U, raster.V,
+                                raster.Y_stride, raster.UV_stride,
+                                simple_.macroblock_limit_vector().data(),
+                                simple_.interior_limit_vector().data(),
+                                hev_threshold_vector_.data() );
 }
 
-void NormalLoopFilter::filter_sb_vertical( VP8Raster::Macroblock & raster )
+void NormalLoopFilter::filter_sb_vertical( const VP8Raster::MacroblockView & raster )
 {
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.subblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-#ifdef ARCH_X86_64
-    vp8_loop_filter_bv_y_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), 2);
-#else
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 4, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 8, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 12, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-#endif
-
-  vp8_loop_filter_vertical_edge_uv_sse2(u_ptr + 4, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), v_ptr + 4);
-#else
-  filter_sb_vertical_c( raster.Y );
-  filter_sb_vertical_c( raster.U );
-  filter_sb_vertical_c( raster.V );
-#endif
+  kernels().sb_vertical_edges( raster.Y, raster.U, raster.V,
+                               raster.Y_stride, raster.UV_stride,
+                               simple_.subblock_limit_vector().data(),
+                               simple_.interior_limit_vector().data(),
+                               hev_threshold_vector_.data() );
 }
 
-template <class BlockType>
-void NormalLoopFilter::filter_sb_horizontal_c( BlockType & block )
+void NormalLoopFilter::filter_sb_horizontal( const VP8Raster::MacroblockView & raster )
 {
-  const uint8_t size = BlockType::dimension;
-
-  const unsigned int stride = block.stride();
-
-  for ( unsigned int center_row = 4; center_row < size; center_row += 4 ) {
-    for ( unsigned int column = 0; column < size; column++ ) {
-      uint8_t *central = &block.at( column, center_row );
-
-      const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                           simple_.subblock_edge_limit(),
-                                           *(central - 4 * stride ),
-                                           *(central - 3 * stride ),
-                                           *(central - 2 * stride ),
-                                           *(central - stride ),
-                                           *(central),
-                                           *(central + stride ),
-                                           *(central + 2 * stride ),
-                                           *(central + 3 * stride ) );
-
-      const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                      *(central - 2 * stride ),
-                                      *(central - stride ),
-                                      *(central),
-                                      *(central + stride ) );
-
-      vp8_filter( mask, hev,
-                  *(central - 2 * stride ),
-                  *(central - stride ),
-                  *(central),
-                  *(central + stride ) );
-    }
-  }
-}
-
-void NormalLoopFilter::filter_sb_horizontal( VP8Raster::Macroblock & raster )
-{
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.subblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-#ifdef ARCH_X86_64
-    vp8_loop_filter_bh_y_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), 2);
-#else
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 4 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 8 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 12 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-#endif
-
-  vp8_loop_filter_horizontal_edge_uv_sse2(u_ptr + 4 * uv_stride, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), v_ptr + 4 * uv_stride);
-#else
-  filter_sb_horizontal_c( raster.Y );
-  filter_sb_horizontal_c( raster.U );
-  filter_sb_horizontal_c( raster.V );
-#endif
+  kernels().sb_horizontal_edges( raster.Y, raster.U, raster.V,
+                                 raster.Y_stride, raster.UV_stride,
+                                 simple_.subblock_limit_vector().data(),
+                                 simple_.interior_limit_vector().data(),
+                                 hev_threshold_vector_.data() );
 }
@@ -63,7 +63,7 @@ struct FilterParameters
 class SimpleLoopFilter
 {
 private:
-  // libvpx SSE2 routines expect preloaded vectors for arguments rather than pointers
+  // the loop filter kernels expect preloaded vectors for arguments rather than pointers
   // to single elements
   alignas(16) std::array<uint8_t, 16> interior_limit_vector_;
   alignas(16) std::array<uint8_t, 16> macroblock_limit_vector_;
@@ -81,7 +81,7 @@ public:
   uint8_t subblock_edge_limit( void ) const { return subblock_limit_vector_[0]; }
   const std::array<uint8_t, 16>& subblock_limit_vector( void ) const { return subblock_limit_vector_; }
 
-  void filter( VP8Raster::Macroblock & raster, const bool skip_subblock_edges );
+  void filter( const VP8Raster::MacroblockView & raster, const bool skip_subblock_edges );
 };
 
 class NormalLoopFilter
@@ -90,30 +90,18 @@ private:
   SimpleLoopFilter simple_;
   alignas(16) std::array<uint8_t, 16> hev_threshold_vector_;
 
-  void filter_mb_vertical( VP8Raster::Macroblock & raster );
+  void filter_mb_vertical( const VP8Raster::MacroblockView & raster );
 
-  void filter_mb_horizontal( VP8Raster::Macroblock & raster );
+  void filter_mb_horizontal( const VP8Raster::MacroblockView & raster );
 
-  void filter_sb_vertical( VP8Raster::Macroblock & raster );
+  void filter_sb_vertical( const VP8Raster::MacroblockView & raster );
 
-  void filter_sb_horizontal( VP8Raster::Macroblock & raster );
-
-  template <class BlockType>
-  void filter_mb_vertical_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_mb_horizontal_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_sb_vertical_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_sb_horizontal_c( BlockType & block );
+  void filter_sb_horizontal( const VP8Raster::MacroblockView & raster );
 
 public:
   NormalLoopFilter( const bool key_frame, const FilterParameters & params );
 
-  void filter( VP8Raster::Macroblock & raster, const bool skip_subblock_edges );
+  void filter( const VP8Raster::MacroblockView & raster, const bool skip_subblock_edges );
 };
 
 #endif /* LOOPFILTER_HH */
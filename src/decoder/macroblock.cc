@@ -34,6 +34,7 @@
 #include "quantization.cc"
 #include "tree.cc"
 #include "scorer.hh"
+#include "kernels.hh"
 
 #include <climits>
 #include <algorithm>
@@ -94,10 +95,10 @@ void KeyFrameMacroblock::decode_prediction_modes( BoolDecoder & data,
   Y_.forall( [&]( YBlock & block )
              {
                if ( Y2_.prediction_mode() == B_PRED ) {
-                 const auto above_mode = block.context().above.initialized()
-                   ? block.context().above.get()->prediction_mode() : B_DC_PRED;
-                 const auto left_mode = block.context().left.initialized()
-                   ? block.context().left.get()->prediction_mode() : B_DC_PRED;
+                 const auto above_mode = block.context().above().initialized()
+                   ? block.context().above().get()->prediction_mode() : B_DC_PRED;
+                 const auto left_mode = block.context().left().initialized()
+                   ? block.context().left().get()->prediction_mode() : B_DC_PRED;
                  block.set_Y_without_Y2();
                  block.set_prediction_mode( Tree< bmode, num_intra_b_modes, b_mode_tree >( data,
                                                                                            kf_b_mode_probs.at( above_mode ).at( left_mode ) ) );
@@ -185,9 +186,9 @@ MotionVector Scorer::clamp( const MotionVector & mv, const typename TwoD< InterF
   MotionVector ret( mv );
 
   const int16_t to_left = max( -(((int32_t)c.column * 16) << 3) - 128, (int32_t)SHRT_MIN );
-  const int16_t to_right = min( (((c.width - 1 - c.column) * 16) << 3) + 128, (uint32_t)SHRT_MAX );
+  const int16_t to_right = min( (((c.width() - 1 - c.column) * 16) << 3) + 128, (uint32_t)SHRT_MAX );
   const int16_t to_top = max( -((((int32_t)c.row * 16)) << 3) - 128, (int32_t)SHRT_MIN );
-  const int16_t to_bottom = min( (((c.height - 1 - c.row) * 16) << 3) + 128, (uint32_t)SHRT_MAX );
+  const int16_t to_bottom = min( (((c.height() - 1 - c.row) * 16) << 3) + 128, (uint32_t)SHRT_MAX );
 
   ret.clamp( to_left, to_right, to_top, to_bottom );
 
@@ -235,9 +236,9 @@ void YBlock::read_subblock_inter_prediction( BoolDecoder & data,
 {
   const MotionVector default_mv;
 
-  const MotionVector & left_mv = context().left.initialized() ? context().left.get()->motion_vector() : default_mv;
+  const MotionVector & left_mv = context().left().initialized() ? context().left().get()->motion_vector() : default_mv;
 
-  const MotionVector & above_mv = context().above.initialized() ? context().above.get()->motion_vector() : default_mv;
+  const MotionVector & above_mv = context().above().initialized() ? context().above().get()->motion_vector() : default_mv;
 
   const bool left_is_zero = left_mv.empty();
   const bool above_is_zero = above_mv.empty();
@@ -303,9 +304,9 @@ Scorer InterFrameMacroblock::motion_vector_census()
 {
   Scorer census( header_.motion_vectors_flipped_ );
 
-  census.add( 2, context_.above );
-  census.add( 2, context_.left );
-  census.add( 1, context_.above_left );
+  census.add( 2, context_.above() );
+  census.add( 2, context_.left() );
+  census.add( 1, context_.above_left() );
   census.calculate();
 
   return census;
@@ -474,7 +475,7 @@ InterFrameMacroblockHeader::InterFrameMacroblockHeader()
 
 template <class FrameHeaderType, class MacroblockHeaderType>
 void Macroblock<FrameHeaderType, MacroblockHeaderType>::parse_tokens( BoolDecoder & data,
-                                                                      const ProbabilityTables & probability_tables )
+                                                                      const TokenProbabilities & token_probabilities )
 {
   /* is macroblock skipped? */
   if ( mb_skip_coeff_.get_or( false ) ) {
@@ -483,67 +484,99 @@ void Macroblock<FrameHeaderType, MacroblockHeaderType>::parse_tokens( BoolDecode
 
   /* parse Y2 block if present */
   if ( Y2_.coded() ) {
-    Y2_.parse_tokens( data, probability_tables );
+    Y2_.parse_tokens( data, token_probabilities );
     has_nonzero_ |= Y2_.has_nonzero();
   }
 
   /* parse Y blocks with variable first coefficient */
   Y_.forall( [&]( YBlock & block ) {
-      block.parse_tokens( data, probability_tables );
+      block.parse_tokens( data, token_probabilities );
       has_nonzero_ |= block.has_nonzero(); } );
 
   /* parse U and V blocks */
   U_.forall( [&]( UVBlock & block ) {
-      block.parse_tokens( data, probability_tables );
+      block.parse_tokens( data, token_probabilities );
       has_nonzero_ |= block.has_nonzero(); } );
   V_.forall( [&]( UVBlock & block ) {
-      block.parse_tokens( data, probability_tables );
+      block.parse_tokens( data, token_probabilities );
       has_nonzero_ |= block.has_nonzero(); } );
 }
 
 template <class FrameHeaderType, class MacroblockHeaderType>
 void Macroblock<FrameHeaderType, MacroblockHeaderType>::apply_walsh( const Quantizer & quantizer,
-                                                                     VP8Raster::Macroblock & raster ) const
+                                                                     const VP8Raster::MacroblockView & raster ) const
 {
+    /* blocks with no AC coefficients only need the DC from the Y2 block */
     SafeArray< SafeArray< DCTCoefficients, 4 >, 4 > Y_dequant_coeffs;
+    SafeArray< bool, 4 > row_has_ac {{}};
     for ( int row = 0; row < 4; row++ ) {
       for ( int column = 0; column < 4; column++ ) {
-        Y_dequant_coeffs.at( row ).at( column ) = Y_.at( column, row ).dequantize( quantizer );
+        const YBlock & block = Y_.at( column, row );
+        if ( block.eob() > 1 ) {
+          Y_dequant_coeffs.at( row ).at( column ) = block.dequantize( quantizer );
+          row_has_ac.at( row ) = true;
+        }
       }
     }
-    Y2_.dequantize( quantizer ).iwht( Y_dequant_coeffs );
+
+    const DCTCoefficients Y2_dequant_coeffs = Y2_.dequantize( quantizer );
+    if ( Y2_.eob() <= 1 ) {
+      /* the inverse WHT of a lone DC gives every block the same DC */
+      const int16_t dc = ( Y2_dequant_coeffs.at( 0 ) + 3 ) >> 3;
+      for ( int row = 0; row < 4; row++ ) {
+        for ( int column = 0; column < 4; column++ ) {
+          Y_dequant_coeffs.at( row ).at( column ).at( 0 ) = dc;
+        }
+      }
+    }
+    else {
+      Y2_dequant_coeffs.iwht( Y_dequant_coeffs );
+    }
 
     for ( int row = 0; row < 4; row++ ) {
-      for ( int column = 0; column < 4; column++ ) {
-        Y_dequant_coeffs.at( row ).at( column ).idct_add( raster.Y_sub_at( column, row ) );
+      if ( row_has_ac.at( row ) ) {
+        DCTCoefficients::idct_add_x4( Y_dequant_coeffs.at( row ), raster.Y_sub( 0, row ), raster.Y_stride );
+      }
+      else {
+        for ( int column = 0; column < 4; column++ ) {
+          kernels().idct_dc_add( Y_dequant_coeffs.at( row ).at( column ).at( 0 ),
+                                 raster.Y_sub( column, row ), raster.Y_stride );
+        }
       }
     }
 }
 
+template <class FrameHeaderType, class MacroblockHeaderType>
+void Macroblock<FrameHeaderType, MacroblockHeaderType>::add_chroma_residue( const Quantizer & quantizer,
+                                                                            const VP8Raster::MacroblockView & raster ) const
+{
+  U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
+                { block.idct_add( quantizer, raster.U_sub( column, row ), raster.UV_stride ); } );
+  V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
+                { block.idct_add( quantizer, raster.V_sub( column, row ), raster.UV_stride ); } );
+}
+
 template <class FrameHeaderType, class MacroblockHeaderType>
 void Macroblock<FrameHeaderType, MacroblockHeaderType>::reconstruct_intra( const Quantizer & quantizer,
-                                                                           VP8Raster::Macroblock & raster ) const
+                                                                           const VP8Raster::MacroblockView & raster ) const
 {
   /* Chroma */
-  raster.U.intra_predict( uv_prediction_mode() );
-  raster.V.intra_predict( uv_prediction_mode() );
+  raster.U_block().intra_predict( uv_prediction_mode() );
+  raster.V_block().intra_predict( uv_prediction_mode() );
 
   if ( has_nonzero_ ) {
-    U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                  { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
-    V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                  { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+    add_chroma_residue( quantizer, raster );
   }
 
   /* Luma */
   if ( Y2_.prediction_mode() == B_PRED ) {
     /* Prediction and inverse transform done in line! */
     Y_.forall_ij( [&] ( const YBlock & block, const unsigned int column, const unsigned int row ) {
-        raster.Y_sub_at( column, row ).intra_predict( block.prediction_mode() );
-        if ( has_nonzero_ ) block.dequantize( quantizer ).idct_add( raster.Y_sub_at( column, row ) );
+        raster.Y_sub_block( column, row ).intra_predict( block.prediction_mode() );
+        if ( has_nonzero_ ) block.idct_add( quantizer, raster.Y_sub( column, row ), raster.Y_stride );
       } );
   } else {
-    raster.Y.intra_predict( Y2_.prediction_mode() );
+    raster.Y_block().intra_predict( Y2_.prediction_mode() );
     if ( has_nonzero_ ) {
       apply_walsh( quantizer, raster );
     }
@@ -553,7 +586,7 @@ void Macroblock<FrameHeaderType, MacroblockHeaderType>::reconstruct_intra( const
 template <>
 void InterFrameMacroblock::reconstruct_inter( const Quantizer & quantizer,
                                               const References & references,
-                                              VP8Raster::Macroblock & raster ) const
+                                              const VP8Raster::MacroblockView & raster ) const
 {
   const VP8Raster & reference = references.at( header_.reference() );
 
@@ -561,41 +594,41 @@ void InterFrameMacroblock::reconstruct_inter( const Quantizer & quantizer,
     Y_.forall_ij(
       [&] ( const YBlock & block, const unsigned int column, const unsigned int row )
       {
-        raster.Y_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.Y() );
+        raster.Y_sub_block( column, row ).inter_predict( block.motion_vector(),
+                                                         reference.Y() );
       }
     );
 
     U_.forall_ij(
       [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
       {
-        raster.U_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.U() );
-        raster.V_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.V() );
+        raster.U_sub_block( column, row ).inter_predict( block.motion_vector(),
+                                                         reference.U() );
+        raster.V_sub_block( column, row ).inter_predict( block.motion_vector(),
+                                                         reference.V() );
       }
     );
 
     if ( has_nonzero_ ) {
       /* Add residue */
       Y_.forall_ij( [&] ( const YBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.Y_sub_at( column, row ) ); } );
-      U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
-      V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+                    { block.idct_add( quantizer, raster.Y_sub( column, row ), raster.Y_stride ); } );
+      add_chroma_residue( quantizer, raster );
     }
+  } else if ( base_motion_vector().empty() and not has_nonzero_ ) {
+    /* a still, residue-free macroblock is a copy of the reference
+       (the chroma motion vectors are zero too) */
+    raster.Y_block().copy_from( reference.Y() );
+    raster.U_block().copy_from( reference.U() );
+    raster.V_block().copy_from( reference.V() );
   } else {
-    raster.Y.inter_predict( base_motion_vector(), reference.Y() );
-    raster.U.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.U() );
-    raster.V.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.V() );
+    raster.Y_block().inter_predict( base_motion_vector(), reference.Y() );
+    raster.U_block().inter_predict( U_.at( 0, 0 ).motion_vector(), reference.U() );
+    raster.V_block().inter_predict( U_.at( 0, 0 ).motion_vector(), reference.V() );
 
     if ( has_nonzero_ ) {
       apply_walsh( quantizer, raster );
-      U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
-      V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+      add_chroma_residue( quantizer, raster );
     }
   }
 }
@@ -603,7 +636,7 @@ void InterFrameMacroblock::reconstruct_inter( const Quantizer & quantizer,
 template <class FrameHeaderType, class MacroblockHeaderType>
 void Macroblock<FrameHeaderType, MacroblockHeaderType>::loopfilter( const Optional< FilterAdjustments > & filter_adjustments,
                                                                     const FilterParameters & loopfilter,
-                                                                    VP8Raster::Macroblock & raster ) const
+                                                                    const VP8Raster::MacroblockView & raster ) const
 {
   const bool skip_subblock_edges = Y2_.coded() and ( not has_nonzero_ );
 
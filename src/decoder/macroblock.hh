@@ -37,6 +37,7 @@
 #include "decoder.hh"
 
 struct ProbabilityTables;
+struct TokenProbabilities;
 struct References;
 class BoolEncoder;
 class ReferenceUpdater;
@@ -74,7 +75,8 @@ private:
   void encode_prediction_modes( BoolEncoder & encoder,
                                 const ProbabilityTables & probability_tables ) const;
 
-  void apply_walsh( const Quantizer & quantizer, VP8Raster::Macroblock & raster ) const;
+  void apply_walsh( const Quantizer & quantizer, const VP8Raster::MacroblockView & raster ) const;
+  void add_chroma_residue( const Quantizer & quantizer, const VP8Raster::MacroblockView & raster ) const;
 
 public:
   Macroblock( const typename TwoD< Macroblock >::Context & c,
@@ -91,16 +93,16 @@ public:
   void update_segmentation( SegmentationMap & mutable_segmentation_map );
 
   void parse_tokens( BoolDecoder & data,
-                     const ProbabilityTables & probability_tables );
+                     const TokenProbabilities & token_probabilities );
 
-  void reconstruct_intra( const Quantizer & quantizer, VP8Raster::Macroblock & raster ) const;
+  void reconstruct_intra( const Quantizer & quantizer, const VP8Raster::MacroblockView & raster ) const;
   void reconstruct_inter( const Quantizer & quantizer,
                           const References & references,
-                          VP8Raster::Macroblock & raster ) const;
+                          const VP8Raster::MacroblockView & raster ) const;
 
   void loopfilter( const Optional< FilterAdjustments > & filter_adjustments,
                    const FilterParameters & loopfilter,
-                   VP8Raster::Macroblock & raster ) const;
+                   const VP8Raster::MacroblockView & raster ) const;
 
   const MacroblockHeaderType & header( void ) const { return header_; }
         MacroblockHeaderType & mutable_header( void ) { return header_; }
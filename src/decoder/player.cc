@@ -30,6 +30,7 @@
 #include "uncompressed_chunk.hh"
 #include "decoder_state.hh"
 
+#include <algorithm>
 #include <fstream>
 
 using namespace std;
@@ -121,6 +122,9 @@ FilePlayer::FilePlayer(const string &filename, IVF &&file, EncoderStateDeseriali
   if ( not decoder_.minihash_match( file_.expected_decoder_minihash() ) ) {
     throw Invalid( "Decoder state / IVF mismatch" );
   }
+
+  checkpoints_->put( frame_no_, decoder_, true /* pinned */ );
+  initial_checkpoint_.initialize( frame_no_ );
 }
 
 FilePlayer FilePlayer::deserialize(EncoderStateDeserializer &idata, const string &filename) {
@@ -131,10 +135,20 @@ size_t FilePlayer::serialize(EncoderStateSerializer &odata) {
   return decoder_.serialize(odata);
 }
 
+void FilePlayer::decode_next_frame( Optional<RasterHandle> & output )
+{
+  output = decode( file_.frame( frame_no_++ ) );
+
+  if ( seeking_ and frame_no_ % checkpoint_interval_ == 0 ) {
+    checkpoints_->put( frame_no_, decoder_ );
+  }
+}
+
 RasterHandle FilePlayer::advance( void )
 {
   while ( not eof() ) {
-    Optional<RasterHandle> raster = decode( file_.frame( frame_no_++ ) );
+    Optional<RasterHandle> raster;
+    decode_next_frame( raster );
     if ( raster.initialized() ) {
       return raster.get();
     }
@@ -143,6 +157,78 @@ RasterHandle FilePlayer::advance( void )
   throw Unsupported( "hidden frames at end of file" );
 }
 
+void FilePlayer::seek( const unsigned int frame_no )
+{
+  if ( frame_no > file_.frame_count() ) {
+    throw Invalid( "seek past the end of the file" );
+  }
+
+  if ( not seeking_ ) {
+    /* only the frame tags are read */
+    for ( unsigned int i = 0; i < file_.frame_count(); i++ ) {
+      if ( decoder_.decompress_frame( file_.frame( i ) ).key_frame() ) {
+        key_frames_.push_back( i );
+      }
+    }
+
+    seeking_ = true;
+  }
+
+  /* the latest place at or before frame_no to decode from */
+  Optional<unsigned int> start;
+  Optional<unsigned int> checkpoint;
+
+  if ( frame_no_ <= frame_no ) {
+    start.initialize( frame_no_ );
+  }
+
+  auto key_frame = upper_bound( key_frames_.begin(), key_frames_.end(), frame_no );
+  if ( key_frame != key_frames_.begin() ) {
+    key_frame--;
+
+    if ( not start.initialized() or *key_frame > start.get() ) {
+      start.reset( *key_frame );
+    }
+  }
+
+  for ( unsigned int candidate = frame_no - frame_no % checkpoint_interval_;
+        not start.initialized() or candidate > start.get();
+        candidate -= checkpoint_interval_ ) {
+    if ( checkpoints_->contains( candidate ) ) {
+      start.reset( candidate );
+      checkpoint.reset( candidate );
+      break;
+    }
+
+    if ( candidate < checkpoint_interval_ ) {
+      break;
+    }
+  }
+
+  if ( initial_checkpoint_.initialized() and initial_checkpoint_.get() <= frame_no
+       and ( not start.initialized() or initial_checkpoint_.get() > start.get() ) ) {
+    start.reset( initial_checkpoint_.get() );
+    checkpoint.reset( initial_checkpoint_.get() );
+  }
+
+  if ( not start.initialized() ) {
+    /* nothing before the first key frame can be decoded */
+    frame_no_ = key_frames_.empty() ? file_.frame_count() : key_frames_.front();
+    return;
+  }
+
+  if ( checkpoint.initialized() ) {
+    decoder_ = checkpoints_->get( checkpoint.get() );
+  }
+
+  frame_no_ = start.get();
+
+  Optional<RasterHandle> ignored;
+  while ( frame_no_ < frame_no ) {
+    decode_next_frame( ignored );
+  }
+}
+
 bool FilePlayer::eof( void ) const
 {
   return frame_no_ == file_.frame_count();
@@ -35,6 +35,7 @@
 
 #include "ivf.hh"
 #include "decoder.hh"
+#include "state_store.hh"
 #include "enc_state_serializer.hh"
 
 class FramePlayer
@@ -64,12 +65,14 @@ public:
   References current_references() const { return decoder_.get_references(); }
   DecoderState current_state() const { return decoder_.get_state(); }
 
-  void set_decoder( Decoder & decoder ) { decoder_ = decoder; }
+  void set_decoder( const Decoder & decoder ) { decoder_ = decoder; }
 
   size_t serialize(EncoderStateSerializer &odata);
   static FramePlayer deserialize(EncoderStateDeserializer &idata);
 
   void set_error_concealment( const bool value ) { decoder_.set_error_concealment( value ); }
+
+  void set_thread_count( const unsigned int value ) { decoder_.set_thread_count( value ); }
 };
 
 class FilePlayer : public FramePlayer
@@ -78,9 +81,22 @@ private:
   IVF file_;
   unsigned int frame_no_ { 0 };
   std::string filename_;
+
+  /* for seek(): the key frames, found on the first seek, and from then on
+     the decoder's state every checkpoint_interval_ frames, by the number of
+     the next frame to decode. a player made from a serialized state also
+     keeps that state, since there may be no key frame for a while. */
+  std::vector<unsigned int> key_frames_ {};
+  bool seeking_ { false };
+  unsigned int checkpoint_interval_ { 32 };
+  std::unique_ptr<StateStore> checkpoints_ { new StateStore( 256 << 20, StateStore::EvictionPolicy::LEAST_RECENTLY_USED ) };
+  Optional<unsigned int> initial_checkpoint_ {};
+
   FilePlayer( const std::string & filename, IVF && file );
   FilePlayer( const std::string & filename, IVF && file, EncoderStateDeserializer & idata );
 
+  void decode_next_frame( Optional<RasterHandle> & output );
+
 public:
   FilePlayer( const std::string & filename );
 
@@ -88,6 +104,15 @@ public:
   bool eof() const;
   unsigned int cur_frame_no() const { return frame_no_ - 1; }
 
+  /* makes frame_no the next frame advance() decodes, decoding from the
+     nearest of the current position, a checkpoint or a key frame. frames
+     before the first key frame can't be reached (unless the player started
+     from a serialized state); seeking there goes to the key frame. */
+  void seek( const unsigned int frame_no );
+
+  void set_checkpoint_interval( const unsigned int frames ) { checkpoint_interval_ = frames ? frames : 1; }
+  void set_checkpoint_budget( const size_t bytes ) { checkpoints_->set_budget( bytes ); }
+
   long unsigned int original_size() const;
 
   size_t serialize(EncoderStateSerializer &odata);
@@ -31,7 +31,7 @@
 
 #include "macroblock.hh"
 #include "vp8_raster.hh"
-#include "intrapred_sse.hh"
+#include "kernels.hh"
 
 using namespace std;
 
@@ -93,7 +93,8 @@ VP8Raster::Macroblock::Macroblock( const unsigned int column, const unsigned int
 
 VP8Raster::VP8Raster( const unsigned int display_width, const unsigned int display_height )
 : BaseRaster( display_width, display_height,
-              16 * macroblock_dimension( display_width ), 16 * macroblock_dimension( display_height ) )
+              16 * macroblock_dimension( display_width ), 16 * macroblock_dimension( display_height ),
+              BORDER_WIDTH )
 {}
 
 template <unsigned int size>
@@ -166,272 +167,54 @@ typename VP8Raster::Block<size>::Predictors VP8Raster::Block<size>::predictors()
   return predictors_;
 }
 
-#ifdef HAVE_SSE2
-
-template<>
-void VP8Raster::Block<4>::true_motion_predict( const Predictors & predictors,
-                                               BlockSubRange & output ) const
-{
-  vpx_tm_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                             predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<8>::true_motion_predict( const Predictors & predictors,
-                                               BlockSubRange & output ) const
-{
-  vpx_tm_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                             predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<16>::true_motion_predict( const Predictors & predictors,
-                                                BlockSubRange & output ) const
-{
-  vpx_tm_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                               predictors.above, predictors.left );
-}
-
-#else
-
 template <unsigned int size>
 void VP8Raster::Block<size>::true_motion_predict( const Predictors & predictors,
                                                   BlockSubRange & output ) const
 {
-  output.forall_ij(
-    [&] ( uint8_t & b, unsigned int column, unsigned int row )
-    {
-      b = clamp255( predictors.left[ row ]
-                  + predictors.above[ column ]
-                  - predictors.above[ -1 ] );
-    }
-  );
-}
-
-#endif
-
-#ifdef HAVE_SSE2
-
-template<>
-void VP8Raster::Block<4>::horizontal_predict( const Predictors & predictors,
-                                              BlockSubRange & output ) const
-{
-  vpx_h_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                            predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<8>::horizontal_predict( const Predictors & predictors,
-                                              BlockSubRange & output ) const
-{
-  vpx_h_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                            predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<16>::horizontal_predict( const Predictors & predictors,
-                                               BlockSubRange & output ) const
-{
-  vpx_h_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                              predictors.above, predictors.left );
+  kernels().tm_predict[ Kernels::width_index( size ) ]( &output.at( 0, 0 ), output.stride(),
+                                                         predictors.above, predictors.left );
 }
 
-#else
-
 template <unsigned int size>
 void VP8Raster::Block<size>::horizontal_predict( const Predictors & predictors,
                                                  BlockSubRange & output ) const
 {
-  for ( unsigned int row = 0; row < size; row++ ) {
-    output.row( row ).fill( predictors.left[ row ] );
-  }
-}
-
-#endif
-
-#ifdef HAVE_SSE2
-
-template<>
-void VP8Raster::Block<4>::vertical_predict( const Predictors & predictors,
-                                            BlockSubRange & output ) const
-{
-  vpx_v_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                            predictors.above, predictors.left );
+  kernels().h_predict[ Kernels::width_index( size ) ]( &output.at( 0, 0 ), output.stride(),
+                                                        predictors.above, predictors.left );
 }
 
-template<>
-void VP8Raster::Block<8>::vertical_predict( const Predictors & predictors,
-                                            BlockSubRange & output ) const
-{
-  vpx_v_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                            predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<16>::vertical_predict( const Predictors & predictors,
-                                             BlockSubRange & output ) const
-{
-  vpx_v_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                            predictors.above, predictors.left );
-}
-
-#else
-
 template <unsigned int size>
 void VP8Raster::Block<size>::vertical_predict( const Predictors & predictors,
                                                BlockSubRange & output ) const
 {
-  for ( unsigned int column = 0; column < size; column++ ) {
-    output.column( column ).fill( predictors.above[ column ] );
-  }
+  kernels().v_predict[ Kernels::width_index( size ) ]( &output.at( 0, 0 ), output.stride(),
+                                                        predictors.above, predictors.left );
 }
 
-#endif
-
-#ifdef HAVE_SSE2
-
-template<>
-void VP8Raster::Block<4>::dc_predict_simple( const Predictors & predictors,
-                                             BlockSubRange & output ) const
-{
-  vpx_dc_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                             predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<8>::dc_predict_simple( const Predictors & predictors,
-                                             BlockSubRange & output ) const
-{
-  vpx_dc_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                             predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<16>::dc_predict_simple( const Predictors & predictors,
-                                              BlockSubRange & output ) const
-{
-  vpx_dc_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                               predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<4>::dc_predict( const Predictors & predictors,
-                                      BlockSubRange & output ) const
-{
-  if ( column_ and row_ ) {
-    return dc_predict_simple( predictors, output );
-  }
-
-  if ( row_ > 0 ) {
-    return vpx_dc_top_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                                          predictors.above, predictors.left );
-  }
-
-  if ( column_ > 0 ) {
-    return vpx_dc_left_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                                           predictors.above, predictors.left );
-  }
-
-  return vpx_dc_128_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                                        predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<8>::dc_predict( const Predictors & predictors,
-                                      BlockSubRange & output ) const
-{
-  if ( column_ and row_ ) {
-    return dc_predict_simple( predictors, output );
-  }
-
-  if ( row_ > 0 ) {
-    return vpx_dc_top_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                                          predictors.above, predictors.left );
-  }
-
-  if ( column_ > 0 ) {
-    return vpx_dc_left_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                                           predictors.above, predictors.left );
-  }
-
-  return vpx_dc_128_predictor_8x8_sse2( &output.at( 0, 0 ), output.stride(),
-                                        predictors.above, predictors.left );
-}
-
-template<>
-void VP8Raster::Block<16>::dc_predict( const Predictors & predictors,
-                                       BlockSubRange & output ) const
-{
-  if ( column_ and row_ ) {
-    return dc_predict_simple( predictors, output );
-  }
-
-  if ( row_ > 0 ) {
-    return vpx_dc_top_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                                            predictors.above, predictors.left );
-  }
-
-  if ( column_ > 0 ) {
-    return vpx_dc_left_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                                             predictors.above, predictors.left );
-  }
-
-  return vpx_dc_128_predictor_16x16_sse2( &output.at( 0, 0 ), output.stride(),
-                                          predictors.above, predictors.left );
-}
-
-#else
-
 template <unsigned int size>
 void VP8Raster::Block<size>::dc_predict_simple( const Predictors & predictors,
                                                 BlockSubRange & output ) const
 {
-  static_assert( size == 4 or size == 8 or size == 16, "invalid Block size" );
-  static constexpr uint8_t log2size = size == 4 ? 2 : size == 8 ? 3 : size == 16 ? 4 : 0;
-
-  int16_t above_sum = 0;
-  int16_t left_sum = 0;
-
-  for ( size_t i = 0; i < size; i++ ) {
-    above_sum += predictors.above[ i ];
-    left_sum += predictors.left[ i ];
-  }
-
-  uint8_t value = ( above_sum + left_sum + ( 1 << log2size ) ) >> ( log2size + 1 );
-
-  output.fill( value );
+  kernels().dc_predict[ Kernels::width_index( size ) ]( &output.at( 0, 0 ), output.stride(),
+                                                         predictors.above, predictors.left );
 }
 
 template <unsigned int size>
 void VP8Raster::Block<size>::dc_predict( const Predictors & predictors,
                                          BlockSubRange & output ) const
 {
-  if ( column_ and row_ ) {
-    return dc_predict_simple( predictors, output );
-  }
+  const Kernels & k = kernels();
+  const unsigned int index = Kernels::width_index( size );
 
-  uint8_t value = 128;
-  static_assert( size == 4 or size == 8 or size == 16, "invalid Block size" );
-  static constexpr uint8_t log2size = size == 4 ? 2 : size == 8 ? 3 : size == 16 ? 4 : 0;
-
-  if ( row_ > 0 ) {
-    int16_t above_sum = 0;
-    for ( size_t i = 0; i < size; i++ ) { above_sum += predictors.above[ i ]; }
+  /* the edges that are outside the frame don't count */
+  Kernels::IntraPredictor * const predict = ( column_ and row_ ) ? k.dc_predict[ index ]
+                                          : ( row_ > 0 )         ? k.dc_top_predict[ index ]
+                                          : ( column_ > 0 )      ? k.dc_left_predict[ index ]
+                                          :                        k.dc_128_predict[ index ];
 
-    value = ( above_sum + ( 1 << ( log2size - 1 ) ) ) >> log2size;
-  }
-  else if ( column_ > 0 ) {
-    int16_t left_sum = 0;
-    for ( size_t i = 0; i < size; i++ ) { left_sum += predictors.left[ i ]; }
-
-    value = ( left_sum + ( 1 << ( log2size - 1 ) ) ) >> log2size;
-  }
-
-  output.fill( value );
+  predict( &output.at( 0, 0 ), output.stride(), predictors.above, predictors.left );
 }
 
-#endif
-
 template <>
 template <>
 void VP8Raster::Block8::intra_predict( const mbmode uv_mode,
@@ -558,67 +341,22 @@ void VP8Raster::Block4::vertical_left_predict( const Predictors & predictors,
   output.at( 3, 3 ) =                     avg3( predictors.above[ 5 ], predictors.above[ 6 ], predictors.above[ 7 ] );
 }
 
-#ifdef HAVE_SSE2
-
-template <>
-void VP8Raster::Block4::horizontal_down_predict( const Predictors & predictors,
-                                                 BlockSubRange & output ) const
-{
-  vpx_d153_predictor_4x4_ssse3( &output.at( 0, 0 ), output.stride(),
-                                predictors.above, predictors.left );
-}
-
-#else
-
 template <>
 void VP8Raster::Block4::horizontal_down_predict( const Predictors & predictors,
                                                  BlockSubRange & output ) const
 {
-  output.at( 0, 3 ) =                     avg2( predictors.east( 0 ), predictors.east( 1 ) );
-  output.at( 1, 3 ) =                     avg3( predictors.east( 0 ), predictors.east( 1 ), predictors.east( 2 ) );
-  output.at( 0, 2 ) = output.at( 2, 3 ) = avg2( predictors.east( 1 ), predictors.east( 2 ) );
-  output.at( 1, 2 ) = output.at( 3, 3 ) = avg3( predictors.east( 1 ), predictors.east( 2 ), predictors.east( 3 ) );
-  output.at( 2, 2 ) = output.at( 0, 1 ) = avg2( predictors.east( 2 ), predictors.east( 3 ) );
-  output.at( 3, 2 ) = output.at( 1, 1 ) = avg3( predictors.east( 2 ), predictors.east( 3 ), predictors.east( 4 ) );
-  output.at( 2, 1 ) = output.at( 0, 0 ) = avg2( predictors.east( 3 ), predictors.east( 4 ) );
-  output.at( 3, 1 ) = output.at( 1, 0 ) = avg3( predictors.east( 3 ), predictors.east( 4 ), predictors.east( 5 ) );
-  output.at( 2, 0 ) =                     avg3( predictors.east( 4 ), predictors.east( 5 ), predictors.east( 6 ) );
-  output.at( 3, 0 ) =                     avg3( predictors.east( 5 ), predictors.east( 6 ), predictors.east( 7 ) );
-}
-
-#endif
-
-#ifdef HAVE_SSE2
-
-template <>
-void VP8Raster::Block4::horizontal_up_predict( const Predictors & predictors,
-                                               BlockSubRange & output ) const
-{
-  vpx_d207_predictor_4x4_sse2( &output.at( 0, 0 ), output.stride(),
-                               predictors.above, predictors.left );
+  kernels().hd_predict( &output.at( 0, 0 ), output.stride(),
+                        predictors.above, predictors.left );
 }
 
-#else
-
 template <>
 void VP8Raster::Block4::horizontal_up_predict( const Predictors & predictors,
                                                BlockSubRange & output ) const
 {
-  output.at( 0, 0 ) =                     avg2( predictors.left[ 0 ], predictors.left[ 1 ] );
-  output.at( 1, 0 ) =                     avg3( predictors.left[ 0 ], predictors.left[ 1 ], predictors.left[ 2 ] );
-  output.at( 2, 0 ) = output.at( 0, 1 ) = avg2( predictors.left[ 1 ], predictors.left[ 2 ] );
-  output.at( 3, 0 ) = output.at( 1, 1 ) = avg3( predictors.left[ 1 ], predictors.left[ 2 ], predictors.left[ 3 ] );
-  output.at( 2, 1 ) = output.at( 0, 2 ) = avg2( predictors.left[ 2 ], predictors.left[ 3 ] );
-  output.at( 3, 1 ) = output.at( 1, 2 ) = avg3( predictors.left[ 2 ], predictors.left[ 3 ], predictors.left[ 3 ] );
-  output.at( 2, 2 ) = output.at( 3, 2 )
-                    = output.at( 0, 3 )
-                    = output.at( 1, 3 )
-                    = output.at( 2, 3 )
-                    = output.at( 3, 3 ) = predictors.left[ 3 ];
+  kernels().hu_predict( &output.at( 0, 0 ), output.stride(),
+                        predictors.above, predictors.left );
 }
 
-#endif
-
 template <>
 template <>
 void VP8Raster::Block4::intra_predict( const bmode b_mode,
@@ -642,332 +380,104 @@ void VP8Raster::Block4::intra_predict( const bmode b_mode,
   }
 }
 
-static constexpr SafeArray<SafeArray<int16_t, 6>, 8> sixtap_filters =
-  {{ { { 0,  0,  128,    0,   0,  0 } },
-     { { 0, -6,  123,   12,  -1,  0 } },
-     { { 2, -11, 108,   36,  -8,  1 } },
-     { { 0, -9,   93,   50,  -6,  0 } },
-     { { 3, -16,  77,   77, -16,  3 } },
-     { { 0, -6,   50,   93,  -9,  0 } },
-     { { 1, -8,   36,  108, -11,  2 } },
-     { { 0, -1,   12,  123,  -6,  0 } } }};
-
+/* with a whole-pixel motion vector, the prediction is just the reference block */
 template <unsigned int size>
-void VP8Raster::Block<size>::inter_predict( const MotionVector & mv,
-                                            const TwoD<uint8_t> & reference,
-                                            TwoDSubRange<uint8_t, size, size> & output ) const
+static void copy_block( const uint8_t * source, const unsigned int source_stride,
+                        TwoDSubRange<uint8_t, size, size> & output )
 {
-  const int source_column = column_ * size + ( mv.x() >> 3 );
-  const int source_row = row_ * size + ( mv.y() >> 3 );
-
-  if ( source_column - 2 < 0
-       or source_column + size + 3 > reference.width()
-       or source_row - 2 < 0
-       or source_row + size + 3 > reference.height() ) {
-
-    EdgeExtendedRaster safe_reference( reference );
+  const unsigned int stride = output.stride();
 
-    safe_inter_predict( mv, safe_reference, source_column, source_row, output );
-  } else {
-    unsafe_inter_predict( mv, reference, source_column, source_row, output );
+  uint8_t *dest_row_start = &output.at( 0, 0 );
+  const uint8_t *dest_last_row_start = dest_row_start + size * stride;
+  while ( dest_row_start != dest_last_row_start ) {
+    memcpy( dest_row_start, source, size );
+    dest_row_start += stride;
+    source += source_stride;
   }
 }
 
-template void VP8Raster::Block<16>::inter_predict( const MotionVector & mv,
-                                                   const TwoD<uint8_t> & reference,
-                                                   TwoDSubRange<uint8_t, 16, 16> & output ) const;
-
-#ifdef HAVE_SSE2
-
+/* sub-pixel prediction from a reference with at least two pixels to the
+   left and above and three to the right and below the block */
 template <unsigned int size>
-void VP8Raster::Block<size>::inter_predict( const MotionVector & mv,
-                                            const SafeRaster & reference,
-                                            TwoDSubRange<uint8_t, size, size> & output ) const
+static void sixtap_predict( const uint8_t * source, const unsigned int source_stride,
+                            uint8_t * output, const unsigned int output_stride,
+                            const uint8_t mx, const uint8_t my )
 {
-  const int source_column = column_ * size + ( mv.x() >> 3 );
-  const int source_row = row_ * size + ( mv.y() >> 3 );
-
-  const unsigned int dst_stride = output.stride();
-  const unsigned int src_stride = reference.stride();
-
-  const uint8_t mx = mv.x() & 7, my = mv.y() & 7;
-
-  if ( (mx & 7) == 0 and (my & 7) == 0 ) {
-    uint8_t *dest_row_start = &output.at( 0, 0 );
-    const uint8_t *src_row_start = &reference.at( source_column, source_row );
-    const uint8_t *dest_last_row_start = dest_row_start + size * dst_stride;
-    while ( dest_row_start != dest_last_row_start ) {
-      memcpy( dest_row_start, src_row_start, size );
-      dest_row_start += dst_stride;
-      src_row_start += src_stride;
-    }
-    return;
-  }
-
-  alignas(16) SafeArray< SafeArray< uint8_t, size + 8 >, size + 8 > intermediate;
-  const uint8_t *intermediate_ptr = &intermediate.at( 0 ).at( 0 );
-  const uint8_t *src_ptr = &reference.at( source_column, source_row );
-  const uint8_t *dst_ptr = &output.at( 0, 0 );
+  const unsigned int width = Kernels::width_index( size );
+  const Kernels & k = kernels();
 
   if ( mx ) {
     if ( my ) {
-      sse_horiz_inter_predict( src_ptr - 2 * src_stride, src_stride, intermediate_ptr,
-                               size, size + 5, mx );
-      sse_vert_inter_predict( intermediate_ptr, size, dst_ptr, dst_stride,
-                              size, my );
+      /* packed at a stride of `size`, with slack for the assembly kernels' wide loads */
+      alignas(16) SafeArray< SafeArray< uint8_t, size + 8 >, size + 8 > intermediate;
+      uint8_t *intermediate_ptr = &intermediate.at( 0 ).at( 0 );
+
+      k.sixtap_horizontal[ width ]( source - 2 * source_stride, source_stride,
+                                    intermediate_ptr, size, size + 5, mx );
+      k.sixtap_vertical[ width ]( intermediate_ptr, size, output, output_stride, size, my );
     }
     else {
       /* First pass only */
-      sse_horiz_inter_predict( src_ptr, src_stride, dst_ptr, dst_stride, size, mx );
+      k.sixtap_horizontal[ width ]( source, source_stride, output, output_stride, size, mx );
     }
   }
   else {
     /* Second pass only */
-    sse_vert_inter_predict( src_ptr - 2 * src_stride, src_stride, dst_ptr, dst_stride,
-                            size, my );
+    k.sixtap_vertical[ width ]( source - 2 * source_stride, source_stride,
+                                output, output_stride, size, my );
   }
 }
 
-template
-void VP8Raster::Block<16>::inter_predict( const MotionVector & mv,
-                                            const SafeRaster & reference,
-                                            TwoDSubRange<uint8_t, 16, 16> & output ) const;
-
-#endif
-
-#ifdef HAVE_SSE2
-template <>
-void VP8Raster::Block<4>::sse_horiz_inter_predict( const uint8_t * src,
-                                                   const unsigned int pixels_per_line,
-                                                   const uint8_t * dst,
-                                                   const unsigned int dst_pitch,
-                                                   const unsigned int dst_height,
-                                                   const unsigned int filter_idx )
+template <unsigned int size>
+void VP8Raster::Block<size>::copy_from( const TwoD<uint8_t> & reference )
 {
-  vp8_filter_block1d4_h6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
+  copy_block( &reference.at( column_ * size, row_ * size ), reference.stride(), contents_ );
 }
 
-template <>
-void VP8Raster::Block<8>::sse_horiz_inter_predict( const uint8_t * src,
-                                                   const unsigned int pixels_per_line,
-                                                   const uint8_t * dst,
-                                                   const unsigned int dst_pitch,
-                                                   const unsigned int dst_height,
-                                                   const unsigned int filter_idx )
+template <unsigned int size>
+void VP8Raster::Block<size>::inter_predict( const MotionVector & mv,
+                                            const TwoD<uint8_t> & reference,
+                                            TwoDSubRange<uint8_t, size, size> & output ) const
 {
-  vp8_filter_block1d8_h6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
-}
+  /* past its edges, the reference repeats its outermost pixels forever. a
+     block that starts further out than just beyond the reach of the filter
+     taps sees nothing but those repeated pixels, so moving it back there
+     gives the same prediction and keeps every read inside the border */
+  const int min_position = -int( size + 3 );
 
-template <>
-void VP8Raster::Block<16>::sse_horiz_inter_predict( const uint8_t * src,
-                                                    const unsigned int pixels_per_line,
-                                                    const uint8_t * dst,
-                                                    const unsigned int dst_pitch,
-                                                    const unsigned int dst_height,
-                                                    const unsigned int filter_idx )
-{
-  vp8_filter_block1d16_h6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
-}
+  const int source_column = min( max( int( column_ * size ) + ( mv.x() >> 3 ), min_position ),
+                                 int( reference.width() ) + 2 );
+  const int source_row = min( max( int( row_ * size ) + ( mv.y() >> 3 ), min_position ),
+                              int( reference.height() ) + 2 );
 
-template <>
-void VP8Raster::Block<4>::sse_vert_inter_predict( const uint8_t * src,
-                                                  const unsigned int pixels_per_line,
-                                                  const uint8_t * dst,
-                                                  const unsigned int dst_pitch,
-                                                  const unsigned int dst_height,
-                                                  const unsigned int filter_idx )
-{
-  vp8_filter_block1d4_v6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
+  unsafe_inter_predict( mv, reference, source_column, source_row, output );
 }
 
-template <>
-void VP8Raster::Block<8>::sse_vert_inter_predict( const uint8_t * src,
-                                                  const unsigned int pixels_per_line,
-                                                  const uint8_t * dst,
-                                                  const unsigned int dst_pitch,
-                                                  const unsigned int dst_height,
-                                                  const unsigned int filter_idx )
-{
-  vp8_filter_block1d8_v6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
-}
-
-template <>
-void VP8Raster::Block<16>::sse_vert_inter_predict( const uint8_t * src,
-                                                   const unsigned int pixels_per_line,
-                                                   const uint8_t * dst,
-                                                   const unsigned int dst_pitch,
-                                                   const unsigned int dst_height,
-                                                   const unsigned int filter_idx )
-{
-  vp8_filter_block1d16_v6_ssse3( src, pixels_per_line, dst, dst_pitch, dst_height,
-                                filter_idx );
-}
-
-#endif
+template void VP8Raster::Block<16>::inter_predict( const MotionVector & mv,
+                                                   const TwoD<uint8_t> & reference,
+                                                   TwoDSubRange<uint8_t, 16, 16> & output ) const;
 
 template <unsigned int size>
 void VP8Raster::Block<size>::unsafe_inter_predict( const MotionVector & mv, const TwoD< uint8_t > & reference,
                                                    const int source_column, const int source_row,
                                                    TwoDSubRange<uint8_t, size, size> & output ) const
 {
-  assert( output.stride() == reference.width() );
+  assert( source_column - 2 >= -int( reference.border() )
+          and source_column + int( size + 3 ) <= int( reference.width() + reference.border() )
+          and source_row - 2 >= -int( reference.border() )
+          and source_row + int( size + 3 ) <= int( reference.height() + reference.border() ) );
 
-  const unsigned int stride = output.stride();
+  const unsigned int stride = reference.stride();
+  const uint8_t * source = &reference.at( 0, 0 ) + source_row * int( stride ) + source_column;
 
   const uint8_t mx = mv.x() & 7, my = mv.y() & 7;
 
-  if ( (mx & 7) == 0 and (my & 7) == 0 ) {
-    uint8_t *dest_row_start = &output.at( 0, 0 );
-    const uint8_t *src_row_start = &reference.at( source_column, source_row );
-    const uint8_t *dest_last_row_start = dest_row_start + size * output.stride();
-    while ( dest_row_start != dest_last_row_start ) {
-      memcpy( dest_row_start, src_row_start, size );
-      dest_row_start += stride;
-      src_row_start += stride;
-    }
+  if ( mx == 0 and my == 0 ) {
+    copy_block( source, stride, output );
     return;
   }
 
-#ifdef HAVE_SSE2
-  alignas(16) SafeArray< SafeArray< uint8_t, size + 8 >, size + 8 > intermediate;
-  const uint8_t *intermediate_ptr = &intermediate.at( 0 ).at( 0 );
-  const uint8_t *src_ptr = &reference.at( source_column, source_row );
-  const uint8_t *dst_ptr = &output.at( 0, 0 );
-
-  if ( mx ) {
-    if ( my ) {
-      sse_horiz_inter_predict( src_ptr - 2 * stride, stride, intermediate_ptr,
-                               size, size + 5, mx );
-      sse_vert_inter_predict( intermediate_ptr, size, dst_ptr, stride,
-                              size, my );
-    }
-    else {
-      /* First pass only */
-      sse_horiz_inter_predict( src_ptr, stride, dst_ptr, stride, size, mx );
-    }
-  }
-  else {
-    /* Second pass only */
-    sse_vert_inter_predict( src_ptr - 2 * stride, stride, dst_ptr, stride,
-                            size, my );
-  }
-
-#else
-  SafeArray< SafeArray< uint8_t, size >, size + 5 > intermediate;
-
-  {
-    uint8_t *intermediate_row_start = &intermediate.at( 0 ).at( 0 );
-    const uint8_t *intermediate_last_row_start = intermediate_row_start + size * (size + 5);
-    const uint8_t *src_row_start = &reference.at( source_column - 2, source_row - 2 );
-
-    const auto & horizontal_filter = sixtap_filters.at( mx );
-
-    while ( intermediate_row_start != intermediate_last_row_start ) {
-      const uint8_t *intermediate_row_end = intermediate_row_start + size;
-
-      while ( intermediate_row_start != intermediate_row_end ) {
-        *( intermediate_row_start ) =
-          clamp255( ( (   *( src_row_start )     * horizontal_filter.at( 0 ) )
-                      + ( *( src_row_start + 1 ) * horizontal_filter.at( 1 ) )
-                      + ( *( src_row_start + 2 ) * horizontal_filter.at( 2 ) )
-                      + ( *( src_row_start + 3 ) * horizontal_filter.at( 3 ) )
-                      + ( *( src_row_start + 4 ) * horizontal_filter.at( 4 ) )
-                      + ( *( src_row_start + 5 ) * horizontal_filter.at( 5 ) )
-                      + 64 ) >> 7 );
-
-        intermediate_row_start++;
-        src_row_start++;
-      }
-      src_row_start += stride - size;
-    }
-  }
-
-  {
-    uint8_t *dest_row_start = &output.at( 0, 0 );
-    const uint8_t *dest_last_row_start = dest_row_start + size * stride;
-    const uint8_t *intermediate_row_start = &intermediate.at( 0 ).at( 0 );
-
-    const auto & vertical_filter = sixtap_filters.at( my );
-
-    while ( dest_row_start != dest_last_row_start ) {
-      const uint8_t *dest_row_end = dest_row_start + size;
-
-      while ( dest_row_start != dest_row_end ) {
-        *dest_row_start =
-          clamp255( ( (   *( intermediate_row_start )            * vertical_filter.at( 0 ) )
-                      + ( *( intermediate_row_start + size )     * vertical_filter.at( 1 ) )
-                      + ( *( intermediate_row_start + size * 2 ) * vertical_filter.at( 2 ) )
-                      + ( *( intermediate_row_start + size * 3 ) * vertical_filter.at( 3 ) )
-                      + ( *( intermediate_row_start + size * 4 ) * vertical_filter.at( 4 ) )
-                      + ( *( intermediate_row_start + size * 5 ) * vertical_filter.at( 5 ) )
-                      + 64 ) >> 7 );
-
-        dest_row_start++;
-        intermediate_row_start++;
-      }
-      dest_row_start += stride - size;
-    }
-  }
-#endif
-}
-
-template <unsigned int size>
-template <class ReferenceType>
-void VP8Raster::Block<size>::safe_inter_predict( const MotionVector & mv, const ReferenceType & reference,
-                                                 const int source_column, const int source_row,
-                                                 TwoDSubRange<uint8_t, size, size> & output ) const
-{
-  if ( (mv.x() & 7) == 0 and (mv.y() & 7) == 0 ) {
-    output.forall_ij(
-      [&] ( uint8_t & val, unsigned int column, unsigned int row )
-      {
-        val = reference.at( source_column + column, source_row + row );
-      }
-    );
-
-    return;
-  }
-
-  /* filter horizontally */
-  const auto & horizontal_filter = sixtap_filters.at( mv.x() & 7 );
-
-  SafeArray<SafeArray<uint8_t, size>, size + 5> intermediate;
-
-  for ( uint8_t row = 0; row < size + 5; row++ ) {
-    for ( uint8_t column = 0; column < size; column++ ) {
-      const int real_row = source_row + row - 2;
-      const int real_column = source_column + column;
-      intermediate.at( row ).at( column ) =
-        clamp255( ( ( reference.at( real_column - 2, real_row ) * horizontal_filter.at( 0 ) )
-                  + ( reference.at( real_column - 1, real_row ) * horizontal_filter.at( 1 ) )
-                  + ( reference.at( real_column,     real_row ) * horizontal_filter.at( 2 ) )
-                  + ( reference.at( real_column + 1, real_row ) * horizontal_filter.at( 3 ) )
-                  + ( reference.at( real_column + 2, real_row ) * horizontal_filter.at( 4 ) )
-                  + ( reference.at( real_column + 3, real_row ) * horizontal_filter.at( 5 ) )
-                  + 64 ) >> 7 );
-    }
-  }
-
-  /* filter vertically */
-  const auto & vertical_filter = sixtap_filters.at( mv.y() & 7 );
-
-  for ( uint8_t row = 0; row < size; row++ ) {
-    for ( uint8_t column = 0; column < size; column++ ) {
-      output.at( column, row ) =
-        clamp255( ( ( intermediate.at( row     ).at( column ) * vertical_filter.at( 0 ) )
-                  + ( intermediate.at( row + 1 ).at( column ) * vertical_filter.at( 1 ) )
-                  + ( intermediate.at( row + 2 ).at( column ) * vertical_filter.at( 2 ) )
-                  + ( intermediate.at( row + 3 ).at( column ) * vertical_filter.at( 3 ) )
-                  + ( intermediate.at( row + 4 ).at( column ) * vertical_filter.at( 4 ) )
-                  + ( intermediate.at( row + 5 ).at( column ) * vertical_filter.at( 5 ) )
-                  + 64 ) >> 7 );
-    }
-  }
+  sixtap_predict<size>( source, stride, &output.at( 0, 0 ), output.stride(), mx, my );
 }
 
 template class VP8Raster::Block<4>;
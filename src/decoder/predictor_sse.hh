@@ -8,7 +8,7 @@ extern "C" {
   (
     const uint8_t        *src_ptr,
     const unsigned int   src_pixels_per_line,
-    const uint8_t        *output_ptr,
+    uint8_t              *output_ptr,
     const unsigned int   output_pitch,
     const unsigned int   output_height,
     const unsigned int   vp8_filter_index
@@ -27,26 +27,16 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <memory>
-#include <queue>
 #include <functional>
 #include <unordered_map>
 #include <cassert>
 #include <mutex>
 
-#include "exception.hh"
+#include "free_list.hh"
 #include "raster_handle.hh"
 
 using namespace std;
 
-/* helper to dequeue front element from a queue */
-template <typename T>
-static T dequeue( queue<T> & q )
-{
-  T ret { move( q.front() ) };
-  q.pop();
-  return ret;
-}
-
 bool RasterPoolDebug::allow_resize = false;
 
 template<class RasterType>
@@ -56,34 +46,26 @@ public:
   typedef std::unique_ptr<RasterType, RasterDeleter<RasterType>> VP8RasterHolder;
 
 private:
-  queue<VP8RasterHolder> unused_rasters_ {};
+  static size_t plane_bytes( const TwoD<uint8_t> & plane )
+  {
+    return size_t( plane.stride() ) * ( plane.height() + 2 * plane.border() );
+  }
 
-  mutex mutex_ {};
+  static size_t raster_bytes( const RasterType & raster )
+  {
+    return sizeof( RasterType ) + plane_bytes( raster.Y() ) + plane_bytes( raster.U() ) + plane_bytes( raster.V() );
+  }
+
+  SizeClassPool<RasterType> unused_rasters_ { raster_bytes };
 
 public:
   VP8RasterHolder make_raster( const unsigned int display_width,
                                const unsigned int display_height )
   {
-    unique_lock<mutex> lock { mutex_ };
-
-    VP8RasterHolder ret;
+    VP8RasterHolder ret { unused_rasters_.take( display_width, display_height ) };
 
-    if ( unused_rasters_.empty() ) {
+    if ( not ret ) {
       ret.reset( new RasterType( display_width, display_height ) );
-    } else {
-      if ( (unused_rasters_.front()->display_width() != display_width )
-           or (unused_rasters_.front()->display_height() != display_height ) ) {
-        if (RasterPoolDebug::allow_resize) {
-          while (! unused_rasters_.empty()) {
-            dequeue(unused_rasters_);
-          }
-          ret.reset(new RasterType(display_width, display_height));
-        } else {
-          throw Unsupported( "raster size has changed" );
-        }
-      } else {
-        ret = dequeue( unused_rasters_ );
-      }
     }
 
     ret.get_deleter().set_raster_pool( this );
@@ -93,11 +75,13 @@ public:
 
   void free_raster( RasterType * raster )
   {
-    unique_lock<mutex> lock { mutex_ };
-
     assert( raster );
-    unused_rasters_.emplace( raster );
+    unused_rasters_.give( raster );
   }
+
+  PoolStats stats( void ) const { return unused_rasters_.stats(); }
+  void set_budget( const size_t bytes ) { unused_rasters_.set_budget( bytes ); }
+  void trim( void ) { unused_rasters_.trim(); }
 };
 
 template<class RasterType>
@@ -141,6 +125,21 @@ static RasterPool<RasterType> & global_raster_pool( void )
   return pool;
 }
 
+PoolStats raster_pool_stats( void )
+{
+  return global_raster_pool<HashCachedRaster>().stats();
+}
+
+void set_raster_pool_budget( const size_t bytes )
+{
+  global_raster_pool<HashCachedRaster>().set_budget( bytes );
+}
+
+void trim_raster_pool( void )
+{
+  global_raster_pool<HashCachedRaster>().trim();
+}
+
 template<class RasterType>
 VP8MutableRasterHandle<RasterType>::VP8MutableRasterHandle( const unsigned int display_width,
                                                             const unsigned int display_height )
@@ -199,23 +198,52 @@ size_t HashCachedRaster::hash() const
   unique_lock<mutex> lock { mutex_ };
 
   if ( not frozen_hash_.initialized() ) {
-    frozen_hash_.initialize( VP8Raster::raw_hash() );
+    /* same as raw_hash(), without rehashing the bands we already have */
+    size_t hash_val = 0;
+
+    for ( unsigned int band = 0; band < band_hashes_.size(); band++ ) {
+      const Optional<size_t> & band_hash_val = band_hashes_[ band ];
+      hash_val = combine_band_hashes( hash_val, band_hash_val.initialized()
+                                                ? band_hash_val.get()
+                                                : band_hash( band ) );
+    }
+
+    frozen_hash_.initialize( hash_val );
   }
 
   return frozen_hash_.get();
 }
 
+size_t HashCachedRaster::stable_hash() const
+{
+  unique_lock<mutex> lock { mutex_ };
+
+  if ( not frozen_stable_hash_.initialized() ) {
+    frozen_stable_hash_.initialize( VP8Raster::stable_hash() );
+  }
+
+  return frozen_stable_hash_.get();
+}
+
+void HashCachedRaster::freeze_band( const unsigned int band )
+{
+  band_hashes_.at( band ).reset( band_hash( band ) );
+}
+
 void HashCachedRaster::reset_cache()
 {
   frozen_hash_.clear();
+  frozen_stable_hash_.clear();
+
+  for ( Optional<size_t> & band_hash_val : band_hashes_ ) {
+    band_hash_val.clear();
+  }
 }
 
 bool HashCachedRaster::has_cache() const
 {
-  return frozen_hash_.initialized();
+  return frozen_hash_.initialized() or frozen_stable_hash_.initialized();
 }
 
 template class VP8MutableRasterHandle<HashCachedRaster>;
 template class VP8RasterHandle<HashCachedRaster>;
-template class VP8MutableRasterHandle<SafeRaster>;
-template class VP8RasterHandle<SafeRaster>;
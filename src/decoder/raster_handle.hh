@@ -30,18 +30,18 @@
 #define RASTER_POOL_HH
 
 #include <mutex>
+#include <vector>
 
 #include "vp8_raster.hh"
+#include "free_list.hh"
 
 template<class RasterType> class RasterPool;
 template<class RasterType> class VP8RasterHandle;
 
 class RasterPoolDebug {
   public:
-    // WARNING this will probably break everything!
-    // you should only use it if you absolutely must
-    // resize rasters while displaying and know exactly
-    // what you're doing!
+    // no longer needed: rasters of different sizes
+    // now share the pool. kept for existing callers.
     static bool allow_resize;
 };
 
@@ -49,6 +49,10 @@ class HashCachedRaster : public VP8Raster
 {
 private:
   mutable Optional<size_t> frozen_hash_ {};
+  mutable Optional<size_t> frozen_stable_hash_ {};
+
+  /* filled in by the decoder as each band is finished */
+  std::vector<Optional<size_t>> band_hashes_ { std::vector<Optional<size_t>>( hash_band_count() ) };
 
   mutable std::mutex mutex_ {};
 
@@ -58,6 +62,13 @@ public:
   size_t hash() const;
   void reset_cache();
 
+  /* BaseRaster::stable_hash(), computed once like hash() */
+  size_t stable_hash() const;
+
+  /* hash a band now, while its rows are still in cache; it must not change
+     afterwards. different bands can be hashed from different threads. */
+  void freeze_band( const unsigned int band );
+
   bool has_cache() const;
 };
 
@@ -111,6 +122,7 @@ public:
   const RasterType & get( void ) const { return *raster_; }
 
   size_t hash( void ) const;
+  size_t stable_hash( void ) const { return raster_->stable_hash(); }
 
   bool operator==( const VP8RasterHandle<RasterType> & other ) const;
   bool operator!=( const VP8RasterHandle<RasterType> & other ) const;
@@ -119,7 +131,12 @@ public:
 using MutableRasterHandle = VP8MutableRasterHandle<HashCachedRaster>;
 using RasterHandle = VP8RasterHandle<HashCachedRaster>;
 
-using MutableSafeRasterHandle = VP8MutableRasterHandle<SafeRaster>;
-using SafeRasterHandle = VP8RasterHandle<SafeRaster>;
+/* the pool behind MutableRasterHandle keeps rasters of every size it has
+   seen. unused ones beyond the budget (unlimited by default) are freed,
+   least recently used sizes first; trim frees all of them except the few
+   that other threads keep cached. */
+PoolStats raster_pool_stats( void );
+void set_raster_pool_budget( const size_t bytes );
+void trim_raster_pool( void );
 
 #endif /* RASTER_POOL_HH */
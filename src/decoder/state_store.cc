@@ -0,0 +1,267 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "state_store.hh"
+
+using namespace std;
+
+namespace {
+
+size_t object_bytes( const ProbabilityTables & )
+{
+  return sizeof( ProbabilityTables );
+}
+
+size_t object_bytes( const Segmentation & segmentation )
+{
+  return sizeof( Segmentation ) + segmentation.map.width() * segmentation.map.height();
+}
+
+size_t plane_bytes( const TwoD<uint8_t> & plane )
+{
+  return size_t( plane.stride() ) * ( plane.height() + 2 * plane.border() );
+}
+
+size_t object_bytes( const RasterHandle & handle )
+{
+  const VP8Raster & raster = handle;
+  return sizeof( HashCachedRaster ) + plane_bytes( raster.Y() )
+    + plane_bytes( raster.U() ) + plane_bytes( raster.V() );
+}
+
+}
+
+template <class T>
+shared_ptr<const T> StateStore::Interned<T>::intern( const T & value, const size_t hash,
+                                                     size_t & bytes, uint64_t & shared )
+{
+  const auto range = objects_.equal_range( hash );
+
+  for ( auto it = range.first; it != range.second; it++ ) {
+    if ( *it->second == value ) {
+      shared++;
+      return it->second;
+    }
+  }
+
+  shared_ptr<const T> object = make_shared<const T>( value );
+  objects_.emplace( hash, object );
+  bytes += object_bytes( value );
+
+  return object;
+}
+
+/* the table's own reference is the last one once no snapshot uses the object */
+template <class T>
+void StateStore::Interned<T>::release( shared_ptr<const T> & object, const size_t hash,
+                                       size_t & bytes )
+{
+  if ( not object ) {
+    return;
+  }
+
+  const auto range = objects_.equal_range( hash );
+
+  for ( auto it = range.first; it != range.second; it++ ) {
+    if ( it->second == object ) {
+      object.reset();
+
+      if ( it->second.use_count() == 1 ) {
+        bytes -= object_bytes( *it->second );
+        objects_.erase( it );
+      }
+
+      return;
+    }
+  }
+
+  throw LogicError();
+}
+
+StateStore::StateStore( const size_t budget, const EvictionPolicy policy )
+  : budget_( budget ), policy_( policy )
+{}
+
+void StateStore::put( const uint32_t name, const Decoder & decoder, const bool pinned )
+{
+  if ( contains( name ) ) {
+    return;
+  }
+
+  const DecoderState state = decoder.get_state();
+  const References references = decoder.get_references();
+
+  Snapshot snapshot;
+
+  snapshot.width = state.width;
+  snapshot.height = state.height;
+
+  snapshot.probability_tables_hash = state.probability_tables.hash();
+  snapshot.probability_tables = probability_tables_.intern( state.probability_tables,
+                                                            snapshot.probability_tables_hash,
+                                                            stats_.bytes, stats_.shared );
+
+  snapshot.segmentation_hash = 0;
+  if ( state.segmentation.initialized() ) {
+    snapshot.segmentation_hash = state.segmentation.get().hash();
+    snapshot.segmentation = segmentations_.intern( state.segmentation.get(),
+                                                   snapshot.segmentation_hash,
+                                                   stats_.bytes, stats_.shared );
+  }
+
+  snapshot.filter_adjustments = state.filter_adjustments;
+
+  const RasterHandle * handles[] = { &references.last, &references.golden, &references.alternative };
+  for ( unsigned int i = 0; i < 3; i++ ) {
+    snapshot.references.at( i ) = rasters_.intern( *handles[ i ], handles[ i ]->hash(),
+                                                   stats_.bytes, stats_.shared );
+  }
+
+  snapshot.state_id = decoder.state_id();
+  snapshot.error_concealment = decoder.error_concealment();
+  snapshot.thread_count = decoder.thread_count();
+
+  snapshot.pinned = pinned;
+  snapshot.position = order_.insert( order_.end(), name );
+
+  states_.emplace( name, move( snapshot ) );
+
+  evict( name );
+}
+
+Decoder StateStore::get( const uint32_t name )
+{
+  const auto found = states_.find( name );
+
+  if ( found == states_.end() ) {
+    stats_.misses++;
+    throw Invalid( "no stored decoder state with this name" );
+  }
+
+  stats_.hits++;
+
+  Snapshot & snapshot = found->second;
+
+  if ( policy_ == EvictionPolicy::LEAST_RECENTLY_USED ) {
+    order_.splice( order_.end(), order_, snapshot.position );
+  }
+
+  Optional<Segmentation> segmentation;
+  if ( snapshot.segmentation ) {
+    segmentation.initialize( *snapshot.segmentation );
+  }
+
+  Decoder decoder( DecoderState( snapshot.width, snapshot.height,
+                                 ProbabilityTables( *snapshot.probability_tables ),
+                                 move( segmentation ),
+                                 Optional<FilterAdjustments>( snapshot.filter_adjustments ) ),
+                   References( *snapshot.references.at( 0 ), *snapshot.references.at( 1 ),
+                               *snapshot.references.at( 2 ) ),
+                   snapshot.state_id );
+
+  decoder.set_error_concealment( snapshot.error_concealment );
+  decoder.set_thread_count( snapshot.thread_count );
+
+  return decoder;
+}
+
+void StateStore::release( Snapshot & snapshot )
+{
+  probability_tables_.release( snapshot.probability_tables, snapshot.probability_tables_hash,
+                               stats_.bytes );
+  segmentations_.release( snapshot.segmentation, snapshot.segmentation_hash, stats_.bytes );
+
+  for ( unsigned int i = 0; i < 3; i++ ) {
+    shared_ptr<const RasterHandle> & reference = snapshot.references.at( i );
+    rasters_.release( reference, reference->hash(), stats_.bytes );
+  }
+
+  order_.erase( snapshot.position );
+}
+
+void StateStore::erase( const uint32_t name )
+{
+  const auto found = states_.find( name );
+
+  if ( found == states_.end() ) {
+    return;
+  }
+
+  release( found->second );
+  states_.erase( found );
+}
+
+void StateStore::set_pinned( const uint32_t name, const bool pinned )
+{
+  const auto found = states_.find( name );
+
+  if ( found != states_.end() ) {
+    found->second.pinned = pinned;
+  }
+}
+
+bool StateStore::pinned( const uint32_t name ) const
+{
+  const auto found = states_.find( name );
+  return found != states_.end() and found->second.pinned;
+}
+
+void StateStore::evict( const uint32_t newest )
+{
+  auto it = order_.begin();
+
+  while ( stats_.bytes > budget_ and it != order_.end() ) {
+    const uint32_t name = *it;
+    it++;
+
+    const Snapshot & snapshot = states_.at( name );
+
+    if ( snapshot.pinned or name == newest ) {
+      continue;
+    }
+
+    erase( name );
+    stats_.evictions++;
+  }
+}
+
+void StateStore::set_budget( const size_t bytes )
+{
+  budget_ = bytes;
+
+  if ( not order_.empty() ) {
+    evict( order_.back() );
+  }
+}
+
+StateStore::Stats StateStore::stats( void ) const
+{
+  Stats ret = stats_;
+  ret.states = states_.size();
+  return ret;
+}
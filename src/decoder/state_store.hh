@@ -0,0 +1,149 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef STATE_STORE_HH
+#define STATE_STORE_HH
+
+#include <list>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#include "decoder.hh"
+
+/* decoder states kept by name, such as the ones salsify's sender and
+   receiver keep for every state the other side might be in. the stored
+   states are immutable and share what they have in common: probability
+   tables and segmentation maps with equal contents are kept once, and so
+   are reference rasters with equal hashes. get() hands out a Decoder with
+   its own copy of the tables, so nothing stored is ever written to.
+
+   once the states take more than the budget (unlimited by default), the
+   unpinned ones are evicted in the order of the policy, until they fit or
+   only the newest is left. not thread-safe. */
+class StateStore
+{
+public:
+  enum class EvictionPolicy { OLDEST_FIRST, LEAST_RECENTLY_USED };
+
+  struct Stats
+  {
+    size_t states, bytes;
+    uint64_t hits, misses, evictions;
+
+    /* tables, maps and rasters that were already stored for another state */
+    uint64_t shared;
+  };
+
+private:
+  /* objects shared between snapshots, found by hash */
+  template <class T>
+  class Interned
+  {
+  private:
+    std::unordered_multimap<size_t, std::shared_ptr<const T>> objects_ {};
+
+  public:
+    std::shared_ptr<const T> intern( const T & value, const size_t hash,
+                                     size_t & bytes, uint64_t & shared );
+    void release( std::shared_ptr<const T> & object, const size_t hash, size_t & bytes );
+  };
+
+  struct Snapshot
+  {
+    uint16_t width {}, height {};
+
+    std::shared_ptr<const ProbabilityTables> probability_tables {};
+    size_t probability_tables_hash {};
+
+    std::shared_ptr<const Segmentation> segmentation {}; /* null if not present */
+    size_t segmentation_hash {};
+
+    Optional<FilterAdjustments> filter_adjustments {};
+
+    /* last, golden, alternative */
+    SafeArray<std::shared_ptr<const RasterHandle>, 3> references {};
+
+    size_t state_id {};
+    bool error_concealment {};
+    unsigned int thread_count {};
+
+    bool pinned {};
+    std::list<uint32_t>::iterator position {};
+  };
+
+  size_t budget_;
+  EvictionPolicy policy_;
+
+  std::unordered_map<uint32_t, Snapshot> states_ {};
+
+  /* front is evicted first */
+  std::list<uint32_t> order_ {};
+
+  Interned<ProbabilityTables> probability_tables_ {};
+  Interned<Segmentation> segmentations_ {};
+  Interned<RasterHandle> rasters_ {};
+
+  Stats stats_ {};
+
+  void release( Snapshot & snapshot );
+  void evict( const uint32_t newest );
+
+public:
+  StateStore( const size_t budget = std::numeric_limits<size_t>::max(),
+              const EvictionPolicy policy = EvictionPolicy::OLDEST_FIRST );
+
+  StateStore( const StateStore & other ) = delete;
+  StateStore & operator=( const StateStore & other ) = delete;
+
+  /* a state already stored under `name` is kept as it is. pinned states
+     are never evicted. */
+  void put( const uint32_t name, const Decoder & decoder, const bool pinned = false );
+
+  bool contains( const uint32_t name ) const { return states_.count( name ) > 0; }
+
+  /* throws if there is no such state */
+  Decoder get( const uint32_t name );
+
+  void erase( const uint32_t name );
+
+  /* does nothing if there is no such state. an unpinned state can be
+     evicted by the next put() or set_budget(). */
+  void set_pinned( const uint32_t name, const bool pinned );
+  bool pinned( const uint32_t name ) const;
+
+  size_t size( void ) const { return states_.size(); }
+  size_t bytes( void ) const { return stats_.bytes; }
+
+  size_t budget( void ) const { return budget_; }
+  void set_budget( const size_t bytes );
+
+  Stats stats( void ) const;
+};
+
+#endif /* STATE_STORE_HH */
@@ -44,26 +44,41 @@ uint16_t TokenDecoder<length>::decode( BoolDecoder & data ) const
   return base_value_ + increment;
 }
 
+TokenProbabilities::TokenProbabilities( const ProbabilityTables & tables )
+  : probabilities()
+{
+  for ( unsigned int type = 0; type < BLOCK_TYPES; type++ ) {
+    for ( unsigned int index = 0; index < 16; index++ ) {
+      for ( unsigned int context = 0; context < PREV_COEF_CONTEXTS; context++ ) {
+        const auto & band_probs = tables.coeff_probs.at( type ).at( coefficient_to_band.at( index ) ).at( context );
+        memcpy( &probabilities.at( type ).at( index ).at( context ).at( 0 ),
+                &band_probs.at( 0 ), ENTROPY_NODES );
+      }
+    }
+  }
+}
+
 /* The unfolded token decoder is not pretty, but it is considerably faster
    than using a tree decoder */
 
 template < BlockType initial_block_type, class PredictionMode >
 void Block< initial_block_type,
             PredictionMode >::parse_tokens( BoolDecoder & data,
-                                            const ProbabilityTables & probability_tables )
+                                            const TokenProbabilities & token_probabilities )
 {
   bool last_was_zero = false;
 
   /* prediction context starts with number-not-zero count */
-  char token_context = ( context().above.initialized() ? context().above.get()->has_nonzero() : 0 )
-    + ( context().left.initialized() ? context().left.get()->has_nonzero() : 0 );
+  char token_context = ( context().above().initialized() ? context().above().get()->has_nonzero() : 0 )
+    + ( context().left().initialized() ? context().left().get()->has_nonzero() : 0 );
+
+  const TokenProbabilities::Positions & positions = token_probabilities.probabilities.at( type_ );
 
   for ( unsigned int index = (type_ == BlockType::Y_after_Y2) ? 1 : 0;
         index < 16;
         index++ ) {
-    /* select the tree probabilities based on the prediction context */
-    const ProbabilityArray< MAX_ENTROPY_TOKENS > & prob
-      = probability_tables.coeff_probs.at( type_ ).at( coefficient_to_band.at( index ) ).at( token_context );
+    /* select the tree probabilities based on the position and prediction context */
+    const TokenProbabilities::Nodes & prob = positions.at( index ).at( token_context );
 
     /* decode the token */
     if ( not last_was_zero ) {
@@ -131,5 +146,6 @@ void Block< initial_block_type,
 
     /* assign to block storage */
     coefficients_.at( zigzag.at( index ) ) = value;
+    eob_ = index + 1;
   }
 }
@@ -28,9 +28,9 @@
 
 #include "macroblock.hh"
 #include "block.hh"
+#include "tokens.hh"
 #include "safe_array.hh"
-#include "transform_sse.hh"
-#include "dct_sse.hh"
+#include "kernels.hh"
 
 template <>
 void YBlock::set_dc_coefficient( const int16_t & val )
@@ -46,96 +46,62 @@ void DCTCoefficients::set_dc_coefficient( const int16_t & val )
 
 void DCTCoefficients::iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output ) const
 {
-#ifdef HAVE_SSE2
-
-  vp8_short_inv_walsh4x4_sse2( &at( 0 ), &output.at( 0 ).at( 0 ).at( 0 ) );
-
-#else
-
-  SafeArray< int16_t, 16 > intermediate;
-
-  for ( size_t i = 0; i < 4; i++ ) {
-    int a1 = coefficients_.at( i + 0 ) + coefficients_.at( i + 12 );
-    int b1 = coefficients_.at( i + 4 ) + coefficients_.at( i + 8  );
-    int c1 = coefficients_.at( i + 4 ) - coefficients_.at( i + 8  );
-    int d1 = coefficients_.at( i + 0 ) - coefficients_.at( i + 12 );
-
-    intermediate.at( i + 0  ) = a1 + b1;
-    intermediate.at( i + 4  ) = c1 + d1;
-    intermediate.at( i + 8  ) = a1 - b1;
-    intermediate.at( i + 12 ) = d1 - c1;
-  }
-
-  for ( size_t i = 0; i < 4; i++ ) {
-    const uint8_t offset = i * 4;
-    int a1 = intermediate.at( offset + 0 ) + intermediate.at( offset + 3 );
-    int b1 = intermediate.at( offset + 1 ) + intermediate.at( offset + 2 );
-    int c1 = intermediate.at( offset + 1 ) - intermediate.at( offset + 2 );
-    int d1 = intermediate.at( offset + 0 ) - intermediate.at( offset + 3 );
-
-    int a2 = a1 + b1;
-    int b2 = c1 + d1;
-    int c2 = a1 - b1;
-    int d2 = d1 - c1;
-
-    output.at( i ).at( 0 ).at( 0 ) = ( a2 + 3 ) >> 3;
-    output.at( i ).at( 1 ).at( 0 ) = ( b2 + 3 ) >> 3;
-    output.at( i ).at( 2 ).at( 0 ) = ( c2 + 3 ) >> 3;
-    output.at( i ).at( 3 ).at( 0 ) = ( d2 + 3 ) >> 3;
-  }
-
-#endif
+  kernels().iwht( &at( 0 ), &output.at( 0 ).at( 0 ).at( 0 ) );
 }
 
-#ifdef HAVE_SSE2
-
 void DCTCoefficients::idct_add( VP8Raster::Block4 & output ) const
 {
+  idct_add( &output.at( 0, 0 ), output.stride() );
+}
 
-  vp8_short_idct4x4llm_mmx( &coefficients_.at( 0 ), &output.at( 0, 0 ), output.stride(), &output.at( 0, 0 ), output.stride() );
+void DCTCoefficients::idct_add( uint8_t * output, const unsigned int stride ) const
+{
+  kernels().idct_add( &coefficients_.at( 0 ), output, stride );
 }
 
-#else
+void DCTCoefficients::idct_add_x4( const SafeArray<DCTCoefficients, 4> & blocks,
+                                   uint8_t * leftmost_output, const unsigned int stride )
+{
+  static_assert( sizeof( DCTCoefficients ) == 16 * sizeof( int16_t ),
+                 "the batched IDCT needs the four blocks' coefficients to be contiguous" );
 
-static inline int MUL_20091( const int a ) { return ((((a)*20091) >> 16) + (a)); }
-static inline int MUL_35468( const int a ) { return (((a)*35468) >> 16); }
+  kernels().idct_add_x4( &blocks.at( 0 ).coefficients_.at( 0 ), leftmost_output, stride );
+}
 
-void DCTCoefficients::idct_add( VP8Raster::Block4 & output ) const
+template <BlockType initial_block_type, class PredictionMode>
+void Block< initial_block_type, PredictionMode >::calculate_has_nonzero()
 {
-  SafeArray< int16_t, 16 > intermediate;
+  eob_ = 16;
+  while ( eob_ > 0 and coefficients_.at( zigzag.at( eob_ - 1 ) ) == 0 ) {
+    eob_--;
+  }
 
-  /* Based on libav/ffmpeg vp8_idct_add_c */
+  has_nonzero_ = eob_ > 0;
+}
 
-  for ( int i = 0; i < 4; i++ ) {
-    int t0 = coefficients_.at( i + 0 ) + coefficients_.at( i + 8 );
-    int t1 = coefficients_.at( i + 0 ) - coefficients_.at( i + 8 );
-    int t2 = MUL_35468( coefficients_.at( i + 4 ) ) - MUL_20091( coefficients_.at( i + 12 ) );
-    int t3 = MUL_20091( coefficients_.at( i + 4 ) ) + MUL_35468( coefficients_.at( i + 12 ) );
+/* most blocks at real-time quantizers are empty or DC-only, and a DC-only
+   block adds the same value, (DC + 4) >> 3, to all sixteen pixels */
+template <BlockType initial_block_type, class PredictionMode>
+void Block< initial_block_type, PredictionMode >::idct_add( const Quantizer & quantizer,
+                                                           uint8_t * output,
+                                                           const unsigned int stride ) const
+{
+  static_assert( initial_block_type != Y2, "Y2 blocks are inverse-transformed with iwht()" );
+  assert( type_ != Y_after_Y2 );
 
-    intermediate.at( i * 4 + 0 ) = t0 + t3;
-    intermediate.at( i * 4 + 1 ) = t1 + t2;
-    intermediate.at( i * 4 + 2 ) = t1 - t2;
-    intermediate.at( i * 4 + 3 ) = t0 - t3;
+  if ( eob_ == 0 ) {
+    return;
   }
 
-  for ( int i = 0; i < 4; i++ ) {
-    int t0 = intermediate.at( i + 0 ) + intermediate.at( i + 8 );
-    int t1 = intermediate.at( i + 0 ) - intermediate.at( i + 8 );
-    int t2 = MUL_35468( intermediate.at( i + 4 ) ) - MUL_20091( intermediate.at( i + 12 ) );
-    int t3 = MUL_20091( intermediate.at( i + 4 ) ) + MUL_35468( intermediate.at( i + 12 ) );
-
-    uint8_t *target = &output.at( 0, i );
-
-    *target = clamp255( *target + ((t0 + t3 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t1 + t2 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t1 - t2 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t0 - t3 + 4) >> 3) );
+  const DCTCoefficients dequantized = dequantize( quantizer );
+
+  if ( eob_ == 1 ) {
+    kernels().idct_dc_add( dequantized.at( 0 ), output, stride );
+  }
+  else {
+    dequantized.idct_add( output, stride );
   }
 }
-#endif
 
 template <BlockType initial_block_type, class PredictionMode>
 void Block< initial_block_type, PredictionMode >::add_residue( VP8Raster::Block4 & output ) const
@@ -145,3 +111,10 @@ void Block< initial_block_type, PredictionMode >::add_residue( VP8Raster::Block4
                                           + coefficients_.at( zigzag.at( i ) ) );
   }
 }
+
+template void Y2Block::calculate_has_nonzero();
+template void YBlock::calculate_has_nonzero();
+template void UVBlock::calculate_has_nonzero();
+
+template void YBlock::idct_add( const Quantizer &, uint8_t *, const unsigned int ) const;
+template void UVBlock::idct_add( const Quantizer &, uint8_t *, const unsigned int ) const;
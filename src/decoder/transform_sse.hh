@@ -6,6 +6,8 @@
 extern "C" {
   void vp8_short_idct4x4llm_mmx( const short *input, unsigned char *pred,
                                  int pitch, unsigned char *dest,int stride );
+  void vp8_dc_only_idct_add_mmx( short input_dc, unsigned char *pred,
+                                 int pred_stride, unsigned char *dest, int stride );
 }
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef VARIANCE_SSE_HH
+#define VARIANCE_SSE_HH
+
+#include <cstdint>
+
+/* from variance_sse2.cc; `sum` may be null */
+void vpx_get4x4var_sse2( const uint8_t *src, int src_stride,
+                         const uint8_t *ref, int ref_stride,
+                         unsigned int *sse, int *sum );
+void vpx_get8x8var_sse2( const uint8_t *src, int src_stride,
+                         const uint8_t *ref, int ref_stride,
+                         unsigned int *sse, int *sum );
+void vpx_get16x16var_sse2( const uint8_t *src, int src_stride,
+                           const uint8_t *ref, int ref_stride,
+                           unsigned int *sse, int *sum );
+
+unsigned int vpx_variance4x4_sse2( const unsigned char *src, int src_stride,
+                                   const unsigned char *ref, int ref_stride,
+                                   unsigned int *sse );
+unsigned int vpx_variance8x8_sse2( const unsigned char *src, int src_stride,
+                                   const unsigned char *ref, int ref_stride,
+                                   unsigned int *sse );
+unsigned int vpx_variance16x16_sse2( const unsigned char *src, int src_stride,
+                                     const unsigned char *ref, int ref_stride,
+                                     unsigned int *sse );
+
+#endif /* VARIANCE_SSE_HH */
@@ -11,6 +11,8 @@
 #include <emmintrin.h>  // SSE2
 #include <stdint.h>
 
+#include "variance_sse.hh"
+
 //#include "vpx_ports/mem.h"
 
 typedef void (*getNxMvar_fn_t)(const unsigned char *src, int src_stride,
@@ -37,9 +39,9 @@ unsigned int vpx_get_mb_ss_sse2(const int16_t *src) {
       _mm_cvtsi32_si128(*(const uint32_t *)(p + i * stride)), \
       _mm_cvtsi32_si128(*(const uint32_t *)(p + (i + 1) * stride)))
 
-static void get4x4var_sse2(const uint8_t *src, int src_stride,
-                           const uint8_t *ref, int ref_stride,
-                           unsigned int *sse, int *sum) {
+void vpx_get4x4var_sse2(const uint8_t *src, int src_stride,
+                        const uint8_t *ref, int ref_stride,
+                        unsigned int *sse, int *sum) {
   const __m128i zero = _mm_setzero_si128();
   const __m128i src0 = _mm_unpacklo_epi8(READ64(src, src_stride, 0), zero);
   const __m128i src1 = _mm_unpacklo_epi8(READ64(src, src_stride, 2), zero);
@@ -173,7 +175,7 @@ unsigned int vpx_variance4x4_sse2(const unsigned char *src, int src_stride,
                                   const unsigned char *ref, int ref_stride,
                                   unsigned int *sse) {
   int sum;
-  get4x4var_sse2(src, src_stride, ref, ref_stride, sse, &sum);
+  vpx_get4x4var_sse2(src, src_stride, ref, ref_stride, sse, &sum);
   return *sse - ((sum * sum) >> 4);
 }
 
@@ -182,7 +184,7 @@ unsigned int vpx_variance8x4_sse2(const uint8_t *src, int src_stride,
                                   unsigned int *sse) {
   int sum;
   variance_sse2(src, src_stride, ref, ref_stride, 8, 4, sse, &sum,
-                get4x4var_sse2, 4);
+                vpx_get4x4var_sse2, 4);
   return *sse - ((sum * sum) >> 5);
 }
 
@@ -191,7 +193,7 @@ unsigned int vpx_variance4x8_sse2(const uint8_t *src, int src_stride,
                                   unsigned int *sse) {
   int sum;
   variance_sse2(src, src_stride, ref, ref_stride, 4, 8, sse, &sum,
-                get4x4var_sse2, 4);
+                vpx_get4x4var_sse2, 4);
   return *sse - ((sum * sum) >> 5);
 }
 
@@ -34,10 +34,6 @@
 #include "config.h"
 #include "raster.hh"
 
-#ifdef HAVE_SSE2
-#include "predictor_sse.hh"
-#endif
-
 class MotionVector;
 
 template <class integer>
@@ -48,8 +44,6 @@ static inline uint8_t clamp255( const integer value )
   return value;
 }
 
-class SafeRaster;
-
 class VP8Raster : public BaseRaster
 {
 public:
@@ -133,31 +127,16 @@ public:
                         const TwoD<uint8_t> & reference,
                         TwoD<uint8_t> & output ) const;
 
-    void inter_predict( const MotionVector & mv,
-                        const SafeRaster & reference,
-                        TwoDSubRange<uint8_t, size, size> & output ) const;
-
-    template <class ReferenceType>
-    void safe_inter_predict( const MotionVector & mv,
-                             const ReferenceType & reference,
-                             const int source_column, const int source_row,
-                             TwoDSubRange<uint8_t, size, size> & output ) const;
+    /* same as inter prediction with a zero motion vector */
+    void copy_from( const TwoD<uint8_t> & reference );
 
+    /* the source position must be no further than the sixtap filter's
+       reach inside the reference's border */
     void unsafe_inter_predict( const MotionVector & mv,
                                const TwoD<uint8_t> & reference,
                                const int source_column, const int source_row,
                                TwoDSubRange<uint8_t, size, size> & output ) const;
 
-#ifdef HAVE_SSE2
-    static void sse_horiz_inter_predict( const uint8_t * src, const unsigned int pixels_per_line,
-                                         const uint8_t * dst, const unsigned int dst_pitch,
-                                         const unsigned int dst_height, const unsigned int filter_idx );
-
-    static void sse_vert_inter_predict( const uint8_t * src, const unsigned int pixels_per_line,
-                                        const uint8_t * dst, const unsigned int dst_pitch,
-                                        const unsigned int dst_height, const unsigned int filter_idx );
-#endif
-
     static constexpr unsigned int dimension { size };
 
     SafeArray<SafeArray<int16_t, size>, size> operator-( const Block & other ) const;
@@ -179,6 +158,95 @@ public:
   using Block8  = Block<8>;
   using Block16 = Block<16>;
 
+  /* just the position of a macroblock and where its pixels are, cheap enough
+     to make for every macroblock on every pass. Blocks are built on demand. */
+  struct MacroblockView
+  {
+    VP8Raster * raster;
+    unsigned int column, row;
+
+    /* top-left pixel of the macroblock in each plane */
+    uint8_t * Y, * U, * V;
+    unsigned int Y_stride, UV_stride;
+
+    uint8_t * Y_sub( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return Y + 4 * ( sub_row * Y_stride + sub_column );
+    }
+
+    uint8_t * U_sub( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return U + 4 * ( sub_row * UV_stride + sub_column );
+    }
+
+    uint8_t * V_sub( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return V + 4 * ( sub_row * UV_stride + sub_column );
+    }
+
+    Block16 Y_block() const { return { column, row, raster->Y() }; }
+    Block8 U_block() const { return { column, row, raster->U() }; }
+    Block8 V_block() const { return { column, row, raster->V() }; }
+
+    Block4 Y_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return { 4 * column + sub_column, 4 * row + sub_row, raster->Y() };
+    }
+
+    Block4 U_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return { 2 * column + sub_column, 2 * row + sub_row, raster->U() };
+    }
+
+    Block4 V_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return { 2 * column + sub_column, 2 * row + sub_row, raster->V() };
+    }
+
+    template <class lambda>
+    void Y_sub_forall_ij( const lambda & f ) const
+    {
+      for ( unsigned int sub_row = 0; sub_row < 4; sub_row++ ) {
+        for ( unsigned int sub_column = 0; sub_column < 4; sub_column++ ) {
+          Block4 block = Y_sub_block( sub_column, sub_row );
+          f( block, sub_column, sub_row );
+        }
+      }
+    }
+  };
+
+  /* a view of a macroblock of a const raster, for the encoder's original frame */
+  struct ConstMacroblockView
+  {
+  private:
+    MacroblockView view_;
+
+  public:
+    ConstMacroblockView( const MacroblockView & view ) : view_( view ) {}
+
+    unsigned int column() const { return view_.column; }
+    unsigned int row() const { return view_.row; }
+
+    const Block16 Y_block() const { return view_.Y_block(); }
+    const Block8 U_block() const { return view_.U_block(); }
+    const Block8 V_block() const { return view_.V_block(); }
+
+    const Block4 Y_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return view_.Y_sub_block( sub_column, sub_row );
+    }
+
+    const Block4 U_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return view_.U_sub_block( sub_column, sub_row );
+    }
+
+    const Block4 V_sub_block( const unsigned int sub_column, const unsigned int sub_row ) const
+    {
+      return view_.V_sub_block( sub_column, sub_row );
+    }
+  };
+
   struct Macroblock
   {
     Block16 Y;
@@ -280,6 +348,11 @@ public:
   };
 
 public:
+  /* every plane keeps this many replicated edge pixels on each side, so
+     inter prediction can read past the edges of a reference without
+     checking. extend_borders() must be called once the frame is final. */
+  static const unsigned int BORDER_WIDTH = 32;
+
   VP8Raster( const unsigned int display_width, const unsigned int display_height );
 
   Macroblock macroblock( const unsigned int column, const unsigned int row )
@@ -292,6 +365,18 @@ public:
     return { column, row, *this };
   }
 
+  MacroblockView macroblock_view( const unsigned int column, const unsigned int row )
+  {
+    return { this, column, row,
+             &Y_.at( 16 * column, 16 * row ), &U_.at( 8 * column, 8 * row ), &V_.at( 8 * column, 8 * row ),
+             Y_.stride(), U_.stride() };
+  }
+
+  ConstMacroblockView macroblock_view( const unsigned int column, const unsigned int row ) const
+  {
+    return const_cast<VP8Raster *>( this )->macroblock_view( column, row );
+  }
+
   static unsigned int macroblock_dimension( const unsigned int num ) { return ( num + 15 ) / 16; }
 
   template <class lambda>
@@ -299,7 +384,7 @@ public:
   {
     for ( unsigned int row = 0; row < height_ / 16; row++ ) {
       for ( unsigned int column = 0; column < width_ / 16; column++ ) {
-        f( macroblock( column, row ), column, row );
+        f( macroblock_view( column, row ), column, row );
       }
     }
   }
@@ -309,59 +394,10 @@ public:
   {
     for ( unsigned int row = 0; row < height_ / 16; row++ ) {
       for ( unsigned int column = 0; column < width_ / 16; column++ ) {
-        f( macroblock( column, row ), column, row );
+        f( macroblock_view( column, row ), column, row );
       }
     }
   }
 };
 
-class EdgeExtendedRaster
-{
-private:
-  const TwoD<uint8_t> & master_;
-
-public:
-  EdgeExtendedRaster( const TwoD<uint8_t> & master )
-    : master_( master ) {}
-
-  uint8_t at( const int column, const int row ) const
-  {
-    int bounded_column = column;
-    if ( bounded_column < 0 ) bounded_column = 0;
-    if ( bounded_column > int(master_.width() - 1) ) bounded_column = master_.width() - 1;
-
-    int bounded_row = row;
-    if ( bounded_row < 0 ) bounded_row = 0;
-    if ( bounded_row > int(master_.height() - 1) ) bounded_row = master_.height() - 1;
-
-    return master_.at( bounded_column, bounded_row );
-  }
-};
-
-class SafeRaster
-{
-private:
-  TwoD<uint8_t> safe_Y_;
-  
-  uint16_t display_width_;
-  uint16_t display_height_;
-
-public:
-  static const size_t MARGIN_WIDTH = 256;
-
-  SafeRaster( uint16_t width, uint16_t height );
-  SafeRaster( const VP8Raster & source );
-
-  uint16_t display_width() const { return display_width_; }
-  uint16_t display_height() const { return display_height_; }
-
-  /* Copies the Y plane of the given raster to the target buffer and automatically
-     does the edge extension. */
-  void copy_raster( const VP8Raster & source );
-
-  const uint8_t & at( int row, int column ) const;
-
-  unsigned int stride() const;
-};
-
 #endif //
@@ -201,7 +201,7 @@ void Texture::load( const TwoD< uint8_t > & raster )
   }*/
 
   glBindTexture( GL_TEXTURE_RECTANGLE, num_ );
-  glPixelStorei( GL_UNPACK_ROW_LENGTH, width_ );
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, raster.stride() );
   glTexSubImage2D( GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, width_, height_,
                    GL_LUMINANCE, GL_UNSIGNED_BYTE, &( raster.at( 0, 0 ) ) );
 }
@@ -33,34 +33,20 @@
 
 #include "bool_decoder.hh"
 
-/* libvpx lookup table to avoid the need for a loop in
- * BoolEncoder::put. Taken from libvpx/vp8/common/entropy.c
- */
-const uint8_t vp8_norm[ 256 ] = {
-    0, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
-    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
-
 /* Routines taken from RFC 6386 */
 
 class BoolEncoder
 {
+public:
+  /* in COUNT_ONLY mode, nothing is written out: the encoder only keeps track
+     of how many bytes it would have produced */
+  enum Mode { EMIT, COUNT_ONLY };
+
 private:
+  Mode mode_;
+
   std::vector< uint8_t > output_ {};
+  size_t size_ { 0 };
 
   uint32_t range_ { 255 }, bottom_ { 0 };
   char bit_count_ { -24 };
@@ -102,10 +88,9 @@ private:
   }
 
 public:
-  BoolEncoder() 
-  {
-    output_.reserve( 1024 * 1024 ); //allocate a lot of space so we never have to realloc
-  }
+  explicit BoolEncoder( const Mode mode = EMIT )
+    : mode_( mode )
+  {}
 
   void put( const bool value, const Probability probability = 128 )
   {
@@ -127,11 +112,16 @@ public:
     if ( bit_count_ >= 0 ) {
       int offset = shift - bit_count_;
 
-      if ( ( bottom_ << (offset - 1)) & 0x80000000 ) {
-        add_one_to_output();
+      /* a carry never changes the number of bytes */
+      if ( mode_ == EMIT ) {
+        if ( ( bottom_ << (offset - 1)) & 0x80000000 ) {
+          add_one_to_output();
+        }
+
+        output_.push_back( bottom_ >> ( 24 - offset ) );
       }
 
-      output_.push_back( bottom_ >> ( 24 - offset ) );
+      size_++;
 
       bottom_ <<= offset;
       shift = bit_count_;
@@ -146,7 +136,16 @@ public:
   {
     flush();
     std::vector< uint8_t > ret( move( output_ ) );
-    *this = BoolEncoder();
+    *this = BoolEncoder( mode_ );
+    return ret;
+  }
+
+  /* the size of what finish() would have returned */
+  size_t finish_size( void )
+  {
+    flush();
+    const size_t ret = size_;
+    *this = BoolEncoder( mode_ );
     return ret;
   }
 };
@@ -208,12 +208,15 @@ void Costs::fill_mode_costs()
 }
 
 /*
- * Fill the mode costs for macroblocks predicted with motion vectors
- * (NEARESTMV to SPLITMV).
+ * The inter-frame mode costs, with the modes predicted with motion vectors
+ * (NEARESTMV to SPLITMV) priced under one macroblock's mode contexts. This
+ * returns a copy so that macroblocks can be costed concurrently.
  */
-void Costs::fill_mv_ref_costs( const ProbabilityArray<num_mv_refs> & mv_mode_probs )
+SafeArray<uint16_t, num_y_modes + num_mv_refs> Costs::inter_mbmode_costs( const ProbabilityArray<num_mv_refs> & mv_mode_probs ) const
 {
-  compute_cost( mbmode_costs.at( 1 ), mv_mode_probs, mv_ref_tree );
+  SafeArray<uint16_t, num_y_modes + num_mv_refs> costs = mbmode_costs.at( 1 );
+  compute_cost( costs, mv_mode_probs, mv_ref_tree );
+  return costs;
 }
 
 /*
@@ -21,7 +21,7 @@ private:
                                      const SafeArray<Probability, MV_PROB_CNT> & probs );
 
   template<unsigned int array_size, unsigned int prob_nodes, unsigned int token_count>
-  void compute_cost( SafeArray<uint16_t, array_size> & costs_nodes,
+  static void compute_cost( SafeArray<uint16_t, array_size> & costs_nodes,
                      const SafeArray<Probability, prob_nodes> & probabilities,
                      const SafeArray<TreeNode, token_count> & tree,
                      size_t tree_index = 0, uint16_t current_cost = 0 );
@@ -54,7 +54,7 @@ public:
   void fill_token_costs( const ProbabilityTables & probability_tables );
 
   void fill_mode_costs();
-  void fill_mv_ref_costs( const ProbabilityArray< num_mv_refs > & mv_ref_probs );
+  SafeArray<uint16_t, num_y_modes + num_mv_refs> inter_mbmode_costs( const ProbabilityArray< num_mv_refs > & mv_ref_probs ) const;
   void fill_mv_component_costs( const SafeArray<SafeArray<Probability, MV_PROB_CNT>, 2> & motion_vector_probs );
   void fill_mv_sad_costs();
 
@@ -85,8 +85,8 @@ uint32_t Costs::block_cost( const Block & block ) const
   }
 
   uint32_t cost = 0;
-  uint8_t token_context = ( block.context().above.initialized() ? block.context().above.get()->has_nonzero() : 0 )
-    + ( block.context().left.initialized() ? block.context().left.get()->has_nonzero() : 0 );
+  uint8_t token_context = ( block.context().above().initialized() ? block.context().above().get()->has_nonzero() : 0 )
+    + ( block.context().left().initialized() ? block.context().left().get()->has_nonzero() : 0 );
 
   size_t i = ( block.type() == BlockType::Y_after_Y2 ) ? 1 : 0;
   for ( ; i < coded_length; i++ ) {
@@ -29,6 +29,7 @@
 #include <limits>
 
 #include "encoder.hh"
+#include "parallel.hh"
 #include "scorer.hh"
 
 using namespace std;
@@ -169,11 +170,16 @@ void Encoder::update_decoder_state( const InterFrame & frame )
   }
 }
 
-Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & original_mb,
-                                                 VP8Raster::Macroblock & temp_mb,
+template<>
+InterFrameHandle & Encoder::frame_handle<InterFrame>()
+{
+  return inter_frame_;
+}
+
+Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::ConstMacroblockView & original_mb,
+                                                 const VP8Raster::MacroblockView & temp_mb,
                                                  InterFrameMacroblock & frame_mb,
                                                  const VP8Raster & reference,
-                                                 const SafeRaster & safe_reference,
                                                  MotionVector base_mv,
                                                  MotionVector origin,
                                                  size_t step_size,
@@ -181,10 +187,10 @@ Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & o
 {
   size_t first_step = step_size / 2;
 
-  auto reference_mb = reference.macroblock( original_mb.Y.column(),
-                                            original_mb.Y.row() );
+  const VP8Raster::Block16 original_Y = original_mb.Y_block();
+  VP8Raster::Block16 temp_Y = temp_mb.Y_block();
 
-  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_mb.Y.mutable_contents();
+  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_Y.mutable_contents();
 
   base_mv = Scorer::clamp( base_mv, frame_mb.context() );
 
@@ -207,8 +213,8 @@ Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & o
 
       MotionVector this_mv( Scorer::clamp( pred.mv + base_mv, frame_mb.context() ) );
 
-      reference_mb.Y().inter_predict( this_mv, safe_reference, prediction );
-      pred.distortion = sad( original_mb.Y, prediction );
+      original_Y.inter_predict( this_mv, reference.Y(), prediction );
+      pred.distortion = sad( original_Y, prediction );
       pred.rate = costs_.sad_motion_vector_cost( pred.mv, MotionVector(), sad_per_bit16lut[ y_ac_qi ] );
       pred.cost = rdcost( pred.rate, pred.distortion, 1, 1 );
 
@@ -228,9 +234,73 @@ Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & o
   return { origin, first_step };
 }
 
-void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
-                                     VP8Raster::Macroblock & reconstructed_mb,
-                                     VP8Raster::Macroblock & temp_mb,
+MotionVector Encoder::motion_search( const VP8Raster::ConstMacroblockView & original_mb,
+                                    const VP8Raster::MacroblockView & temp_mb,
+                                    InterFrameMacroblock & frame_mb,
+                                    const VP8Raster & reference,
+                                    const MotionVector & base_mv,
+                                    const size_t y_ac_qi ) const
+{
+  MotionVector mv;
+
+  for ( int step = 512; step > 1; ) {
+    MVSearchResult result = diamond_search( original_mb, temp_mb, frame_mb,
+                                            reference, base_mv, mv, step, y_ac_qi );
+
+    if ( result.mv == mv ) {
+      break; // there's no need to continue the search
+    }
+
+    mv = result.mv;
+    step = result.first_step;
+  }
+
+  return mv + base_mv;
+}
+
+vector<MotionVector> Encoder::find_motion_vectors( const VP8Raster & raster,
+                                                   const size_t y_ac_qi )
+{
+  InterFrame & frame = inter_frame_;
+  const VP8Raster & reference = references_.at( LAST_FRAME );
+  const unsigned int mb_width = frame.macroblocks().width();
+  const unsigned int mb_height = frame.macroblocks().height();
+
+  costs_.fill_mv_sad_costs();
+
+  vector<MotionVector> motion_vectors( mb_width * mb_height );
+
+  /* unlike the mode decisions, the searches don't depend on each other */
+  const unsigned int worker_count = min( thread_count_, mb_height );
+
+  run_workers( worker_count,
+    [&] ( const unsigned int worker )
+    {
+      for ( unsigned int mb_row = worker; mb_row < mb_height; mb_row += worker_count ) {
+        for ( unsigned int mb_column = 0; mb_column < mb_width; mb_column++ ) {
+          if ( encode_quality_ == REALTIME_QUALITY and
+               not ( mb_column % 4 == 0 and mb_row % 4 == 0 ) ) {
+            continue;
+          }
+
+          const auto original_mb = raster.macroblock_view( mb_column, mb_row );
+          const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
+
+          motion_vectors.at( mb_row * mb_width + mb_column ) =
+            motion_search( original_mb, temp_mb,
+                           frame.mutable_macroblocks().at( mb_column, mb_row ),
+                           reference, MotionVector(), y_ac_qi );
+        }
+      }
+    }
+  );
+
+  return motion_vectors;
+}
+
+void Encoder::luma_mb_inter_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                     const VP8Raster::MacroblockView & reconstructed_mb,
+                                     const VP8Raster::MacroblockView & temp_mb,
                                      InterFrameMacroblock & frame_mb,
                                      const Quantizer & quantizer,
                                      MVComponentCounts & /* component_counts */,
@@ -249,12 +319,11 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
 
   MotionVector best_mv;
   const VP8Raster & reference = references_.at( frame_ref );
-  const SafeRaster & safe_reference = safe_references_.get( frame_ref );
 
-  const auto reference_mb = reference.macroblock( original_mb.Y.column(),
-                                                  original_mb.Y.row() );
+  const VP8Raster::Block16 original_Y = original_mb.Y_block();
+  VP8Raster::Block16 temp_Y = temp_mb.Y_block();
 
-  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_mb.Y.mutable_contents();
+  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_Y.mutable_contents();
 
   const Scorer census = frame_mb.motion_vector_census();
   const MotionVector best_ref = Scorer::clamp( census.best(), frame_mb.context() );
@@ -264,7 +333,7 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
                                                           mv_counts_to_probs.at( counts.at( 2 ) ).at( 2 ),
                                                           mv_counts_to_probs.at( counts.at( 3 ) ).at( 3 ) }};
 
-  costs_.fill_mv_ref_costs( mv_ref_probs );
+  const auto mode_costs = costs_.inter_mbmode_costs( mv_ref_probs );
 
   constexpr array<mbmode, 4> inter_modes = { ZEROMV, NEARESTMV, NEARMV, NEWMV, /* SPLIMV */ };
 
@@ -275,30 +344,28 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
 
     switch ( prediction_mode ) {
     case NEWMV:
-      /* In the case of REALTIME_QUALITY, we should limit the number of times
-       * that we search for a new motion vector.
-       */
-      if ( encode_quality_ == REALTIME_QUALITY ) {
-        if ( not ( frame_mb.context().column % 4 == 0 and frame_mb.context().row % 4 == 0 ) ) {
+      if ( not shared_motion_vectors_.empty() ) {
+        mv = shared_motion_vectors_.at( frame_mb.context().row * frame_mb.context().width()
+                                        + frame_mb.context().column );
+
+        /* NEWMV is coded relative to best_ref */
+        if ( out_of_bounds( mv - best_ref ) ) {
           continue;
         }
       }
-
-      for ( int step = 512; step > 1; ) {
-        MVSearchResult result = diamond_search( original_mb, temp_mb, frame_mb,
-                                                reference, safe_reference,
-                                                best_ref, mv, step, y_ac_qi );
-
-        if ( result.mv == mv ) {
-          break; // there's no need to continue the search
+      else {
+        /* In the case of REALTIME_QUALITY, we should limit the number of times
+         * that we search for a new motion vector.
+         */
+        if ( encode_quality_ == REALTIME_QUALITY ) {
+          if ( not ( frame_mb.context().column % 4 == 0 and frame_mb.context().row % 4 == 0 ) ) {
+            continue;
+          }
         }
 
-        mv = result.mv;
-        step = result.first_step;
+        mv = motion_search( original_mb, temp_mb, frame_mb, reference, best_ref, y_ac_qi );
       }
 
-      mv += best_ref;
-
       if ( mv.empty() ) {
         continue;
       }
@@ -325,10 +392,10 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
       throw runtime_error( "not supported" );
     }
 
-    reference_mb.macroblock().Y.inter_predict( mv, safe_reference, prediction );
+    original_Y.inter_predict( mv, reference.Y(), prediction );
 
-    pred.distortion = variance( original_mb.Y, prediction );
-    pred.rate = costs_.mbmode_costs.at( 1 ).at( prediction_mode );
+    pred.distortion = variance( original_Y, prediction );
+    pred.rate = mode_costs.at( prediction_mode );
 
     if ( prediction_mode == NEWMV ) {
       pred.rate += costs_.motion_vector_cost( mv - best_ref, 96 );
@@ -346,7 +413,7 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
     if ( pred.cost < best_pred.cost ) {
       best_mv = mv;
       best_pred = pred;
-      reconstructed_mb.Y.mutable_contents().copy_from( prediction );
+      reconstructed_mb.Y_block().mutable_contents().copy_from( prediction );
     }
   }
 
@@ -372,8 +439,8 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
  * Please refer to luma_mb_apply_intra_prediction for some information
  * about this method.
  */
-void Encoder::luma_mb_apply_inter_prediction( const VP8Raster::Macroblock & original_mb,
-                                              VP8Raster::Macroblock & reconstructed_mb,
+void Encoder::luma_mb_apply_inter_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                              const VP8Raster::MacroblockView & reconstructed_mb,
                                               InterFrameMacroblock & frame_mb,
                                               const Quantizer & quantizer,
                                               const mbmode best_pred,
@@ -386,10 +453,10 @@ void Encoder::luma_mb_apply_inter_prediction( const VP8Raster::Macroblock & orig
     frame_mb.Y().forall_ij(
       [&] ( YBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
       {
-        auto & original_sb = original_mb.Y_sub_at( sb_column, sb_row );
+        const VP8Raster::Block4 original_sb = original_mb.Y_sub_block( sb_column, sb_row );
 
         frame_sb.mutable_coefficients().subtract_dct( original_sb,
-          reconstructed_mb.Y_sub_at( sb_column, sb_row ).contents() );
+          reconstructed_mb.Y_sub_block( sb_column, sb_row ).contents() );
 
         frame_sb.set_Y_without_Y2();
         frame_sb.mutable_coefficients() = YBlock::quantize( quantizer, frame_sb.coefficients() );
@@ -413,10 +480,10 @@ void Encoder::luma_mb_apply_inter_prediction( const VP8Raster::Macroblock & orig
     frame_mb.Y().forall_ij(
       [&] ( YBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
       {
-        auto & original_sb = original_mb.Y_sub_at( sb_column, sb_row );
+        const VP8Raster::Block4 original_sb = original_mb.Y_sub_block( sb_column, sb_row );
 
         frame_sb.mutable_coefficients().subtract_dct( original_sb,
-          reconstructed_mb.Y_sub_at( sb_column, sb_row ).contents() );
+          reconstructed_mb.Y_sub_block( sb_column, sb_row ).contents() );
 
         walsh_input.at( sb_column + 4 * sb_row ) = frame_sb.coefficients().at( 0 );
         frame_sb.set_dc_coefficient( 0 );
@@ -434,9 +501,9 @@ void Encoder::luma_mb_apply_inter_prediction( const VP8Raster::Macroblock & orig
   }
 }
 
-void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
-                                       VP8Raster::Macroblock & reconstructed_mb,
-                                       VP8Raster::Macroblock & /* temp_mb */,
+void Encoder::chroma_mb_inter_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                       const VP8Raster::MacroblockView & reconstructed_mb,
+                                       const VP8Raster::MacroblockView & /* temp_mb */,
                                        InterFrameMacroblock & frame_mb,
                                        const Quantizer & quantizer,
                                        const EncoderPass ) const
@@ -445,9 +512,6 @@ void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb
 
   const VP8Raster & reference = references_.at( frame_mb.header().reference() );
 
-  auto reference_mb = reference.macroblock( original_mb.Y.column(),
-                                            original_mb.Y.row() );
-
   frame_mb.U().forall_ij(
     [&]( UVBlock & block, const unsigned int column, const unsigned int row )
     {
@@ -463,27 +527,33 @@ void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb
     frame_mb.U().forall_ij(
       [&] ( UVBlock & block, const unsigned int column, const unsigned int row )
       {
-        reference_mb.U_sub_at( column, row ).inter_predict( block.motion_vector(), reference.U(),
-                                                            reconstructed_mb.U_sub_at( column, row ).mutable_contents() );
-        reference_mb.V_sub_at( column, row ).inter_predict( block.motion_vector(), reference.V(),
-                                                            reconstructed_mb.V_sub_at( column, row ).mutable_contents() );
+        VP8Raster::Block4 reconstructed_U_sb = reconstructed_mb.U_sub_block( column, row );
+        VP8Raster::Block4 reconstructed_V_sb = reconstructed_mb.V_sub_block( column, row );
+
+        original_mb.U_sub_block( column, row ).inter_predict( block.motion_vector(), reference.U(),
+                                                              reconstructed_U_sb.mutable_contents() );
+        original_mb.V_sub_block( column, row ).inter_predict( block.motion_vector(), reference.V(),
+                                                              reconstructed_V_sb.mutable_contents() );
       }
     );
   }
   else {
-    reference_mb.U().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
-                                  reference.U(), reconstructed_mb.U.mutable_contents() );
-    reference_mb.V().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
-                                  reference.V(), reconstructed_mb.V.mutable_contents() );
+    VP8Raster::Block8 reconstructed_U = reconstructed_mb.U_block();
+    VP8Raster::Block8 reconstructed_V = reconstructed_mb.V_block();
+
+    original_mb.U_block().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
+                                         reference.U(), reconstructed_U.mutable_contents() );
+    original_mb.V_block().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
+                                         reference.V(), reconstructed_V.mutable_contents() );
   }
 
   frame_mb.U().forall_ij(
     [&] ( UVBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
     {
-      auto & original_sb = original_mb.U_sub_at( sb_column, sb_row );
+      const VP8Raster::Block4 original_sb = original_mb.U_sub_block( sb_column, sb_row );
 
       frame_sb.mutable_coefficients().subtract_dct( original_sb,
-        reconstructed_mb.U_sub_at( sb_column, sb_row ).contents() );
+        reconstructed_mb.U_sub_block( sb_column, sb_row ).contents() );
 
       frame_sb.mutable_coefficients() = UVBlock::quantize( quantizer, frame_sb.coefficients() );
       frame_sb.calculate_has_nonzero();
@@ -493,10 +563,10 @@ void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb
   frame_mb.V().forall_ij(
     [&] ( UVBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
     {
-      auto & original_sb = original_mb.V_sub_at( sb_column, sb_row );
+      const VP8Raster::Block4 original_sb = original_mb.V_sub_block( sb_column, sb_row );
 
       frame_sb.mutable_coefficients().subtract_dct( original_sb,
-        reconstructed_mb.V_sub_at( sb_column, sb_row ).contents() );
+        reconstructed_mb.V_sub_block( sb_column, sb_row ).contents() );
 
       frame_sb.mutable_coefficients() = UVBlock::quantize( quantizer, frame_sb.coefficients() );
       frame_sb.calculate_has_nonzero();
@@ -587,6 +657,7 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
   frame.mutable_header().quant_indices = quant_indices;
   frame.mutable_header().refresh_entropy_probs = true;
   frame.mutable_header().refresh_last = true;
+  frame.mutable_header().log2_number_of_dct_partitions = dct_partitions_log2();
 
   Quantizer quantizer( frame.header().quant_indices );
   MutableRasterHandle reconstructed_raster_handle { width(), height() };
@@ -601,24 +672,27 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
   costs_.fill_mv_component_costs( decoder_state_.probability_tables.motion_vector_probs );
   costs_.fill_mv_sad_costs();
 
-  raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+  vector<TokenBranchCounts> worker_token_branch_counts( thread_count_ );
+
+  run_wavefront( thread_count_, frame.macroblocks().width(), frame.macroblocks().height(),
+    [&] ( unsigned int mb_column, unsigned int mb_row, unsigned int worker )
     {
-      auto reconstructed_mb = reconstructed_raster_handle.get().macroblock( mb_column, mb_row );
-      auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+      const auto original_mb = raster.macroblock_view( mb_column, mb_row );
+      const auto reconstructed_mb = reconstructed_raster_handle.get().macroblock_view( mb_column, mb_row );
+      const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
       auto & frame_mb = frame.mutable_macroblocks().at( mb_column, mb_row );
 
       // Process Y and Y2
-      luma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb, frame_mb,
+      luma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb, frame_mb,
                              quantizer, component_counts,
                              frame.header().quant_indices.y_ac_qi, FIRST_PASS );
 
       if ( frame_mb.inter_coded() ) {
-        chroma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
       else {
-        chroma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
 
@@ -631,10 +705,14 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
       }
 
-      frame_mb.accumulate_token_branches( token_branch_counts );
+      frame_mb.accumulate_token_branches( worker_token_branch_counts.at( worker ) );
     }
   );
 
+  for ( const TokenBranchCounts & counts : worker_token_branch_counts ) {
+    add_token_branch_counts( token_branch_counts, counts );
+  }
+
   frame.relink_y2_blocks();
 
   optimize_prob_skip( frame );
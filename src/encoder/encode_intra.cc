@@ -30,6 +30,7 @@
 #include <typeinfo>
 
 #include "encoder.hh"
+#include "parallel.hh"
 
 using namespace std;
 
@@ -45,6 +46,12 @@ void Encoder::update_decoder_state( const KeyFrame & frame )
   }
 }
 
+template<>
+KeyFrameHandle & Encoder::frame_handle<KeyFrame>()
+{
+  return key_frame_;
+}
+
 void Encoder::luma_sb_apply_intra_prediction( const VP8Raster::Block4 & original_sb,
                                               VP8Raster::Block4 & reconstructed_sb,
                                               YBlock & frame_sb,
@@ -67,7 +74,7 @@ void Encoder::luma_sb_apply_intra_prediction( const VP8Raster::Block4 & original
   frame_sb.calculate_has_nonzero();
 
   reconstructed_sb.intra_predict( sb_prediction_mode );
-  frame_sb.dequantize( quantizer ).idct_add( reconstructed_sb );
+  frame_sb.idct_add( quantizer, &reconstructed_sb.at( 0, 0 ), reconstructed_sb.stride() );
 }
 
 /*
@@ -80,9 +87,9 @@ void Encoder::luma_sb_apply_intra_prediction( const VP8Raster::Block4 & original
  * `frame_mb`.
  */
 template<class MacroblockType>
-Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
-                                                                 VP8Raster::Macroblock & reconstructed_mb,
-                                                                 VP8Raster::Macroblock & temp_mb,
+Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster::ConstMacroblockView & original_mb,
+                                                                 const VP8Raster::MacroblockView & reconstructed_mb,
+                                                                 const VP8Raster::MacroblockView & temp_mb,
                                                                  MacroblockType & frame_mb,
                                                                  const Quantizer & quantizer,
                                                                  const EncoderPass encoder_pass,
@@ -90,8 +97,12 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
 {
   MBPredictionData best_pred;
 
-  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_mb.Y.mutable_contents();
-  auto predictors = reconstructed_mb.Y.predictors();
+  const VP8Raster::Block16 original_Y = original_mb.Y_block();
+  VP8Raster::Block16 reconstructed_Y = reconstructed_mb.Y_block();
+  VP8Raster::Block16 temp_Y = temp_mb.Y_block();
+
+  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_Y.mutable_contents();
+  auto predictors = reconstructed_Y.predictors();
 
   unsigned int total_modes = B_PRED;
 
@@ -116,14 +127,14 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
       reconstructed_mb.Y_sub_forall_ij(
         [&] ( VP8Raster::Block4 & reconstructed_sb, unsigned int sb_column, unsigned int sb_row )
         {
-          auto & original_sb = original_mb.Y_sub_at( sb_column, sb_row );
-          auto & temp_sb = temp_mb.Y_sub_at( sb_column, sb_row );
+          const VP8Raster::Block4 original_sb = original_mb.Y_sub_block( sb_column, sb_row );
+          VP8Raster::Block4 temp_sb = temp_mb.Y_sub_block( sb_column, sb_row );
           auto & frame_sb = frame_mb.Y().at( sb_column, sb_row );
 
-          const auto above_mode = frame_sb.context().above.initialized()
-            ? frame_sb.context().above.get()->prediction_mode() : B_DC_PRED;
-          const auto left_mode = frame_sb.context().left.initialized()
-            ? frame_sb.context().left.get()->prediction_mode() : B_DC_PRED;
+          const auto above_mode = frame_sb.context().above().initialized()
+            ? frame_sb.context().above().get()->prediction_mode() : B_DC_PRED;
+          const auto left_mode = frame_sb.context().left().initialized()
+            ? frame_sb.context().left().get()->prediction_mode() : B_DC_PRED;
 
           bmode sb_prediction_mode = luma_sb_intra_predict( original_sb,
             reconstructed_sb, temp_sb, costs_.bmode_costs.at( above_mode ).at( left_mode ) );
@@ -140,11 +151,11 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
                           RATE_MULTIPLIER, DISTORTION_MULTIPLIER );
     }
     else {
-      reconstructed_mb.Y.intra_predict( ( mbmode )prediction_mode, predictors, prediction );
+      reconstructed_Y.intra_predict( ( mbmode )prediction_mode, predictors, prediction );
 
       /* Here we compute variance, instead of SSE, because in this case
        * the average will be taken out from Y2 block into the Y2 block. */
-      pred.distortion = variance( original_mb.Y, prediction );
+      pred.distortion = variance( original_Y, prediction );
 
       pred.rate = costs_.mbmode_costs.at( interframe ? 1 : 0 ).at( prediction_mode );
       pred.cost = rdcost( pred.rate, pred.distortion, RATE_MULTIPLIER,
@@ -152,7 +163,7 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
     }
 
     if ( pred.cost < best_pred.cost ) {
-      reconstructed_mb.Y.mutable_contents().copy_from( prediction );
+      reconstructed_Y.mutable_contents().copy_from( prediction );
       best_pred = pred;
     }
   }
@@ -166,9 +177,9 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
  * corresponding coefficients in `frame_mb`.
  */
 template<class MacroblockType>
-void Encoder::luma_mb_apply_intra_prediction( const VP8Raster::Macroblock & original_mb,
-                                              VP8Raster::Macroblock & reconstructed_mb,
-                                              __attribute__((unused)) VP8Raster::Macroblock & temp_mb,
+void Encoder::luma_mb_apply_intra_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                              const VP8Raster::MacroblockView & reconstructed_mb,
+                                              __attribute__((unused)) const VP8Raster::MacroblockView & temp_mb,
                                               MacroblockType & frame_mb,
                                               const Quantizer & quantizer,
                                               const mbmode min_prediction_mode,
@@ -186,11 +197,11 @@ void Encoder::luma_mb_apply_intra_prediction( const VP8Raster::Macroblock & orig
   frame_mb.Y().forall_ij(
     [&] ( YBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
     {
-      auto & original_sb = original_mb.Y_sub_at( sb_column, sb_row );
+      const VP8Raster::Block4 original_sb = original_mb.Y_sub_block( sb_column, sb_row );
       frame_sb.set_prediction_mode( KeyFrameMacroblock::implied_subblock_mode( min_prediction_mode ) );
 
       frame_sb.mutable_coefficients().subtract_dct( original_sb,
-        reconstructed_mb.Y_sub_at( sb_column, sb_row ).contents() );
+        reconstructed_mb.Y_sub_block( sb_column, sb_row ).contents() );
 
       walsh_input.at( sb_column + 4 * sb_row ) = frame_sb.coefficients().at( 0 );
       frame_sb.set_dc_coefficient( 0 );
@@ -222,9 +233,9 @@ void Encoder::luma_mb_apply_intra_prediction( const VP8Raster::Macroblock & orig
 }
 
 template <class MacroblockType>
-void Encoder::luma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
-                                     VP8Raster::Macroblock & reconstructed_mb,
-                                     VP8Raster::Macroblock & temp_mb,
+void Encoder::luma_mb_intra_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                     const VP8Raster::MacroblockView & reconstructed_mb,
+                                     const VP8Raster::MacroblockView & temp_mb,
                                      MacroblockType & frame_mb,
                                      const Quantizer & quantizer,
                                      const EncoderPass encoder_pass ) const
@@ -245,36 +256,43 @@ void Encoder::luma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
 /*
  * Please take a look at comments for `luma_mb_best_prediction_mode`.
  */
-Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
-                                                                   VP8Raster::Macroblock & reconstructed_mb,
-                                                                   VP8Raster::Macroblock & temp_mb,
+Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Raster::ConstMacroblockView & original_mb,
+                                                                   const VP8Raster::MacroblockView & reconstructed_mb,
+                                                                   const VP8Raster::MacroblockView & temp_mb,
                                                                    const bool interframe ) const
 {
   MBPredictionData best_pred;
 
-  TwoDSubRange<uint8_t, 8, 8> & u_prediction = temp_mb.U.mutable_contents();
-  TwoDSubRange<uint8_t, 8, 8> & v_prediction = temp_mb.V.mutable_contents();
+  const VP8Raster::Block8 original_U = original_mb.U_block();
+  const VP8Raster::Block8 original_V = original_mb.V_block();
+  VP8Raster::Block8 reconstructed_U = reconstructed_mb.U_block();
+  VP8Raster::Block8 reconstructed_V = reconstructed_mb.V_block();
+  VP8Raster::Block8 temp_U = temp_mb.U_block();
+  VP8Raster::Block8 temp_V = temp_mb.V_block();
 
-  auto u_predictors = reconstructed_mb.U.predictors();
-  auto v_predictors = reconstructed_mb.V.predictors();
+  TwoDSubRange<uint8_t, 8, 8> & u_prediction = temp_U.mutable_contents();
+  TwoDSubRange<uint8_t, 8, 8> & v_prediction = temp_V.mutable_contents();
+
+  auto u_predictors = reconstructed_U.predictors();
+  auto v_predictors = reconstructed_V.predictors();
 
   for ( unsigned int prediction_mode = 0; prediction_mode < num_uv_modes; prediction_mode++ ) {
     MBPredictionData pred;
     pred.prediction_mode = ( mbmode )prediction_mode;
 
-    reconstructed_mb.U.intra_predict( ( mbmode )prediction_mode, u_predictors, u_prediction );
-    reconstructed_mb.V.intra_predict( ( mbmode )prediction_mode, v_predictors, v_prediction );
+    reconstructed_U.intra_predict( ( mbmode )prediction_mode, u_predictors, u_prediction );
+    reconstructed_V.intra_predict( ( mbmode )prediction_mode, v_predictors, v_prediction );
 
-    pred.distortion = sse( original_mb.U, u_prediction )
-                    + sse( original_mb.V, v_prediction );
+    pred.distortion = sse( original_U, u_prediction )
+                    + sse( original_V, v_prediction );
 
     pred.rate = costs_.intra_uv_mode_costs.at( interframe ).at( prediction_mode );
     pred.cost = rdcost( pred.rate, pred.distortion, RATE_MULTIPLIER,
                         DISTORTION_MULTIPLIER );
 
     if ( pred.distortion < best_pred.distortion ) {
-      reconstructed_mb.U.mutable_contents().copy_from( u_prediction );
-      reconstructed_mb.V.mutable_contents().copy_from( v_prediction );
+      reconstructed_U.mutable_contents().copy_from( u_prediction );
+      reconstructed_V.mutable_contents().copy_from( v_prediction );
 
       best_pred = pred;
     }
@@ -284,9 +302,9 @@ Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Rast
 }
 
 template<class MacroblockType>
-void Encoder::chroma_mb_apply_intra_prediction( const VP8Raster::Macroblock & original_mb,
-                                                VP8Raster::Macroblock & reconstructed_mb,
-                                                __attribute__((unused)) VP8Raster::Macroblock & temp_mb,
+void Encoder::chroma_mb_apply_intra_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                                const VP8Raster::MacroblockView & reconstructed_mb,
+                                                __attribute__((unused)) const VP8Raster::MacroblockView & temp_mb,
                                                 MacroblockType & frame_mb,
                                                 const Quantizer & quantizer,
                                                 const mbmode min_prediction_mode,
@@ -297,10 +315,10 @@ void Encoder::chroma_mb_apply_intra_prediction( const VP8Raster::Macroblock & or
   frame_mb.U().forall_ij(
     [&] ( UVBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
     {
-      auto & original_sb = original_mb.U_sub_at( sb_column, sb_row );
+      const VP8Raster::Block4 original_sb = original_mb.U_sub_block( sb_column, sb_row );
 
       frame_sb.mutable_coefficients().subtract_dct( original_sb,
-        reconstructed_mb.U_sub_at( sb_column, sb_row ).contents() );
+        reconstructed_mb.U_sub_block( sb_column, sb_row ).contents() );
 
       if ( encoder_pass == FIRST_PASS ) {
         frame_sb.mutable_coefficients() = UVBlock::quantize( quantizer, frame_sb.coefficients() );
@@ -316,10 +334,10 @@ void Encoder::chroma_mb_apply_intra_prediction( const VP8Raster::Macroblock & or
   frame_mb.V().forall_ij(
     [&] ( UVBlock & frame_sb, unsigned int sb_column, unsigned int sb_row )
     {
-      auto & original_sb = original_mb.V_sub_at( sb_column, sb_row );
+      const VP8Raster::Block4 original_sb = original_mb.V_sub_block( sb_column, sb_row );
 
       frame_sb.mutable_coefficients().subtract_dct( original_sb,
-        reconstructed_mb.V_sub_at( sb_column, sb_row ).contents() );
+        reconstructed_mb.V_sub_block( sb_column, sb_row ).contents() );
 
       if ( encoder_pass == FIRST_PASS ) {
         frame_sb.mutable_coefficients() = UVBlock::quantize( quantizer, frame_sb.coefficients() );
@@ -334,9 +352,9 @@ void Encoder::chroma_mb_apply_intra_prediction( const VP8Raster::Macroblock & or
 }
 
 template <class MacroblockType>
-void Encoder::chroma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
-                                       VP8Raster::Macroblock & reconstructed_mb,
-                                       VP8Raster::Macroblock & temp_mb,
+void Encoder::chroma_mb_intra_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                       const VP8Raster::MacroblockView & reconstructed_mb,
+                                       const VP8Raster::MacroblockView & temp_mb,
                                        MacroblockType & frame_mb,
                                        const Quantizer & quantizer,
                                        const EncoderPass encoder_pass,
@@ -398,6 +416,7 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
 
   frame.mutable_header().quant_indices = quant_indices;
   frame.mutable_header().refresh_entropy_probs = true;
+  frame.mutable_header().log2_number_of_dct_partitions = dct_partitions_log2();
 
   Quantizer quantizer( frame.header().quant_indices );
   MutableRasterHandle reconstructed_raster_handle { width(), height() };
@@ -415,26 +434,33 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
       token_branch_counts = TokenBranchCounts();
     }
 
-    raster.macroblocks_forall_ij(
-      [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+    vector<TokenBranchCounts> worker_token_branch_counts( thread_count_ );
+
+    run_wavefront( thread_count_, frame.macroblocks().width(), frame.macroblocks().height(),
+      [&] ( unsigned int mb_column, unsigned int mb_row, unsigned int worker )
       {
-        auto reconstructed_mb = reconstructed_raster_handle.get().macroblock( mb_column, mb_row );
-        auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+        const auto original_mb = raster.macroblock_view( mb_column, mb_row );
+        const auto reconstructed_mb = reconstructed_raster_handle.get().macroblock_view( mb_column, mb_row );
+        const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
         auto & frame_mb = frame.mutable_macroblocks().at( mb_column, mb_row );
 
         // Process Y and Y2
-        luma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        luma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                frame_mb, quantizer, (EncoderPass)pass );
-        chroma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, (EncoderPass)pass );
 
         frame_mb.calculate_has_nonzero();
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
 
-        frame_mb.accumulate_token_branches( token_branch_counts );
+        frame_mb.accumulate_token_branches( worker_token_branch_counts.at( worker ) );
       }
     );
 
+    for ( const TokenBranchCounts & counts : worker_token_branch_counts ) {
+      add_token_branch_counts( token_branch_counts, counts );
+    }
+
     optimize_probability_tables( frame, token_branch_counts );
   }
 
@@ -37,6 +37,7 @@
 #include "encoder.hh"
 #include "frame_header.hh"
 #include "tokens.hh"
+#include "parallel.hh"
 
 using namespace std;
 
@@ -54,6 +55,29 @@ unsigned Encoder::calc_prob( unsigned false_count, unsigned total )
   }
 }
 
+void Encoder::add_token_branch_counts( TokenBranchCounts & total, const TokenBranchCounts & counts )
+{
+  for ( unsigned int i = 0; i < BLOCK_TYPES; i++ ) {
+    for ( unsigned int j = 0; j < COEF_BANDS; j++ ) {
+      for ( unsigned int k = 0; k < PREV_COEF_CONTEXTS; k++ ) {
+        for ( unsigned int l = 0; l < ENTROPY_NODES; l++ ) {
+          total.at( i ).at( j ).at( k ).at( l ).first += counts.at( i ).at( j ).at( k ).at( l ).first;
+          total.at( i ).at( j ).at( k ).at( l ).second += counts.at( i ).at( j ).at( k ).at( l ).second;
+        }
+      }
+    }
+  }
+}
+
+uint8_t Encoder::dct_partitions_log2() const
+{
+  uint8_t log2 = 0;
+  while ( log2 < 3 and ( 2u << log2 ) <= thread_count_ ) {
+    log2++;
+  }
+  return log2;
+}
+
 QuantIndices::QuantIndices()
   : y_ac_qi(), y_dc(), y2_dc(), y2_ac(), uv_dc(), uv_ac()
 {}
@@ -74,7 +98,8 @@ Encoder::Encoder( const uint16_t s_width,
                   const EncoderQuality quality )
   : decoder_state_( s_width, s_height ),
     references_( width(), height() ),
-    safe_references_( references_ ), has_state_( false ), costs_(),
+    state_id_( get_hash().hash() ),
+    has_state_( false ), costs_(),
     two_pass_encoder_( two_pass ), encode_quality_( quality )
 {
   costs_.fill_mode_costs();
@@ -83,7 +108,8 @@ Encoder::Encoder( const uint16_t s_width,
 Encoder::Encoder( const Decoder & decoder, const bool two_pass,
                   const EncoderQuality quality )
   : decoder_state_( decoder.get_state() ), references_( decoder.get_references() ),
-    safe_references_( references_ ), has_state_( true ), costs_(),
+    state_id_( decoder.state_id() ),
+    has_state_( true ), costs_(),
     two_pass_encoder_( two_pass ), encode_quality_( quality )
 {
   costs_.fill_mode_costs();
@@ -92,28 +118,34 @@ Encoder::Encoder( const Decoder & decoder, const bool two_pass,
 Encoder::Encoder( const Encoder & encoder )
   : decoder_state_( encoder.decoder_state_ ),
     references_( encoder.references_ ),
-    safe_references_( encoder.safe_references_ ),
+    state_id_( encoder.state_id_ ),
     has_state_( encoder.has_state_ ), costs_( encoder.costs_ ),
     two_pass_encoder_( encoder.two_pass_encoder_ ),
     encode_quality_( encoder.encode_quality_ ),
+    thread_count_( encoder.thread_count_ ),
     loop_filter_level_( encoder.loop_filter_level_ ),
     last_y_ac_qi_( encoder.last_y_ac_qi_ ),
+    key_frame_rate_model_( encoder.key_frame_rate_model_ ),
+    inter_frame_rate_model_( encoder.inter_frame_rate_model_ ),
     encode_stats_( encoder.encode_stats_ )
 {}
 
 Encoder::Encoder( Encoder && encoder )
   : decoder_state_( move( encoder.decoder_state_ ) ),
     references_( move( encoder.references_ ) ),
-    safe_references_( move( encoder.safe_references_ ) ),
+    state_id_( encoder.state_id_ ),
     has_state_( encoder.has_state_ ), costs_( move( encoder.costs_ ) ),
     two_pass_encoder_( encoder.two_pass_encoder_ ),
     encode_quality_( encoder.encode_quality_ ),
+    thread_count_( encoder.thread_count_ ),
     key_frame_( move( encoder.key_frame_ ) ),
     subsampled_key_frame_( move( encoder.subsampled_key_frame_ ) ),
     inter_frame_( move( encoder.inter_frame_ ) ),
     subsampled_inter_frame_( move( encoder.subsampled_inter_frame_ ) ),
     loop_filter_level_( move( encoder.loop_filter_level_ ) ),
     last_y_ac_qi_( move( encoder.last_y_ac_qi_ ) ),
+    key_frame_rate_model_( move( encoder.key_frame_rate_model_ ) ),
+    inter_frame_rate_model_( move( encoder.inter_frame_rate_model_ ) ),
     encode_stats_( move( encoder.encode_stats_ ) )
 {}
 
@@ -121,26 +153,37 @@ Encoder & Encoder::operator=( Encoder && encoder )
 {
   decoder_state_ = move( encoder.decoder_state_ );
   references_ = move( encoder.references_ );
-  safe_references_ = move( encoder.safe_references_ );
+  state_id_ = encoder.state_id_;
   has_state_ = encoder.has_state_;
   costs_ = move( encoder.costs_ );
   two_pass_encoder_ = encoder.two_pass_encoder_;
   encode_quality_ = encoder.encode_quality_;
+  thread_count_ = encoder.thread_count_;
   key_frame_ = move( encoder.key_frame_ );
   subsampled_key_frame_ = move( encoder.subsampled_key_frame_ );
   inter_frame_ = move( encoder.inter_frame_ );
   subsampled_inter_frame_ = move( encoder.subsampled_inter_frame_ );
   loop_filter_level_ = move( encoder.loop_filter_level_ );
   last_y_ac_qi_ = move( encoder.last_y_ac_qi_ );
+  key_frame_rate_model_ = move( encoder.key_frame_rate_model_ );
+  inter_frame_rate_model_ = move( encoder.inter_frame_rate_model_ );
   encode_stats_ = move( encoder.encode_stats_ );
 
   return *this;
 }
 
+DecoderHash Encoder::get_hash() const
+{
+  return DecoderHash( decoder_state_.hash(), references_.last.hash(),
+                      references_.golden.hash(), references_.alternative.hash() );
+}
+
+/* the same value as Decoder::minihash() */
 uint32_t Encoder::minihash() const
 {
-  return static_cast<uint32_t>( DecoderHash( decoder_state_.hash(), references_.last.hash(),
-                                references_.golden.hash(), references_.alternative.hash() ).hash() );
+  return static_cast<uint32_t>( DecoderHash( decoder_state_.hash(), references_.last.stable_hash(),
+                                             references_.golden.stable_hash(),
+                                             references_.alternative.stable_hash() ).hash() );
 }
 
 template<class FrameType>
@@ -152,21 +195,19 @@ vector<uint8_t> Encoder::write_frame( const FrameType & frame,
 
   // update the references
   MutableRasterHandle raster { width(), height() };
-  frame.decode( decoder_state_.segmentation, references_, raster );
-  frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, raster );
+  frame.decode_and_loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments,
+                               references_, raster, thread_count_ );
   RasterHandle immutable_raster( move( raster ) );
   frame.copy_to( immutable_raster, references_ );
 
-  safe_references_.last = move( SafeReferences::load( references_.last ) );
-  safe_references_.golden = move( SafeReferences::load( references_.golden ) );
-  safe_references_.alternative = move( SafeReferences::load( references_.alternative ) );
-
   if ( encode_quality_ == REALTIME_QUALITY ) {
     loop_filter_level_.reset( frame.header().loop_filter_level );
     last_y_ac_qi_.reset( frame.header().quant_indices.y_ac_qi );
   }
 
-  return frame.serialize( prob_tables );
+  vector<uint8_t> output = frame.serialize( prob_tables, thread_count_ );
+  state_id_ = Decoder::next_state_id( state_id_, output );
+  return output;
 }
 
 template<class FrameType>
@@ -368,8 +409,8 @@ void Encoder::trellis_quantize( FrameSubblockType & frame_sb,
     }
   }
 
-  uint8_t token_context = ( frame_sb.context().above.initialized() ? frame_sb.context().above.get()->has_nonzero() : 0 )
-    + ( frame_sb.context().left.initialized() ? frame_sb.context().left.get()->has_nonzero() : 0 );
+  uint8_t token_context = ( frame_sb.context().above().initialized() ? frame_sb.context().above().get()->has_nonzero() : 0 )
+    + ( frame_sb.context().left().initialized() ? frame_sb.context().left().get()->has_nonzero() : 0 );
 
   for ( size_t i = 0; i < LEVELS; i++ ) {
     TrellisNode & node = trellis.at( first_index ).at( i );
@@ -429,8 +470,14 @@ void Encoder::optimize_probability_tables( FrameType & frame, const TokenBranchC
 
           assert( prob <= 255 );
 
+          /* the frame may be reused, so an update left from its last use is cleared */
+          TokenProbUpdate & update = frame.mutable_header().token_prob_update.at( i ).at( j ).at( k ).at( l );
+
           if ( prob > 0 and prob != decoder_state_.probability_tables.coeff_probs.at( i ).at( j ).at( k ).at( l ) ) {
-            frame.mutable_header().token_prob_update.at( i ).at( j ).at( k ).at( l ) = TokenProbUpdate( true, prob );
+            update = TokenProbUpdate( true, prob );
+          }
+          else {
+            update = TokenProbUpdate();
           }
         }
       }
@@ -493,7 +540,8 @@ void Encoder::apply_best_loopfilter_settings( const VP8Raster & original,
 
     decoder_state_.filter_adjustments.reset( frame.header() );
 
-    frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, temp_raster() );
+    frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, temp_raster(),
+                      thread_count_ );
 
     /* XXX This is taking too much time and is very inefficient. */
     double ssim = temp_raster().quality( original );
@@ -510,7 +558,8 @@ void Encoder::apply_best_loopfilter_settings( const VP8Raster & original,
   frame.mutable_header().loop_filter_level = best_lf_level;
   decoder_state_.filter_adjustments.reset( frame.header() );
 
-  frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, reconstructed );
+  frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, reconstructed,
+                    thread_count_ );
 
   encode_stats_.ssim.reset( best_ssim );
 }
@@ -519,6 +568,10 @@ template<class FrameType>
 FrameType & Encoder::encode_with_quantizer_search( const VP8Raster & raster,
                                                    const double minimum_ssim )
 {
+  if ( thread_count_ > 1 ) {
+    return encode_with_parallel_quantizer_search<FrameType>( raster, minimum_ssim );
+  }
+
   int y_ac_qi_min = 0;
   int y_ac_qi_max = 127;
 
@@ -530,7 +583,7 @@ FrameType & Encoder::encode_with_quantizer_search( const VP8Raster & raster,
   while ( y_ac_qi_min <= y_ac_qi_max ) {
     quant_indices.y_ac_qi = ( y_ac_qi_min + y_ac_qi_max ) / 2;
 
-    pair<FrameType &, double> encoded_frame = encode_raster<FrameType>( raster, quant_indices, true );
+    pair<FrameType &, double> encoded_frame = encode_raster<FrameType>( raster, quant_indices, false, true );
 
     double current_ssim = encoded_frame.second;
 
@@ -552,10 +605,103 @@ FrameType & Encoder::encode_with_quantizer_search( const VP8Raster & raster,
     }
   }
 
+  if ( quant_indices.y_ac_qi == best_y_ac_qi ) {
+    // the last frame we encoded is the answer
+    return frame_handle<FrameType>().get();
+  }
+
   quant_indices.y_ac_qi = best_y_ac_qi;
   return encode_raster<FrameType>( raster, quant_indices, false ).first;
 }
 
+/*
+ * Same search as above, but each round encodes thread_count_ quantizers at
+ * once, each on its own copy of the encoder, and narrows the range to what
+ * lies between the highest one that reached minimum_ssim and the lowest one
+ * above it that didn't. The winning copy's frame is kept rather than encoded
+ * again.
+ */
+template<class FrameType>
+FrameType & Encoder::encode_with_parallel_quantizer_search( const VP8Raster & raster,
+                                                            const double minimum_ssim )
+{
+  const unsigned int candidate_count = thread_count_;
+
+  int y_ac_qi_min = 0;
+  int y_ac_qi_max = 127;
+
+  /* the highest quantizer that reached minimum_ssim, or failing that, the
+     lowest one tried */
+  unique_ptr<Encoder> best;
+  int best_y_ac_qi = 0;
+  bool found = false;
+
+  while ( y_ac_qi_min <= y_ac_qi_max ) {
+    const unsigned int range = y_ac_qi_max - y_ac_qi_min + 1;
+
+    vector<int> candidates;
+    for ( unsigned int i = 0; i < min( candidate_count, range ); i++ ) {
+      candidates.push_back( ( range <= candidate_count )
+                            ? y_ac_qi_min + i
+                            : y_ac_qi_min + ( ( i + 1 ) * range ) / ( candidate_count + 1 ) );
+    }
+
+    vector<Encoder> encoders;
+    encoders.reserve( candidates.size() );
+    for ( size_t i = 0; i < candidates.size(); i++ ) {
+      encoders.emplace_back( *this );
+      encoders.back().set_thread_count( 1 );
+    }
+
+    vector<double> ssims( candidates.size() );
+
+    run_workers( candidates.size(),
+                 [&]( const unsigned int i )
+                 {
+                   QuantIndices quant_indices;
+                   quant_indices.y_ac_qi = candidates.at( i );
+                   ssims.at( i ) = encoders.at( i ).encode_raster<FrameType>( raster, quant_indices,
+                                                                               false, true ).second;
+                 } );
+
+    /* the candidates are in increasing order, and SSIM falls as the quantizer rises */
+    Optional<size_t> last_passed;
+    Optional<size_t> first_failed;
+
+    for ( size_t i = 0; i < candidates.size() and not first_failed.initialized(); i++ ) {
+      if ( ssims.at( i ) >= minimum_ssim ) {
+        last_passed.reset( i );
+      }
+      else {
+        first_failed.reset( i );
+      }
+    }
+
+    if ( last_passed.initialized() ) {
+      found = true;
+      best_y_ac_qi = candidates.at( last_passed.get() );
+      best.reset( new Encoder( move( encoders.at( last_passed.get() ) ) ) );
+      y_ac_qi_min = best_y_ac_qi + 1;
+    }
+    else if ( not found and ( not best or candidates.front() < best_y_ac_qi ) ) {
+      best_y_ac_qi = candidates.front();
+      best.reset( new Encoder( move( encoders.front() ) ) );
+    }
+
+    if ( first_failed.initialized() ) {
+      y_ac_qi_max = candidates.at( first_failed.get() ) - 1;
+    }
+  }
+
+  /* take over the winner's frame, and the costs it was encoded with */
+  swap( frame_handle<FrameType>(), best->frame_handle<FrameType>() );
+  costs_ = move( best->costs_ );
+  RATE_MULTIPLIER = best->RATE_MULTIPLIER;
+  DISTORTION_MULTIPLIER = best->DISTORTION_MULTIPLIER;
+
+  return frame_handle<FrameType>().get();
+}
+
 vector<uint8_t> Encoder::encode_with_quantizer( const VP8Raster & raster, const uint8_t y_ac_qi )
 {
   if ( width() != raster.display_width() or height() != raster.display_height() ) {
@@ -574,6 +720,51 @@ vector<uint8_t> Encoder::encode_with_quantizer( const VP8Raster & raster, const
   }
 }
 
+vector<pair<Encoder, vector<uint8_t>>> Encoder::encode_with_quantizers( const VP8Raster & raster,
+                                                                        const vector<uint8_t> & y_ac_qis )
+{
+  if ( width() != raster.display_width() or height() != raster.display_height() ) {
+    throw runtime_error( "scaling is not supported" );
+  }
+
+  vector<pair<Encoder, vector<uint8_t>>> variants;
+
+  if ( y_ac_qis.empty() ) {
+    return variants;
+  }
+
+  variants.reserve( y_ac_qis.size() );
+
+  for ( size_t i = 0; i < y_ac_qis.size(); i++ ) {
+    variants.emplace_back( *this, vector<uint8_t>() );
+  }
+
+  if ( has_state_ and variants.size() > 1 ) {
+    /* the quantizer only enters the motion search through the cost of the
+       motion vectors, so a search at the average quantizer serves them all */
+    size_t y_ac_qi_sum = 0;
+    for ( const uint8_t y_ac_qi : y_ac_qis ) {
+      y_ac_qi_sum += y_ac_qi;
+    }
+
+    const vector<MotionVector> motion_vectors = find_motion_vectors( raster, y_ac_qi_sum / y_ac_qis.size() );
+
+    for ( auto & variant : variants ) {
+      variant.first.shared_motion_vectors_ = motion_vectors;
+    }
+  }
+
+  run_workers( variants.size(),
+               [&]( const unsigned int i )
+               {
+                 Encoder & encoder = variants.at( i ).first;
+                 variants.at( i ).second = encoder.encode_with_quantizer( raster, y_ac_qis.at( i ) );
+                 encoder.shared_motion_vectors_.clear();
+               } );
+
+  return variants;
+}
+
 vector<uint8_t> Encoder::encode_with_minimum_ssim( const VP8Raster & raster, const double minimum_ssim )
 {
   if ( width() != raster.display_width() or height() != raster.display_height() ) {
@@ -607,21 +798,72 @@ vector<uint8_t> Encoder::encode_with_target_size( const VP8Raster & raster, cons
     y_qi_max = min( y_qi_max, last_y_ac_qi_.get() + radius );
   }
 
-  uint8_t best_y_qi = numeric_limits<uint8_t>::max();
+  /* instead of binary searching the whole range, let the rate model predict
+     the quantizer and verify the prediction with at most two estimates */
+  RateModel & rate_model = has_state_ ? inter_frame_rate_model_ : key_frame_rate_model_;
+
+  auto within_range = [&]( const int y_qi ) { return max( y_qi_min, min( y_qi_max, y_qi ) ); };
 
-  size_t estimated_size = target_size;
+  int first_y_qi;
+
+  if ( rate_model.trained() ) {
+    first_y_qi = within_range( rate_model.predicted_quantizer( target_size ) );
+  }
+  else {
+    first_y_qi = ( y_qi_min + y_qi_max ) / 2;
+  }
+
+  const size_t first_size = estimate_frame_size( raster, first_y_qi );
+
+  if ( rate_model.trained() ) {
+    encode_stats_.size_prediction_error.reset( first_size / rate_model.predicted_size( first_y_qi ) - 1.0 );
+  }
+  else {
+    encode_stats_.size_prediction_error.clear();
+  }
 
-  while ( y_qi_min <= y_qi_max ) {
-    size_t y_qi = ( y_qi_min + y_qi_max ) / 2;
-    estimated_size = estimate_frame_size( raster, y_qi );
+  rate_model.observe( first_y_qi, first_size );
 
-    if ( estimated_size <= target_size or ( y_qi_min == y_qi_max and best_y_qi == numeric_limits<uint8_t>::max() ) ) {
-      best_y_qi = y_qi;
+  const int second_y_qi = within_range( rate_model.predicted_quantizer( target_size ) );
 
-      y_qi_max = y_qi - 1;
+  int best_y_qi = first_y_qi;
+  bool fits = first_size <= target_size;
+
+  /* the largest quantizer whose estimate was too big */
+  int too_big_y_qi = fits ? y_qi_min - 1 : first_y_qi;
+
+  if ( second_y_qi != first_y_qi ) {
+    const size_t second_size = estimate_frame_size( raster, second_y_qi );
+    rate_model.observe( first_y_qi, first_size, second_y_qi, second_size );
+
+    if ( second_size > target_size ) {
+      too_big_y_qi = max( too_big_y_qi, second_y_qi );
     }
-    else if ( estimated_size > target_size ) {
-      y_qi_min = y_qi + 1;
+    else if ( not fits or second_y_qi < first_y_qi ) {
+      /* the smaller quantizer that fits wins */
+      best_y_qi = second_y_qi;
+      fits = true;
+    }
+  }
+
+  if ( not fits ) {
+    /* the model missed: binary search the quantizers above the ones that
+       were too big, verifying every step. if none fits, use the largest. */
+    best_y_qi = y_qi_max;
+
+    int low = too_big_y_qi + 1;
+    int high = y_qi_max;
+
+    while ( low <= high ) {
+      const int y_qi = ( low + high ) / 2;
+
+      if ( estimate_frame_size( raster, y_qi ) <= target_size ) {
+        best_y_qi = y_qi;
+        high = y_qi - 1;
+      }
+      else {
+        low = y_qi + 1;
+      }
     }
   }
 
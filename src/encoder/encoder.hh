@@ -40,6 +40,7 @@
 #include "vp8_raster.hh"
 #include "ivf_writer.hh"
 #include "costs.hh"
+#include "rate_model.hh"
 #include "enc_state_serializer.hh"
 #include "file_descriptor.hh"
 #include "block.hh"
@@ -67,31 +68,6 @@ enum EncoderMode
   REENCODE
 };
 
-class SafeReferences
-{
-public:
-  /* For now, we only need the Y planes to do the diamond search, so we only
-     keep them in our safe references. */
-  SafeRasterHandle last, golden, alternative;
-
-private:
-  SafeReferences( const uint16_t width, const uint16_t height );
-
-public:
-  SafeReferences( const References & references );
-
-  const SafeRaster & get( reference_frame reference_id ) const;
-
-  static MutableSafeRasterHandle load( const VP8Raster & source );
-};
-
-template<class FrameType>
-static FramePool<FrameType> & subsampled_frame_pool()
-{
-  static FramePool<FrameType> pool;
-  return pool;
-}
-
 class Encoder
 {
 private:
@@ -123,7 +99,9 @@ private:
   uint16_t height() const { return decoder_state_.height; }
   MutableRasterHandle temp_raster_handle_ { width(), height() };
   References references_;
-  SafeReferences safe_references_;
+
+  /* Decoder::state_id() of the decoder that has taken every frame written so far */
+  size_t state_id_;
 
   bool has_state_;
 
@@ -132,6 +110,10 @@ private:
   bool two_pass_encoder_;
   EncoderQuality encode_quality_;
 
+  /* number of threads the per-frame passes (macroblock encoding, the loop
+     filter) may use */
+  unsigned int thread_count_ { 1 };
+
   KeyFrameHandle key_frame_ { width(), height() };
   KeyFrameHandle subsampled_key_frame_ { uint16_t( width() / WIDTH_SAMPLE_DIMENSION_FACTOR ),
       uint16_t( height() / HEIGHT_SAMPLE_DIMENSION_FACTOR ),
@@ -148,6 +130,14 @@ private:
      last_y_ac_qi_ - a <= y_ac_qi <= last_y_ac_qi_ + a */
   Optional<uint8_t> last_y_ac_qi_ {};
 
+  /* if not empty, the NEWMV candidate of every macroblock (in raster order),
+     found ahead of time by encode_with_quantizers() */
+  std::vector<MotionVector> shared_motion_vectors_ {};
+
+  /* predict the quantizer for encode_with_target_size, one per frame type */
+  RateModel key_frame_rate_model_ {};
+  RateModel inter_frame_rate_model_ {};
+
   // TODO: Where did these come from?
   uint32_t RATE_MULTIPLIER { 300 };
   uint32_t DISTORTION_MULTIPLIER { 1 };
@@ -156,6 +146,10 @@ private:
   struct EncodeStats
   {
     Optional<double> ssim;
+
+    /* relative error of the rate model's size prediction, when
+       encode_with_target_size had a trained model to predict from */
+    Optional<double> size_prediction_error;
   } encode_stats_ {};
 
   static uint32_t rdcost( uint32_t rate, uint32_t distortion,
@@ -174,74 +168,87 @@ private:
   static uint32_t variance( const VP8Raster::Block<size> & block,
                             const TwoDSubRange<uint8_t, size, size> & prediction );
 
-  MVSearchResult diamond_search( const VP8Raster::Macroblock & original_mb,
-                                 VP8Raster::Macroblock & temp_mb,
+  MVSearchResult diamond_search( const VP8Raster::ConstMacroblockView & original_mb,
+                                 const VP8Raster::MacroblockView & temp_mb,
                                  InterFrameMacroblock & frame_mb,
                                  const VP8Raster & reference,
-                                 const SafeRaster & safe_reference,
                                  MotionVector base_mv,
                                  MotionVector origin,
                                  size_t step_size,
                                  const size_t y_ac_qi ) const;
 
-  void luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
-                              VP8Raster::Macroblock & constructed_mb,
-                              VP8Raster::Macroblock & temp_mb,
+  /* repeated diamond searches, each from where the last one ended up */
+  MotionVector motion_search( const VP8Raster::ConstMacroblockView & original_mb,
+                              const VP8Raster::MacroblockView & temp_mb,
+                              InterFrameMacroblock & frame_mb,
+                              const VP8Raster & reference,
+                              const MotionVector & base_mv,
+                              const size_t y_ac_qi ) const;
+
+  /* the NEWMV candidates of every macroblock (zero where none is searched
+     for), searched from the zero vector rather than from the neighbours'
+     choices, so that they don't depend on the quantizer's mode decisions */
+  std::vector<MotionVector> find_motion_vectors( const VP8Raster & raster,
+                                                 const size_t y_ac_qi );
+
+  void luma_mb_inter_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                              const VP8Raster::MacroblockView & constructed_mb,
+                              const VP8Raster::MacroblockView & temp_mb,
                               InterFrameMacroblock & frame_mb,
                               const Quantizer & quantizer,
                               MVComponentCounts & component_counts,
                               const size_t y_ac_qi,
                               const EncoderPass encoder_pass );
 
-  void luma_mb_apply_inter_prediction( const VP8Raster::Macroblock & original_mb,
-                                       VP8Raster::Macroblock & reconstructed_mb,
+  void luma_mb_apply_inter_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                       const VP8Raster::MacroblockView & reconstructed_mb,
                                        InterFrameMacroblock & frame_mb,
                                        const Quantizer & quantizer,
                                        const mbmode best_pred,
                                        const MotionVector best_mv );
 
-  void chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
-                                VP8Raster::Macroblock & constructed_mb,
-                                VP8Raster::Macroblock & temp_mb,
+  void chroma_mb_inter_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                const VP8Raster::MacroblockView & constructed_mb,
+                                const VP8Raster::MacroblockView & temp_mb,
                                 InterFrameMacroblock & frame_mb,
                                 const Quantizer & quantizer,
                                 const EncoderPass encoder_pass = FIRST_PASS ) const;
 
   template<class MacroblockType>
-  MBPredictionData luma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
-                                                 VP8Raster::Macroblock & reconstructed_mb,
-                                                 VP8Raster::Macroblock & temp_mb,
+  MBPredictionData luma_mb_best_prediction_mode( const VP8Raster::ConstMacroblockView & original_mb,
+                                                 const VP8Raster::MacroblockView & reconstructed_mb,
+                                                 const VP8Raster::MacroblockView & temp_mb,
                                                  MacroblockType & frame_mb,
                                                  const Quantizer & quantizer,
                                                  const EncoderPass encoder_pass = FIRST_PASS,
                                                  const bool interframe = false ) const;
 
   template<class MacroblockType>
-  void luma_mb_apply_intra_prediction( const VP8Raster::Macroblock & original_mb,
-                                       VP8Raster::Macroblock & reconstructed_mb,
-                                       VP8Raster::Macroblock & temp_mb,
+  void luma_mb_apply_intra_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                       const VP8Raster::MacroblockView & reconstructed_mb,
+                                       const VP8Raster::MacroblockView & temp_mb,
                                        MacroblockType & frame_mb,
                                        const Quantizer & quantizer,
                                        const mbmode min_prediction_mode,
                                        const EncoderPass encoder_pass = FIRST_PASS ) const;
 
   template<class MacroblockType>
-  void luma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
-                              VP8Raster::Macroblock & constructed_mb,
-                              VP8Raster::Macroblock & temp_mb,
+  void luma_mb_intra_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                              const VP8Raster::MacroblockView & constructed_mb,
+                              const VP8Raster::MacroblockView & temp_mb,
                               MacroblockType & frame_mb,
                               const Quantizer & quantizer,
                               const EncoderPass encoder_pass = FIRST_PASS ) const;
 
-  MBPredictionData chroma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
-                                                   VP8Raster::Macroblock & reconstructed_mb,
-                                                   VP8Raster::Macroblock & temp_mb,
+  MBPredictionData chroma_mb_best_prediction_mode( const VP8Raster::ConstMacroblockView & original_mb,
+                                                   const VP8Raster::MacroblockView & reconstructed_mb,
+                                                   const VP8Raster::MacroblockView & temp_mb,
                                                    const bool interframe = false ) const;
 
   template<class MacroblockType>
-  void chroma_mb_apply_intra_prediction( const VP8Raster::Macroblock & original_mb,
-                                         VP8Raster::Macroblock & reconstructed_mb,
-                                         __attribute__((unused)) VP8Raster::Macroblock & temp_mb,
+  void chroma_mb_apply_intra_prediction( const VP8Raster::ConstMacroblockView & original_mb,
+                                         const VP8Raster::MacroblockView & reconstructed_mb,
+                                         __attribute__((unused)) const VP8Raster::MacroblockView & temp_mb,
                                          MacroblockType & frame_mb,
                                          const Quantizer & quantizer,
                                          const mbmode min_prediction_mode,
@@ -249,9 +256,9 @@ private:
 
 
   template<class MacroblockType>
-  void chroma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
-                                VP8Raster::Macroblock & constructed_mb,
-                                VP8Raster::Macroblock & temp_mb,
+  void chroma_mb_intra_predict( const VP8Raster::ConstMacroblockView & original_mb,
+                                const VP8Raster::MacroblockView & constructed_mb,
+                                const VP8Raster::MacroblockView & temp_mb,
                                 MacroblockType & frame_mb,
                                 const Quantizer & quantizer,
                                 const EncoderPass encoder_pass = FIRST_PASS,
@@ -298,6 +305,11 @@ private:
 
   static unsigned calc_prob( unsigned false_count, unsigned total );
 
+  static void add_token_branch_counts( TokenBranchCounts & total, const TokenBranchCounts & counts );
+
+  /* one DCT partition per thread, up to the format's limit of eight */
+  uint8_t dct_partitions_log2() const;
+
   template<class FrameType>
   std::vector<uint8_t> write_frame( const FrameType & frame );
 
@@ -320,9 +332,9 @@ private:
                                 const QuantIndices & quant_indices,
                                 const bool last_frame );
 
-  void update_macroblock( const VP8Raster::Macroblock & original_rmb,
-                          VP8Raster::Macroblock & reconstructed_rmb,
-                          VP8Raster::Macroblock & temp_mb,
+  void update_macroblock( const VP8Raster::ConstMacroblockView & original_rmb,
+                          const VP8Raster::MacroblockView & reconstructed_rmb,
+                          const VP8Raster::MacroblockView & temp_mb,
                           InterFrameMacroblock & frame_mb,
                           const InterFrameMacroblock & original_fmb,
                           const Quantizer & quantizer );
@@ -340,6 +352,14 @@ private:
   FrameType & encode_with_quantizer_search( const VP8Raster & raster,
                                             const double minimum_ssim );
 
+  template<class FrameType>
+  FrameType & encode_with_parallel_quantizer_search( const VP8Raster & raster,
+                                                     const double minimum_ssim );
+
+  /* the frame that encode_raster<FrameType>() encodes into */
+  template<class FrameType>
+  FrameHandle<FrameType> & frame_handle();
+
   void update_rd_multipliers( const Quantizer & quantizer );
 
 public:
@@ -362,6 +382,13 @@ public:
   std::vector<uint8_t> encode_with_quantizer( const VP8Raster & raster,
                                               const uint8_t y_ac_qi );
 
+  /* encodes the raster once per quantizer, each time as the frame that
+     follows this encoder's state, and returns the encoder after each frame
+     along with the frame. the variants are encoded concurrently and, for an
+     inter frame, share a single motion search. this encoder is unchanged. */
+  std::vector<std::pair<Encoder, std::vector<uint8_t>>> encode_with_quantizers( const VP8Raster & raster,
+                                                                                const std::vector<uint8_t> & y_ac_qis );
+
   /* Tries to encode the given raster with the best possible quality, without
    * exceeding the target size. */
   std::vector<uint8_t> encode_with_target_size( const VP8Raster & raster,
@@ -375,11 +402,20 @@ public:
 
   size_t estimate_frame_size( const VP8Raster & raster, const size_t y_ac_qi );
 
-  Decoder export_decoder() const { return { decoder_state_, references_ }; }
+  Decoder export_decoder() const { return { decoder_state_, references_, state_id_ }; }
 
   EncodeStats stats() { return encode_stats_; }
 
+  /* with more than one thread, each frame's macroblock rows are encoded on
+     that many threads, and encode_with_minimum_ssim() tries that many
+     quantizers at a time */
+  void set_thread_count( const unsigned int thread_count ) { thread_count_ = thread_count ? thread_count : 1; }
+  unsigned int thread_count() const { return thread_count_; }
+
+  DecoderHash get_hash() const;
   uint32_t minihash() const;
+
+  size_t state_id() const { return state_id_; }
 };
 
 #endif /* ENCODER_HH */
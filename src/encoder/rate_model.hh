@@ -0,0 +1,91 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef RATE_MODEL_HH
+#define RATE_MODEL_HH
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include "optional.hh"
+
+/* an online model of how a frame's estimated size falls off with its
+   quantizer: log( size ) = intercept - slope * y_ac_qi. every measurement
+   moves the intercept to the latest frame's complexity; two measurements of
+   the same frame at different quantizers refine the slope. */
+class RateModel
+{
+private:
+  static constexpr double DEFAULT_SLOPE = 0.03;
+  static constexpr double MIN_SLOPE = 0.005;
+  static constexpr double MAX_SLOPE = 0.2;
+
+  /* weight given to a new slope measurement */
+  static constexpr double SLOPE_LEARNING_RATE = 0.3;
+
+  Optional<double> intercept_ {};
+  double slope_ { DEFAULT_SLOPE };
+
+public:
+  bool trained() const { return intercept_.initialized(); }
+
+  double predicted_size( const int y_ac_qi ) const
+  {
+    return std::exp( intercept_.get() - slope_ * y_ac_qi );
+  }
+
+  /* the smallest quantizer whose predicted size fits in target_size */
+  int predicted_quantizer( const size_t target_size ) const
+  {
+    const double y_ac_qi = ( intercept_.get() - std::log( std::max( target_size, size_t( 1 ) ) ) ) / slope_;
+    return static_cast<int>( std::ceil( std::max( -1.0, std::min( 128.0, y_ac_qi ) ) ) );
+  }
+
+  void observe( const int y_ac_qi, const size_t size )
+  {
+    intercept_.reset( std::log( std::max( size, size_t( 1 ) ) ) + slope_ * y_ac_qi );
+  }
+
+  void observe( const int y_ac_qi_a, const size_t size_a,
+                const int y_ac_qi_b, const size_t size_b )
+  {
+    /* adjacent quantizers often produce the same size */
+    if ( std::abs( y_ac_qi_b - y_ac_qi_a ) >= 2 and size_a > 0 and size_b > 0 ) {
+      const double slope = ( std::log( size_a ) - std::log( size_b ) ) / ( y_ac_qi_b - y_ac_qi_a );
+
+      if ( slope >= MIN_SLOPE and slope <= MAX_SLOPE ) {
+        slope_ += SLOPE_LEARNING_RATE * ( slope - slope_ );
+      }
+    }
+
+    observe( y_ac_qi_b, size_b );
+  }
+};
+
+#endif /* RATE_MODEL_HH */
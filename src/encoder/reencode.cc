@@ -84,23 +84,23 @@ InterFrame Encoder::reencode_as_interframe( const VP8Raster & original_raster,
   costs_.fill_mv_component_costs( temp_tables.motion_vector_probs );
 
   original_raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+    [&] ( const VP8Raster::ConstMacroblockView & original_mb, unsigned int mb_column, unsigned int mb_row )
     {
-      auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
-      auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+      const auto reconstructed_mb = reconstructed_raster.macroblock_view( mb_column, mb_row );
+      const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
       auto & frame_mb = frame.mutable_macroblocks().at( mb_column, mb_row );
 
       // Process Y and Y2
-      luma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+      luma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb,
                              frame_mb, quantizer, component_counts,
                              frame.header().quant_indices.y_ac_qi, FIRST_PASS );
 
       if ( frame_mb.inter_coded() ) {
-        chroma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
       else {
-        chroma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
 
@@ -128,9 +128,9 @@ InterFrame Encoder::reencode_as_interframe( const VP8Raster & original_raster,
   return frame;
 }
 
-void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
-                                 VP8Raster::Macroblock & reconstructed_mb,
-                                 VP8Raster::Macroblock & temp_mb,
+void Encoder::update_macroblock( const VP8Raster::ConstMacroblockView & original_mb,
+                                 const VP8Raster::MacroblockView & reconstructed_mb,
+                                 const VP8Raster::MacroblockView & temp_mb,
                                  InterFrameMacroblock & frame_mb,
                                  const InterFrameMacroblock & original_fmb,
                                  const Quantizer & quantizer )
@@ -146,14 +146,14 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
   case V_PRED:
   case H_PRED:
   case TM_PRED:
-    reconstructed_mb.Y.intra_predict( luma_pred_mode );
+    reconstructed_mb.Y_block().intra_predict( luma_pred_mode );
     break;
 
   case B_PRED:
     reconstructed_mb.Y_sub_forall_ij(
       [&] ( VP8Raster::Block4 & reconstructed_sb, unsigned int sb_column, unsigned int sb_row )
       {
-        auto & original_sb = original_mb.Y_sub_at( sb_column, sb_row );
+        const VP8Raster::Block4 original_sb = original_mb.Y_sub_block( sb_column, sb_row );
         auto & frame_sb = frame_mb.Y().at( sb_column, sb_row );
         bmode sb_prediction_mode = original_fmb.Y().at( sb_column, sb_row ).prediction_mode();
 
@@ -175,7 +175,7 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
     const VP8Raster & reference = references_.at( frame_mb.header().reference() );
     best_mv = original_fmb.base_motion_vector();
 
-    reconstructed_mb.Y.inter_predict( best_mv, reference.Y() );
+    reconstructed_mb.Y_block().inter_predict( best_mv, reference.Y() );
     break;
   }
 
@@ -192,7 +192,7 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
         block.set_Y_without_Y2();
         block.set_prediction_mode( original_fmb.Y().at( column, row ).prediction_mode() );
 
-        reconstructed_mb.Y_sub_at( column, row ).inter_predict( block.motion_vector(), reference.Y() );
+        reconstructed_mb.Y_sub_block( column, row ).inter_predict( block.motion_vector(), reference.Y() );
       }
     );
 
@@ -221,8 +221,8 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
 
     mbmode chroma_pred_mode = original_fmb.uv_prediction_mode();
 
-    reconstructed_mb.U.intra_predict( chroma_pred_mode );
-    reconstructed_mb.V.intra_predict( chroma_pred_mode );
+    reconstructed_mb.U_block().intra_predict( chroma_pred_mode );
+    reconstructed_mb.V_block().intra_predict( chroma_pred_mode );
 
     chroma_mb_apply_intra_prediction( original_mb, reconstructed_mb, temp_mb,
                                       frame_mb, quantizer, chroma_pred_mode,
@@ -278,14 +278,14 @@ InterFrame Encoder::update_residues( const VP8Raster & original_raster,
   TokenBranchCounts token_branch_counts;
 
   original_raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+    [&] ( const VP8Raster::ConstMacroblockView & original_mb, unsigned int mb_column, unsigned int mb_row )
     {
-      auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
-      auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+      const auto reconstructed_mb = reconstructed_raster.macroblock_view( mb_column, mb_row );
+      const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
       auto & original_fmb = original_frame.macroblocks().at( mb_column, mb_row );
       auto & frame_mb = frame.mutable_macroblocks().at( mb_column, mb_row );
 
-      update_macroblock( original_mb.macroblock(), reconstructed_mb, temp_mb, frame_mb,
+      update_macroblock( original_mb, reconstructed_mb, temp_mb, frame_mb,
                          original_fmb, quantizer );
 
       frame_mb.calculate_has_nonzero();
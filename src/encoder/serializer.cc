@@ -26,6 +26,8 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <array>
+
 #include "uncompressed_chunk.hh"
 #include "frame.hh"
 #include "bool_encoder.hh"
@@ -33,6 +35,7 @@
 #include "scorer.hh"
 #include "tokens.hh"
 #include "decoder_state.hh"
+#include "parallel.hh"
 
 #include "encode_tree.cc"
 
@@ -251,9 +254,9 @@ void YBlock::write_subblock_inter_prediction( BoolEncoder & encoder,
 {
   const MotionVector default_mv;
 
-  const MotionVector & left_mv = context().left.initialized() ? context().left.get()->motion_vector() : default_mv;
+  const MotionVector & left_mv = context().left().initialized() ? context().left().get()->motion_vector() : default_mv;
 
-  const MotionVector & above_mv = context().above.initialized() ? context().above.get()->motion_vector() : default_mv;
+  const MotionVector & above_mv = context().above().initialized() ? context().above().get()->motion_vector() : default_mv;
 
   const bool left_is_zero = left_mv.empty();
   const bool above_is_zero = above_mv.empty();
@@ -292,10 +295,10 @@ void KeyFrameMacroblock::encode_prediction_modes( BoolEncoder & encoder,
 
   if ( Y2_.prediction_mode() == B_PRED ) {
     Y_.forall( [&]( const YBlock & block ) {
-        const auto above_mode = block.context().above.initialized()
-          ? block.context().above.get()->prediction_mode() : B_DC_PRED;
-        const auto left_mode = block.context().left.initialized()
-          ? block.context().left.get()->prediction_mode() : B_DC_PRED;
+        const auto above_mode = block.context().above().initialized()
+          ? block.context().above().get()->prediction_mode() : B_DC_PRED;
+        const auto left_mode = block.context().left().initialized()
+          ? block.context().left().get()->prediction_mode() : B_DC_PRED;
         encode( encoder,
                 Tree< bmode, num_intra_b_modes, b_mode_tree >( block.prediction_mode() ),
                 kf_b_mode_probs.at( above_mode ).at( left_mode ) );
@@ -330,9 +333,9 @@ void InterFrameMacroblock::encode_prediction_modes( BoolEncoder & encoder,
   } else {
     /* motion-vector "census" */
     Scorer census( header_.motion_vectors_flipped_ );
-    census.add( 2, context_.above );
-    census.add( 2, context_.left );
-    census.add( 1, context_.above_left );
+    census.add( 2, context_.above() );
+    census.add( 2, context_.left() );
+    census.add( 1, context_.above_left() );
     census.calculate();
 
     const auto counts = census.mode_contexts();
@@ -385,10 +388,9 @@ void Macroblock< FrameHeaderType, MacroblockheaderType >::serialize( BoolEncoder
 }
 
 template <class FrameHeaderType, class MacroblockType>
-vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize_first_partition( const ProbabilityTables & probability_tables ) const
+void Frame< FrameHeaderType, MacroblockType >::encode_first_partition( BoolEncoder & encoder,
+                                                                     const ProbabilityTables & probability_tables ) const
 {
-  BoolEncoder encoder;
-
   /* encode frame header */
   encode( encoder, header() );
 
@@ -400,22 +402,50 @@ vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize_first_part
                                                             header(),
                                                             segment_tree_probs,
                                                             probability_tables ); } );
+}
 
+template <class FrameHeaderType, class MacroblockType>
+template <class DCTPartitions>
+void Frame< FrameHeaderType, MacroblockType >::encode_tokens( DCTPartitions & dct_partitions,
+                                                              const ProbabilityTables & probability_tables,
+                                                              const unsigned int thread_count ) const
+{
+  /* row r goes to partition r % N, and the contexts a macroblock's tokens
+     depend on are already settled, so the partitions are independent */
+  const unsigned int worker_count = max( 1u, min( thread_count, unsigned( dct_partition_count() ) ) );
+  const TwoD<MacroblockType> & macroblocks = macroblock_headers_.get();
+
+  run_workers( worker_count,
+               [&]( const unsigned int worker )
+               {
+                 for ( unsigned int row = 0; row < macroblocks.height(); row++ ) {
+                   const unsigned int partition = row % dct_partition_count();
+                   if ( partition % worker_count != worker ) {
+                     continue;
+                   }
+
+                   for ( unsigned int column = 0; column < macroblocks.width(); column++ ) {
+                     macroblocks.at( column, row ).serialize_tokens( dct_partitions.at( partition ),
+                                                                     probability_tables );
+                   }
+                 }
+               } );
+}
+
+template <class FrameHeaderType, class MacroblockType>
+vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize_first_partition( const ProbabilityTables & probability_tables ) const
+{
+  BoolEncoder encoder;
+  encode_first_partition( encoder, probability_tables );
   return encoder.finish();
 }
 
 template <class FrameHeaderType, class MacroblockType>
-vector< vector< uint8_t > > Frame< FrameHeaderType, MacroblockType >::serialize_tokens( const ProbabilityTables & probability_tables ) const
+vector< vector< uint8_t > > Frame< FrameHeaderType, MacroblockType >::serialize_tokens( const ProbabilityTables & probability_tables,
+                                                                                       const unsigned int thread_count ) const
 {
   vector< BoolEncoder > dct_partitions( dct_partition_count() );
-
-  /* serialize every macroblock's tokens */
-  macroblock_headers_.get().forall_ij( [&]( const MacroblockType & macroblock,
-                                            const unsigned int column __attribute((unused)),
-                                            const unsigned int row )
-                                       {
-                                         macroblock.serialize_tokens( dct_partitions.at( row % dct_partition_count() ),
-                                                                      probability_tables ); } );
+  encode_tokens( dct_partitions, probability_tables, thread_count );
 
   /* finish encoding and return the resulting octet sequences */
   vector< vector< uint8_t > > ret;
@@ -425,6 +455,30 @@ vector< vector< uint8_t > > Frame< FrameHeaderType, MacroblockType >::serialize_
   return ret;
 }
 
+template <class FrameHeaderType, class MacroblockType>
+size_t Frame< FrameHeaderType, MacroblockType >::count_partition_bytes( const ProbabilityTables & probability_tables,
+                                                                        const unsigned int thread_count ) const
+{
+  BoolEncoder first_partition { BoolEncoder::COUNT_ONLY };
+  encode_first_partition( first_partition, probability_tables );
+
+  array< BoolEncoder, 8 > dct_partitions;
+  for ( auto & x : dct_partitions ) {
+    x = BoolEncoder( BoolEncoder::COUNT_ONLY );
+  }
+
+  encode_tokens( dct_partitions, probability_tables, thread_count );
+
+  /* the first partition, the 3-byte lengths of all but the last DCT
+     partition, and the DCT partitions */
+  size_t size = first_partition.finish_size() + 3 * ( dct_partition_count() - 1 );
+  for ( unsigned int i = 0; i < dct_partition_count(); i++ ) {
+    size += dct_partitions.at( i ).finish_size();
+  }
+
+  return size;
+}
+
 template <class FrameHeaderType, class MacroblockheaderType >
 void Macroblock< FrameHeaderType, MacroblockheaderType >::serialize_tokens( BoolEncoder & encoder,
                                                                             const ProbabilityTables & probability_tables ) const
@@ -470,8 +524,8 @@ static void accumulate_token_branches( const Block<initial_block_type, Predictio
   bool last_was_zero = false;
 
   /* prediction context starts with number-not-zero count */
-  char token_context = ( block.context().above.initialized() ? block.context().above.get()->has_nonzero() : 0 )
-    + ( block.context().left.initialized() ? block.context().left.get()->has_nonzero() : 0 );
+  char token_context = ( block.context().above().initialized() ? block.context().above().get()->has_nonzero() : 0 )
+    + ( block.context().left().initialized() ? block.context().left().get()->has_nonzero() : 0 );
 
   unsigned int index = (block.type() == BlockType::Y_after_Y2) ? 1 : 0;
 
@@ -611,8 +665,8 @@ void Block< initial_block_type,
   bool last_was_zero = false;
 
   /* prediction context starts with number-not-zero count */
-  char token_context = ( context().above.initialized() ? context().above.get()->has_nonzero() : 0 )
-    + ( context().left.initialized() ? context().left.get()->has_nonzero() : 0 );
+  char token_context = ( context().above().initialized() ? context().above().get()->has_nonzero() : 0 )
+    + ( context().left().initialized() ? context().left().get()->has_nonzero() : 0 );
 
   unsigned int index = (type_ == BlockType::Y_after_Y2) ? 1 : 0;
 
@@ -799,7 +853,8 @@ static vector< uint8_t > make_frame( const bool key_frame,
 }
 
 template <>
-vector<uint8_t> KeyFrame::serialize( const ProbabilityTables & probability_tables ) const
+vector<uint8_t> KeyFrame::serialize( const ProbabilityTables & probability_tables,
+                                     const unsigned int thread_count ) const
 {
   ProbabilityTables frame_probability_tables( probability_tables );
   frame_probability_tables.coeff_prob_update( header() );
@@ -810,11 +865,23 @@ vector<uint8_t> KeyFrame::serialize( const ProbabilityTables & probability_table
                      false,
                      display_width_, display_height_,
                      serialize_first_partition( frame_probability_tables ),
-                     serialize_tokens( frame_probability_tables ) );
+                     serialize_tokens( frame_probability_tables, thread_count ) );
+}
+
+template <>
+size_t KeyFrame::serialized_size( const ProbabilityTables & probability_tables,
+                                  const unsigned int thread_count ) const
+{
+  ProbabilityTables frame_probability_tables( probability_tables );
+  frame_probability_tables.coeff_prob_update( header() );
+
+  /* frame tag, start code, and dimensions */
+  return 10 + count_partition_bytes( frame_probability_tables, thread_count );
 }
 
 template <>
-vector<uint8_t> InterFrame::serialize( const ProbabilityTables & probability_tables ) const
+vector<uint8_t> InterFrame::serialize( const ProbabilityTables & probability_tables,
+                                       const unsigned int thread_count ) const
 {
   ProbabilityTables frame_probability_tables( probability_tables );
   frame_probability_tables.update( header() );
@@ -825,5 +892,16 @@ vector<uint8_t> InterFrame::serialize( const ProbabilityTables & probability_tab
                      false,
                      display_width_, display_height_,
                      serialize_first_partition( frame_probability_tables ),
-                     serialize_tokens( frame_probability_tables ) );
+                     serialize_tokens( frame_probability_tables, thread_count ) );
+}
+
+template <>
+size_t InterFrame::serialized_size( const ProbabilityTables & probability_tables,
+                                    const unsigned int thread_count ) const
+{
+  ProbabilityTables frame_probability_tables( probability_tables );
+  frame_probability_tables.update( header() );
+
+  /* frame tag */
+  return 3 + count_partition_bytes( frame_probability_tables, thread_count );
 }
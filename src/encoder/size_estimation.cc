@@ -68,14 +68,14 @@ size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t
       const unsigned int org_mb_column = org_mb_location.first;
       const unsigned int org_mb_row = org_mb_location.second;
 
-      auto original_mb = raster.macroblock( org_mb_column, org_mb_row );
-      auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
-      auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+      const auto original_mb = raster.macroblock_view( org_mb_column, org_mb_row );
+      const auto reconstructed_mb = reconstructed_raster.macroblock_view( mb_column, mb_row );
+      const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
 
-      luma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+      luma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                              frame_mb, quantizer, FIRST_PASS );
 
-      chroma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+      chroma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                 frame_mb, quantizer, FIRST_PASS );
 
       frame_mb.calculate_has_nonzero();
@@ -89,7 +89,7 @@ size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t
   optimize_prob_skip( frame );
   // optimize_probability_tables( frame, token_branch_counts );
 
-  size_t size = frame.serialize( decoder_state_.probability_tables ).size();
+  size_t size = frame.serialized_size( decoder_state_.probability_tables );
   decoder_state_ = decoder_state_copy;
 
   return size * WIDTH_SAMPLE_DIMENSION_FACTOR * HEIGHT_SAMPLE_DIMENSION_FACTOR;
@@ -131,21 +131,21 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
       const unsigned int org_mb_column = org_mb_location.first;
       const unsigned int org_mb_row = org_mb_location.second;
 
-      auto original_mb = raster.macroblock( org_mb_column, org_mb_row );
-      auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
-      auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
+      const auto original_mb = raster.macroblock_view( org_mb_column, org_mb_row );
+      const auto reconstructed_mb = reconstructed_raster.macroblock_view( mb_column, mb_row );
+      const auto temp_mb = temp_raster().macroblock_view( mb_column, mb_row );
 
       // Process Y and Y2
-      luma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb, frame_mb,
+      luma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb, frame_mb,
                              quantizer, component_counts,
                              frame.header().quant_indices.y_ac_qi, FIRST_PASS );
 
       if ( frame_mb.inter_coded() ) {
-        chroma_mb_inter_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
       else {
-        chroma_mb_intra_predict( original_mb.macroblock(), reconstructed_mb, temp_mb,
+        chroma_mb_intra_predict( original_mb, reconstructed_mb, temp_mb,
                                  frame_mb, quantizer, FIRST_PASS );
       }
 
@@ -164,7 +164,7 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
   optimize_prob_skip( frame );
   optimize_interframe_probs( frame );
 
-  size_t size = frame.serialize( decoder_state_.probability_tables ).size();
+  size_t size = frame.serialized_size( decoder_state_.probability_tables );
   decoder_state_ = decoder_state_copy;
 
   return size * WIDTH_SAMPLE_DIMENSION_FACTOR * HEIGHT_SAMPLE_DIMENSION_FACTOR;
@@ -30,10 +30,18 @@
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <getopt.h>
 
 #include "file_descriptor.hh"
 #include "optional.hh"
 #include "player.hh"
+#include "uncompressed_chunk.hh"
 #include "yuv4mpeg.hh"
 
 using namespace std;
@@ -44,15 +52,426 @@ using namespace std;
    to a YUV4MPEG video on standard output
 */
 
+int usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-j threads] [-p depth] [-z] [starting_state]" << endl;
+  return EXIT_FAILURE;
+}
+
+/* writes frames to a file descriptor on its own thread, holding at most
+   `capacity` of them; push() blocks while the queue is full */
+class FrameWriter
+{
+private:
+  FileDescriptor & output_;
+  const size_t capacity_;
+  unique_ptr<YUV4MPEGSplicingWriter> splicer_;
+
+  deque<RasterHandle> queue_ {};
+  bool finished_ { false };
+  exception_ptr error_ {};
+
+  mutex mutex_ {};
+  condition_variable changed_ {};
+
+  thread thread_;
+
+  void write_frames()
+  {
+    try {
+      while ( true ) {
+        unique_lock<mutex> lock { mutex_ };
+        changed_.wait( lock, [&]() { return finished_ or not queue_.empty(); } );
+
+        if ( queue_.empty() ) {
+          return;
+        }
+
+        const RasterHandle raster = queue_.front();
+        queue_.pop_front();
+        changed_.notify_all();
+        lock.unlock();
+
+        if ( splicer_ ) {
+          splicer_->write( raster );
+        } else {
+          YUV4MPEGFrameWriter::write( raster, output_ );
+        }
+      }
+    } catch ( ... ) {
+      unique_lock<mutex> lock { mutex_ };
+      error_ = current_exception();
+      queue_.clear();
+      changed_.notify_all();
+    }
+  }
+
+public:
+  FrameWriter( FileDescriptor & output, const size_t capacity, const bool splice )
+    : output_( output ), capacity_( capacity ),
+      splicer_( splice ? new YUV4MPEGSplicingWriter( output ) : nullptr ),
+      thread_( [this]() { write_frames(); } )
+  {}
+
+  void push( const RasterHandle & raster )
+  {
+    unique_lock<mutex> lock { mutex_ };
+    changed_.wait( lock, [&]() { return error_ or queue_.size() < capacity_; } );
+
+    if ( error_ ) {
+      rethrow_exception( error_ );
+    }
+
+    queue_.push_back( raster );
+    changed_.notify_all();
+  }
+
+  /* waits for the queue to drain */
+  void finish()
+  {
+    {
+      unique_lock<mutex> lock { mutex_ };
+      finished_ = true;
+      changed_.notify_all();
+    }
+
+    thread_.join();
+
+    if ( error_ ) {
+      rethrow_exception( error_ );
+    }
+  }
+
+  ~FrameWriter()
+  {
+    if ( thread_.joinable() ) {
+      {
+        unique_lock<mutex> lock { mutex_ };
+        finished_ = true;
+        queue_.clear();
+        changed_.notify_all();
+      }
+      thread_.join();
+    }
+  }
+
+  FrameWriter( const FrameWriter & ) = delete;
+  FrameWriter & operator=( const FrameWriter & ) = delete;
+};
+
+/* carries one file's frames from the thread decoding it to the writer.
+   push() blocks while `capacity` frames are waiting, so a file decoded
+   ahead of its turn holds only that many. */
+class ChunkFrameQueue
+{
+private:
+  const size_t capacity_;
+
+  deque<RasterHandle> frames_ {};
+  bool closed_ { false };     /* no more frames will be pushed */
+  bool abandoned_ { false };  /* no more frames will be popped */
+
+  mutex mutex_ {};
+  condition_variable changed_ {};
+
+public:
+  ChunkFrameQueue( const size_t capacity )
+    : capacity_( capacity )
+  {}
+
+  void push( const RasterHandle & raster )
+  {
+    unique_lock<mutex> lock { mutex_ };
+    changed_.wait( lock, [&]() { return abandoned_ or frames_.size() < capacity_; } );
+
+    if ( abandoned_ ) {
+      throw runtime_error( "frame queue abandoned" );
+    }
+
+    frames_.push_back( raster );
+    changed_.notify_all();
+  }
+
+  void close()
+  {
+    unique_lock<mutex> lock { mutex_ };
+    closed_ = true;
+    changed_.notify_all();
+  }
+
+  /* the next frame, or nothing once the queue is closed and empty */
+  Optional<RasterHandle> pop()
+  {
+    unique_lock<mutex> lock { mutex_ };
+    changed_.wait( lock, [&]() { return closed_ or not frames_.empty(); } );
+
+    if ( frames_.empty() ) {
+      return {};
+    }
+
+    Optional<RasterHandle> raster = make_optional( true, frames_.front() );
+    frames_.pop_front();
+    changed_.notify_all();
+    return raster;
+  }
+
+  /* drops the frames, and makes push() throw so the decoding stops */
+  void abandon()
+  {
+    unique_lock<mutex> lock { mutex_ };
+    abandoned_ = true;
+    frames_.clear();
+    changed_.notify_all();
+  }
+};
+
+/* returns the decoder's exit state */
+Decoder decode_chunk( const IVF & ivf, Decoder decoder, ChunkFrameQueue & frames )
+{
+  try {
+    for ( unsigned int frame_no = 0; frame_no < ivf.frame_count(); frame_no++ ) {
+      Optional<RasterHandle> raster = decoder.parse_and_decode_frame( ivf.frame( frame_no ) );
+      if ( raster.initialized() ) {
+        frames.push( raster.get() );
+      }
+    }
+  } catch ( ... ) {
+    frames.close();
+    throw;
+  }
+
+  frames.close();
+  return decoder;
+}
+
+struct PendingBundleChunk
+{
+  string filename;
+  unique_ptr<IVF> ivf;
+
+  /* given on the input line; checked against the previous exit state */
+  Optional<Decoder> supplied_state;
+
+  /* decodes the same from any state */
+  bool starts_with_key_frame { false };
+
+  bool started { false };
+
+  unique_ptr<ChunkFrameQueue> frames;
+  future<Decoder> result;
+};
+
+/* -p: up to `depth` files are decoded at once. a file starts as soon as it
+   is read if it begins with a key frame (so its entry state doesn't matter),
+   or if a serialized entry state is given after its name on the same line;
+   any other file starts from the previous file's exit state. the checks are
+   the same as without -p: each file's expected entry hash is checked against
+   the previous file's exit state, and so is a supplied entry state. once a
+   file passes them, its frames go to the writer thread as they are decoded;
+   files decoded ahead of their turn wait with at most 16 frames each. */
+void decode_pipelined( const unsigned int depth, const unsigned int thread_count,
+                       const char * starting_state, const bool splice_output,
+                       FileDescriptor & stdout )
+{
+  static constexpr size_t frames_per_chunk = 16;
+
+  Optional<Decoder> previous_exit;
+  unique_ptr<FrameWriter> writer;
+  deque<PendingBundleChunk> pending;
+  bool input_done = false;
+  exception_ptr input_error {};
+
+  auto start = [&]( PendingBundleChunk & chunk, const Decoder & decoder )
+    {
+      Decoder entry_decoder = decoder;
+      entry_decoder.set_thread_count( thread_count );
+      chunk.result = async( launch::async, decode_chunk, cref( *chunk.ivf ),
+                            move( entry_decoder ), ref( *chunk.frames ) );
+      chunk.started = true;
+    };
+
+  try {
+    while ( true ) {
+      /* read ahead */
+      while ( not input_done and pending.size() < depth ) {
+        string line;
+        getline( cin, line );
+        if ( not cin.good() ) {
+          input_done = true;
+          break;
+        }
+
+        try {
+          PendingBundleChunk chunk {};
+          istringstream words { line };
+          string state_filename;
+          words >> chunk.filename >> state_filename;
+
+          cerr << "Opening " << chunk.filename << "... ";
+          chunk.ivf.reset( new IVF { chunk.filename } );
+          cerr << "done (" << chunk.ivf->frame_count() << " frames).\n";
+
+          chunk.frames.reset( new ChunkFrameQueue( frames_per_chunk ) );
+
+          if ( not previous_exit.initialized() ) {
+            cerr << "Initializing with size " << chunk.ivf->width() << "x" << chunk.ivf->height() << "\n";
+            if ( starting_state ) {
+              previous_exit.initialize( EncoderStateDeserializer::build<Decoder>( starting_state ) );
+            } else {
+              previous_exit.initialize( chunk.ivf->width(), chunk.ivf->height() );
+            }
+
+            stdout.write( YUV4MPEGHeader( previous_exit.get().example_raster() ).to_string() );
+            writer.reset( new FrameWriter( stdout, 16, splice_output ) );
+          }
+
+          chunk.starts_with_key_frame = chunk.ivf->frame_count() > 0
+            and UncompressedChunk( chunk.ivf->frame( 0 ), chunk.ivf->width(),
+                                   chunk.ivf->height(), false ).key_frame();
+
+          if ( not state_filename.empty() ) {
+            chunk.supplied_state.initialize( EncoderStateDeserializer::build<Decoder>( state_filename ) );
+            start( chunk, chunk.supplied_state.get() );
+          } else if ( pending.empty() ) {
+            start( chunk, previous_exit.get() );
+          } else if ( chunk.starts_with_key_frame ) {
+            /* any decoder of the right size will do */
+            start( chunk, previous_exit.get() );
+          }
+
+          pending.push_back( move( chunk ) );
+        } catch ( ... ) {
+          /* raised once the files before this one are written, as
+             it would be without -p */
+          input_error = current_exception();
+          input_done = true;
+        }
+      }
+
+      if ( pending.empty() ) {
+        if ( input_error ) {
+          rethrow_exception( input_error );
+        }
+        break;
+      }
+
+      PendingBundleChunk & chunk = pending.front();
+      const Decoder & entry_decoder = previous_exit.get();
+
+      if ( not entry_decoder.minihash_match( chunk.ivf->expected_decoder_minihash() ) ) {
+        stringstream error;
+        error << hex << "Hash mismatch. Expected " << chunk.ivf->expected_decoder_minihash()
+              << " but decoder is in state " << entry_decoder.minihash();
+        throw Invalid( error.str() );
+      }
+
+      if ( chunk.supplied_state.initialized() and not chunk.starts_with_key_frame
+           and chunk.supplied_state.get().minihash() != entry_decoder.minihash() ) {
+        stringstream error;
+        error << hex << "Supplied state for " << chunk.filename << " is " << chunk.supplied_state.get().minihash()
+              << " but the previous file left the decoder in state " << entry_decoder.minihash();
+        throw Invalid( error.str() );
+      }
+
+      if ( not chunk.started ) {
+        start( chunk, entry_decoder );
+      }
+
+      cerr << chunk.filename << " entering state: " << entry_decoder.get_hash().str() << "\n";
+
+      while ( true ) {
+        Optional<RasterHandle> raster = chunk.frames->pop();
+        if ( not raster.initialized() ) {
+          break;
+        }
+
+        writer->push( raster.get() );
+      }
+
+      previous_exit.reset( chunk.result.get() );
+      cerr << chunk.filename << " exiting state: " << previous_exit.get().get_hash().str() << "\n";
+
+      if ( pending.size() > 1 and not pending.at( 1 ).started ) {
+        start( pending.at( 1 ), previous_exit.get() );
+      }
+
+      pending.pop_front();
+    }
+  } catch ( ... ) {
+    /* stop the decoding threads, and write out the frames that were
+       already handed to the writer, as the sequential mode would have */
+    for ( PendingBundleChunk & chunk : pending ) {
+      if ( chunk.frames ) {
+        chunk.frames->abandon();
+      }
+    }
+
+    if ( writer ) {
+      try {
+        writer->finish();
+      } catch ( ... ) {
+        /* the first error is the one to report */
+      }
+    }
+
+    throw;
+  }
+
+  if ( writer ) {
+    writer->finish();
+  }
+}
+
 int main( int argc, char *argv[] )
 {
   try {
-    if ( argc > 2 ) {
-      cerr << "Usage: " << argv[ 0 ] << " [starting_state]" << endl;
-      return EXIT_FAILURE;
+    unsigned int thread_count = 1;
+    unsigned int pipeline_depth = 0;
+    bool splice_output = false;
+
+    while ( true ) {
+      const int opt = getopt( argc, argv, "j:p:z" );
+
+      if ( opt == -1 ) {
+        break;
+      }
+
+      switch ( opt ) {
+      case 'j':
+        thread_count = stoul( optarg );
+        break;
+
+      case 'p':
+        pipeline_depth = stoul( optarg );
+        break;
+
+      case 'z':
+        splice_output = true;
+        break;
+
+      default:
+        return usage( argv[ 0 ] );
+      }
     }
 
+    if ( argc - optind > 1 ) {
+      return usage( argv[ 0 ] );
+    }
+
+    const char * starting_state = ( optind < argc ) ? argv[ optind ] : nullptr;
+
     FileDescriptor stdout( STDOUT_FILENO );
+
+    if ( pipeline_depth > 0 ) {
+      decode_pipelined( pipeline_depth, thread_count, starting_state, splice_output, stdout );
+      return EXIT_SUCCESS;
+    }
+
+    unique_ptr<YUV4MPEGSplicingWriter> splicer;
+    if ( splice_output ) {
+      splicer.reset( new YUV4MPEGSplicingWriter( stdout ) );
+    }
+
     unique_ptr<FramePlayer> player;
 
     while ( true ) {
@@ -71,14 +490,16 @@ int main( int argc, char *argv[] )
       /* initialize player and output if necessary */
       if ( not player ) {
         cerr << "Initializing with size " << ivf.width() << "x" << ivf.height() << "\n";
-        if (argc > 1) {
-          player.reset( new FramePlayer { move( EncoderStateDeserializer::build<FramePlayer>(argv[1]) ) } );
+        if ( starting_state ) {
+          player.reset( new FramePlayer { move( EncoderStateDeserializer::build<FramePlayer>( starting_state ) ) } );
           assert(ivf.width() == player->width());
           assert(ivf.height() == player->height());
         } else {
           player.reset( new FramePlayer { ivf.width(), ivf.height() } );
         }
 
+        player->set_thread_count( thread_count );
+
         stdout.write( YUV4MPEGHeader( player->example_raster() ).to_string() );
       }
 
@@ -94,7 +515,11 @@ int main( int argc, char *argv[] )
       for ( unsigned int frame_no = 0; frame_no < ivf.frame_count(); frame_no++ ) {
         Optional<RasterHandle> raster = player->decode( ivf.frame( frame_no ) );
         if ( raster.initialized() ) {
-          YUV4MPEGFrameWriter::write( raster.get(), stdout );
+          if ( splicer ) {
+            splicer->write( raster.get() );
+          } else {
+            YUV4MPEGFrameWriter::write( raster.get(), stdout );
+          }
         }
       }
       cerr << filename << " exiting state: " << *player << "\n";
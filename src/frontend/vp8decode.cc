@@ -30,6 +30,7 @@
 #include <cstring>
 #include <getopt.h>
 #include <iostream>
+#include <memory>
 
 #include "file_descriptor.hh"
 #include "optional.hh"
@@ -49,9 +50,11 @@ int main( int argc, char *argv[] )
 
     Optional<FileDescriptor> y4m_fd;
     char *decoder_state = NULL;
+    unsigned int thread_count = 1;
+    bool splice_output = false;
 
     while (true) {
-      const int opt = getopt(argc, argv, "s:o:");
+      const int opt = getopt(argc, argv, "s:o:j:z");
 
       if (opt == -1) {
         break;
@@ -66,6 +69,14 @@ int main( int argc, char *argv[] )
           y4m_fd.initialize(fopen(optarg, "wb"));
           break;
 
+        case 'j':
+          thread_count = stoul(optarg);
+          break;
+
+        case 'z':
+          splice_output = true;
+          break;
+
         default:
           return usage(argv[0]);
       }
@@ -79,16 +90,29 @@ int main( int argc, char *argv[] )
       ? Player( argv[optind] )
       : EncoderStateDeserializer::build<Player>(decoder_state, argv[optind]);
 
+    player.set_thread_count(thread_count);
+
+    unique_ptr<YUV4MPEGSplicingWriter> splicer;
+    if (splice_output and y4m_fd.initialized()) {
+      splicer.reset(new YUV4MPEGSplicingWriter(y4m_fd.get()));
+    }
+
+    bool header_written = false;
+
     while ( not player.eof() ) {
       RasterHandle raster = player.advance();
 
       if (y4m_fd.initialized()) {
-        if (lseek(y4m_fd.get().fd_num(), 0, SEEK_CUR) == 0) {
-          // position 0: we haven't written a header yet
+        if (not header_written) {
           y4m_fd.get().write(YUV4MPEGHeader(raster).to_string());
+          header_written = true;
         }
 
-        YUV4MPEGFrameWriter::write(raster, y4m_fd.get());
+        if (splicer) {
+          splicer->write(raster);
+        } else {
+          YUV4MPEGFrameWriter::write(raster, y4m_fd.get());
+        }
       }
     }
 
@@ -101,6 +125,6 @@ int main( int argc, char *argv[] )
 }
 
 int usage(char *argv0) {
-  cerr << "Usage: " << argv0 << " [-s decoder_state] [-o y4m_output] input_file" << endl;
+  cerr << "Usage: " << argv0 << " [-s decoder_state] [-o y4m_output] [-j threads] [-z] input_file" << endl;
   return EXIT_FAILURE;
 }
@@ -71,6 +71,7 @@ void usage_error( const string & program_name )
        << "                                         Each line specifies the target size"     << endl
        << "                                         in bytes for the corresponding frame."   << endl
        << " --two-pass                            Do the second encoding pass"               << endl
+       << " -j <arg>, --threads=<arg>             Threads to use per frame (default: 1)"     << endl
                                                                                              << endl
        << "Re-encode:"                                                                       << endl
        << " -r, --reencode                        Re-encode"                                 << endl
@@ -120,6 +121,7 @@ int main( int argc, char *argv[] )
     bool no_wait = false;
     Optional<uint8_t> y_ac_qi;
     EncoderQuality quality = BEST_QUALITY;
+    unsigned int thread_count = 1;
 
     EncoderMode encoder_mode = MINIMUM_SSIM;
 
@@ -140,11 +142,12 @@ int main( int argc, char *argv[] )
       { "quality",              required_argument, nullptr, 'q' },
       { "frame-sizes",          required_argument, nullptr, 'F' },
       { "no-wait",              no_argument,       nullptr, 'W' },
+      { "threads",              required_argument, nullptr, 'j' },
       { 0, 0, 0, 0 }
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "o:s:i:O:I:2y:p:S:rw:eq:F:W", command_line_options, nullptr );
+      const int opt = getopt_long( argc, argv, "o:s:i:O:I:2y:p:S:rw:eq:F:Wj:", command_line_options, nullptr );
 
       if ( opt == -1 ) {
         break;
@@ -218,6 +221,10 @@ int main( int argc, char *argv[] )
         encoder_mode = TARGET_FRAME_SIZE;
         break;
 
+      case 'j':
+        thread_count = stoul( optarg );
+        break;
+
       default:
         throw runtime_error( "getopt_long: unexpected return value." );
       }
@@ -312,8 +319,9 @@ int main( int argc, char *argv[] )
 
       Encoder encoder( EncoderStateDeserializer::build<Decoder>( input_state ),
                        two_pass, quality );
+      encoder.set_thread_count( thread_count );
 
-      output.set_expected_decoder_entry_hash( encoder.export_decoder().get_hash().hash() );
+      output.set_expected_decoder_entry_hash( encoder.export_decoder().minihash() );
 
       encoder.reencode( original_rasters, prediction_frames, kf_q_weight,
                         extra_frame_chunk, output );
@@ -331,9 +339,10 @@ int main( int argc, char *argv[] )
                    two_pass, quality )
         : Encoder( EncoderStateDeserializer::build<Decoder>( input_state ),
                    two_pass, quality );
+      encoder.set_thread_count( thread_count );
 
       if ( not input_state.empty() ) {
-        output.set_expected_decoder_entry_hash( encoder.export_decoder().get_hash().hash() );
+        output.set_expected_decoder_entry_hash( encoder.export_decoder().minihash() );
       }
 
       ifstream frame_sizes_if;
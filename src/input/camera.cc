@@ -120,25 +120,22 @@ Optional<RasterHandle> Camera::get_next_frame()
   case V4L2_PIX_FMT_YUYV:
     {
     uint8_t * src = mmap_region_->addr();
-    uint8_t * dst_y_start  = &raster.Y().at( 0, 0 );
-    uint8_t * dst_cb_start = &raster.U().at( 0, 0 );
-    uint8_t * dst_cr_start = &raster.V().at( 0, 0 );
 
-    const size_t y_plane_lenght = width_ * height_;
+    for ( size_t row = 0; row < height_; row++ ) {
+      uint8_t * dst_y_row = &raster.Y().at( 0, row );
 
-    for ( size_t i = 0; i < y_plane_lenght; i++ ) {
-      dst_y_start[ i ] = src[ i << 1 ];
+      for ( size_t column = 0; column < width_; column++ ) {
+        dst_y_row[ column ] = src[ ( row * width_ + column ) << 1 ];
+      }
     }
 
-    size_t i = 0;
-
-    for ( size_t row = 0; row < height_; row++ ) {
-      if ( row % 2 == 1 ) { continue; }
+    for ( size_t row = 0; row < height_; row += 2 ) {
+      uint8_t * dst_cb_row = &raster.U().at( 0, row / 2 );
+      uint8_t * dst_cr_row = &raster.V().at( 0, row / 2 );
 
       for ( size_t column = 0; column < width_ / 2; column++ ) {
-        dst_cb_start[ i ] = src[ row * width_ * 2 + column * 4 + 1 ];
-        dst_cr_start[ i ] = src[ row * width_ * 2 + column * 4 + 3 ];
-        i++;
+        dst_cb_row[ column ] = src[ row * width_ * 2 + column * 4 + 1 ];
+        dst_cr_row[ column ] = src[ row * width_ * 2 + column * 4 + 3 ];
       }
     }
   }
@@ -147,17 +144,21 @@ Optional<RasterHandle> Camera::get_next_frame()
 
   case V4L2_PIX_FMT_NV12:
     {
-      memcpy( &raster.Y().at( 0, 0 ), mmap_region_->addr(), width_ * height_ );
+      for ( size_t row = 0; row < height_; row++ ) {
+        memcpy( &raster.Y().at( 0, row ), mmap_region_->addr() + row * width_, width_ );
+      }
 
       uint8_t * src_chroma_start = mmap_region_->addr() + width_ * height_;
-      uint8_t * dst_cb_start = &raster.U().at( 0, 0 );
-      uint8_t * dst_cr_start = &raster.V().at( 0, 0 );
 
-      size_t chroma_length = width_ * height_ / 4;
+      for ( size_t row = 0; row < height_ / 2; row++ ) {
+        const uint8_t * src_chroma_row = src_chroma_start + row * width_;
+        uint8_t * dst_cb_row = &raster.U().at( 0, row );
+        uint8_t * dst_cr_row = &raster.V().at( 0, row );
 
-      for ( size_t i = 0; i < chroma_length; i++ ) {
-        dst_cb_start[ i ] = src_chroma_start[ 2 * i ];
-        dst_cr_start[ i ] = src_chroma_start[ 2 * i + 1 ];
+        for ( size_t column = 0; column < width_ / 2; column++ ) {
+          dst_cb_row[ column ] = src_chroma_row[ 2 * column ];
+          dst_cr_row[ column ] = src_chroma_row[ 2 * column + 1 ];
+        }
       }
     }
 
@@ -165,9 +166,18 @@ Optional<RasterHandle> Camera::get_next_frame()
 
   case V4L2_PIX_FMT_YUV420:
     {
-      memcpy( &raster.Y().at( 0, 0 ), mmap_region_->addr(), width_ * height_ );
-      memcpy( &raster.U().at( 0, 0 ), mmap_region_->addr() + width_ * height_, width_ * height_ / 4 );
-      memcpy( &raster.V().at( 0, 0 ), mmap_region_->addr() + width_ * height_ * 5 / 4, width_ * height_ / 4 );
+      const uint8_t * src_y = mmap_region_->addr();
+      const uint8_t * src_cb = src_y + width_ * height_;
+      const uint8_t * src_cr = src_y + width_ * height_ * 5 / 4;
+
+      for ( size_t row = 0; row < height_; row++ ) {
+        memcpy( &raster.Y().at( 0, row ), src_y + row * width_, width_ );
+      }
+
+      for ( size_t row = 0; row < height_ / 2; row++ ) {
+        memcpy( &raster.U().at( 0, row ), src_cb + row * width_ / 2, width_ / 2 );
+        memcpy( &raster.V().at( 0, row ), src_cr + row * width_ / 2, width_ / 2 );
+      }
     }
 
     break;
@@ -306,12 +306,47 @@ Optional<RasterHandle> YUV4MPEGReader::get_next_frame()
   return { move( raster ) };
 }
 
-void YUV4MPEGFrameWriter::write( const BaseRaster &rh, FileDescriptor &fd )
+vector<Chunk> YUV4MPEGFrameWriter::frame_chunks( const BaseRaster &rh )
 {
-  fd.write("FRAME\n");
+  static const string frame_header = "FRAME\n";
+
+  vector<Chunk> chunks { frame_header };
 
   // display_rectangle_as_planar returns Y, U, V chunks in row-major order
-  for ( const auto & chunk : rh.display_rectangle_as_planar() ) {
-    fd.write( chunk );
+  const vector<Chunk> planes = rh.display_rectangle_as_planar();
+  chunks.insert( chunks.end(), planes.begin(), planes.end() );
+
+  return chunks;
+}
+
+void YUV4MPEGFrameWriter::write( const BaseRaster &rh, FileDescriptor &fd )
+{
+  fd.write( frame_chunks( rh ) );
+}
+
+YUV4MPEGSplicingWriter::YUV4MPEGSplicingWriter( FileDescriptor & fd )
+  : fd_( fd )
+{
+  if ( not fd_.is_pipe() ) {
+    throw runtime_error( "vmsplice output needs a pipe" );
+  }
+}
+
+void YUV4MPEGSplicingWriter::write( const RasterHandle & raster )
+{
+  const vector<Chunk> chunks = YUV4MPEGFrameWriter::frame_chunks( raster );
+  fd_.vmsplice( chunks );
+
+  for ( const Chunk & chunk : chunks ) {
+    bytes_written_ += chunk.size();
+  }
+
+  in_flight_.emplace_back( raster, bytes_written_ );
+
+  /* the pipe can't hold more than its capacity, so anything further back
+     than that has been read */
+  const uint64_t capacity = fd_.pipe_capacity();
+  while ( not in_flight_.empty() and in_flight_.front().second + capacity <= bytes_written_ ) {
+    in_flight_.pop_front();
   }
 }
@@ -30,6 +30,9 @@
 #define YUV4MPEG_HH
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <utility>
 
 #include "frame_input.hh"
 #include "exception.hh"
@@ -92,7 +95,29 @@ public:
 class YUV4MPEGFrameWriter
 {
 public:
+  /* the frame header followed by the Y, U and V planes */
+  static std::vector<Chunk> frame_chunks( const BaseRaster &rh );
+
   static void write( const BaseRaster &rh, FileDescriptor &fd );
 };
 
+/* vmsplice()s frames into a pipe, so the pipe refers to the rasters' memory
+   instead of copying it. Each raster is held until a pipe's worth of data
+   has been written after it, by which time the reader has consumed it; a
+   reader that splices or tees the pages onward is not covered by this. */
+class YUV4MPEGSplicingWriter
+{
+private:
+  FileDescriptor & fd_;
+  uint64_t bytes_written_ { 0 };
+
+  /* rasters that may still be in the pipe, with bytes_written_ at their end */
+  std::deque<std::pair<RasterHandle, uint64_t>> in_flight_ {};
+
+public:
+  YUV4MPEGSplicingWriter( FileDescriptor & fd );
+
+  void write( const RasterHandle & raster );
+};
+
 #endif /* YUV4MPEG_HH */
@@ -29,6 +29,8 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <memory>
+#include <getopt.h>
 
 #include "yuv4mpeg.hh"
 #include "paranoid.hh"
@@ -37,7 +39,7 @@ using namespace std;
 
 void usage( const char *argv0 )
 {
-  cerr << "Usage: " << argv0 << " INPUT FPS" << endl;
+  cerr << "Usage: " << argv0 << " [-z] INPUT FPS" << endl;
 }
 
 int main( int argc, char *argv[] )
@@ -47,20 +49,46 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 3 ) {
+  /* -z: vmsplice the frames into stdout, which must be a pipe */
+  bool splice_output = false;
+
+  while ( true ) {
+    const int opt = getopt( argc, argv, "z" );
+
+    if ( opt == -1 ) {
+      break;
+    }
+
+    switch ( opt ) {
+    case 'z':
+      splice_output = true;
+      break;
+
+    default:
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ( argc - optind != 2 ) {
     usage( argv[ 0 ] );
     return EXIT_FAILURE;
   }
 
   /* open the YUV4MPEG input */
-  YUV4MPEGReader input { argv[ 1 ] };
+  YUV4MPEGReader input { argv[ optind ] };
 
   /* parse the # of frames per second of playback */
-  unsigned int frames_per_second = paranoid::stoul( argv[ 2 ] );
+  unsigned int frames_per_second = paranoid::stoul( argv[ optind + 1 ] );
 
   /* open the output */
   FileDescriptor stdout { STDOUT_FILENO };
 
+  unique_ptr<YUV4MPEGSplicingWriter> splicer;
+  if ( splice_output ) {
+    splicer.reset( new YUV4MPEGSplicingWriter( stdout ) );
+  }
+
   const auto interval_between_frames = chrono::microseconds( int( 1.0e6 / frames_per_second ) );
 
   auto next_frame_is_due = chrono::system_clock::now();
@@ -87,6 +115,10 @@ int main( int argc, char *argv[] )
     }
 
     /* send the frame */
-    YUV4MPEGFrameWriter::write( raster.get(), stdout );
+    if ( splicer ) {
+      splicer->write( raster.get() );
+    } else {
+      YUV4MPEGFrameWriter::write( raster.get(), stdout );
+    }
   }
 }
@@ -44,6 +44,7 @@
 #include "poller.hh"
 #include "optional.hh"
 #include "player.hh"
+#include "state_store.hh"
 #include "display.hh"
 #include "paranoid.hh"
 #include "procinfo.hh"
@@ -84,7 +85,19 @@ public:
 
 void usage( const char *argv0 )
 {
-  cerr << "Usage: " << argv0 << " [-f, --fullscreen] [--verbose] PORT WIDTH HEIGHT" << endl;
+  cerr << "Usage: " << argv0 << " [-f, --fullscreen] [--verbose] [--chain-states] PORT WIDTH HEIGHT" << endl;
+}
+
+/* decoder states are named by a hash of their contents, or with
+   --chain-states by Decoder::state_id(), which never touches the pixels.
+   the hash is built from the rasters' cached hashes rather than being the
+   minihash that IVF headers carry, which hashes every pixel again.
+   the sender has to be run the same way. */
+bool chain_states = false;
+
+uint32_t state_name( const Decoder & decoder )
+{
+  return static_cast<uint32_t>( chain_states ? decoder.state_id() : decoder.get_hash().hash() );
 }
 
 uint16_t ezrand()
@@ -148,6 +161,7 @@ int main( int argc, char *argv[] )
   const option command_line_options[] = {
     { "fullscreen", no_argument, nullptr, 'f' },
     { "verbose",    no_argument, nullptr, 'v' },
+    { "chain-states", no_argument, nullptr, 'c' },
     { 0, 0, 0, 0 }
   };
 
@@ -167,6 +181,10 @@ int main( int argc, char *argv[] )
       verbose = true;
       break;
 
+    case 'c':
+      chain_states = true;
+      break;
+
     default:
       usage( argv[ 0 ] );
       return EXIT_FAILURE;
@@ -202,10 +220,11 @@ int main( int argc, char *argv[] )
   AverageInterPacketDelay avg_delay;
 
   /* decoder states */
-  uint32_t current_state = player.current_decoder().get_hash().hash();
+  uint32_t current_state = state_name( player.current_decoder() );
   const uint32_t initial_state = current_state;
   deque<uint32_t> complete_states;
-  unordered_map<uint32_t, Decoder> decoders { { current_state, player.current_decoder() } };
+  StateStore decoders;
+  decoders.put( current_state, player.current_decoder(), true /* pinned */ );
 
   /* memory usage logs */
   system_clock::time_point next_mem_usage_report = system_clock::now();
@@ -239,7 +258,7 @@ int main( int argc, char *argv[] )
         }
 
         next_frame_no = packet.frame_no();
-        current_state = player.current_decoder().minihash();
+        current_state = state_name( player.current_decoder() );
       }
 
       /* add to current frame */
@@ -265,9 +284,9 @@ int main( int argc, char *argv[] )
         uint32_t expected_source_state = fragment.source_state();
 
         if ( current_state != expected_source_state ) {
-          if ( decoders.count( expected_source_state ) ) {
+          if ( decoders.contains( expected_source_state ) ) {
             /* we have this state! let's load it */
-            player.set_decoder( decoders.at( expected_source_state ) );
+            player.set_decoder( decoders.get( expected_source_state ) );
             current_state = expected_source_state;
           }
         }
@@ -296,12 +315,12 @@ int main( int argc, char *argv[] )
         enqueue_frame( player, fragment.frame() );
 
         // state "after" applying the frame
-        current_state = player.current_decoder().minihash();
+        current_state = state_name( player.current_decoder() );
 
         if ( current_state == fragment.target_state() and
              current_state != initial_state ) {
           /* this is a full state. let's save it */
-          decoders.insert( make_pair( current_state, player.current_decoder() ) );
+          decoders.put( current_state, player.current_decoder() );
           complete_states.push_back( current_state );
         }
 
@@ -46,6 +46,7 @@
 #include "paranoid.hh"
 #include "yuv4mpeg.hh"
 #include "encoder.hh"
+#include "state_store.hh"
 #include "socket.hh"
 #include "packet.hh"
 #include "poller.hh"
@@ -90,21 +91,26 @@ public:
 
 struct EncodeJob
 {
-  string name;
-
   RasterHandle raster;
 
   Encoder encoder;
   EncoderMode mode;
 
-  uint8_t y_ac_qi;
+  /* one output per variant, named and with its quantizer. the variants of
+     a job share a single motion search. a TARGET_FRAME_SIZE job has exactly
+     one variant, which only names the output; its quantizer is unused. */
+  vector<pair<string, uint8_t>> variants;
   size_t target_size;
 
-  EncodeJob( const string & name, RasterHandle raster, const Encoder & encoder,
-             const EncoderMode mode, const uint8_t y_ac_qi, const size_t target_size )
-    : name( name ), raster( raster ), encoder( encoder ),
-      mode( mode ), y_ac_qi( y_ac_qi ), target_size( target_size )
-  {}
+  EncodeJob( RasterHandle raster, const Encoder & encoder, const EncoderMode mode,
+             const vector<pair<string, uint8_t>> & variants, const size_t target_size )
+    : raster( raster ), encoder( encoder ),
+      mode( mode ), variants( variants ), target_size( target_size )
+  {
+    if ( variants.empty() or ( mode == TARGET_FRAME_SIZE and variants.size() != 1 ) ) {
+      throw runtime_error( "an encode job needs one variant, or for a constant quantizer at least one" );
+    }
+  }
 };
 
 struct EncodeOutput
@@ -125,27 +131,50 @@ struct EncodeOutput
   {}
 };
 
-EncodeOutput do_encode_job( EncodeJob && encode_job )
+/* decoder states are named by a hash of their contents, or with
+   --chain-states by Decoder::state_id(), which never touches the pixels.
+   the hash is built from the rasters' cached hashes rather than being the
+   minihash that IVF headers carry, which hashes every pixel again.
+   the receiver has to be run the same way. */
+bool chain_states = false;
+
+uint32_t state_name( const Encoder & encoder )
 {
-  vector<uint8_t> output;
+  return static_cast<uint32_t>( chain_states ? encoder.state_id() : encoder.get_hash().hash() );
+}
 
-  uint32_t source_minihash = encode_job.encoder.minihash();
+vector<EncodeOutput> do_encode_job( EncodeJob && encode_job )
+{
+  vector<pair<Encoder, vector<uint8_t>>> frames;
 
-  const auto encode_beginning = system_clock::now();
+  uint32_t source_minihash = state_name( encode_job.encoder );
 
-  uint8_t quantizer_in_use = 0;
+  const auto encode_beginning = system_clock::now();
 
   switch ( encode_job.mode ) {
   case CONSTANT_QUANTIZER:
-    output = encode_job.encoder.encode_with_quantizer( encode_job.raster.get(),
-                                                       encode_job.y_ac_qi );
-    quantizer_in_use = encode_job.y_ac_qi;
+    if ( encode_job.variants.size() == 1 ) {
+      vector<uint8_t> output = encode_job.encoder.encode_with_quantizer( encode_job.raster.get(),
+                                                                         encode_job.variants.front().second );
+      frames.emplace_back( move( encode_job.encoder ), move( output ) );
+    }
+    else {
+      vector<uint8_t> y_ac_qis;
+      for ( const auto & variant : encode_job.variants ) {
+        y_ac_qis.push_back( variant.second );
+      }
+
+      frames = encode_job.encoder.encode_with_quantizers( encode_job.raster.get(), y_ac_qis );
+    }
     break;
 
   case TARGET_FRAME_SIZE:
-    output = encode_job.encoder.encode_with_target_size( encode_job.raster.get(),
-                                                         encode_job.target_size );
+  {
+    vector<uint8_t> output = encode_job.encoder.encode_with_target_size( encode_job.raster.get(),
+                                                                         encode_job.target_size );
+    frames.emplace_back( move( encode_job.encoder ), move( output ) );
     break;
+  }
 
   default:
     throw runtime_error( "unsupported encoding mode." );
@@ -154,7 +183,19 @@ EncodeOutput do_encode_job( EncodeJob && encode_job )
   const auto encode_ending = system_clock::now();
   const auto ms_elapsed = duration_cast<milliseconds>( encode_ending - encode_beginning );
 
-  return { move( encode_job.encoder ), move( output ), source_minihash, ms_elapsed, encode_job.name, quantizer_in_use };
+  vector<EncodeOutput> outputs;
+  outputs.reserve( frames.size() );
+
+  for ( size_t i = 0; i < frames.size(); i++ ) {
+    const uint8_t quantizer_in_use = ( encode_job.mode == CONSTANT_QUANTIZER )
+                                     ? encode_job.variants.at( i ).second : 0;
+
+    outputs.emplace_back( move( frames.at( i ).first ), move( frames.at( i ).second ),
+                          source_minihash, ms_elapsed,
+                          encode_job.variants.at( i ).first, quantizer_in_use );
+  }
+
+  return outputs;
 }
 
 size_t target_size( uint32_t avg_delay, const uint64_t last_acked, const uint64_t last_sent,
@@ -173,7 +214,8 @@ void usage( const char *argv0 )
 {
   cerr << "Usage: " << argv0
        << " [-m,--mode MODE] [-d, --device CAMERA] [-p, --pixfmt PIXEL_FORMAT]"
-       << " [-u,--update-rate RATE] [--log-mem-usage] HOST PORT CONNECTION_ID" << endl
+       << " [-u,--update-rate RATE] [--log-mem-usage] [--chain-states]"
+       << " [--state-budget MB] [-j,--threads THREADS] HOST PORT CONNECTION_ID" << endl
        << endl
        << "Accepted MODEs are s1, s2 (default), conventional." << endl;
 }
@@ -204,6 +246,8 @@ int main( int argc, char *argv[] )
   size_t update_rate __attribute__((unused)) = 1;
   OperationMode operation_mode = OperationMode::S2;
   bool log_mem_usage = false;
+  size_t state_budget = numeric_limits<size_t>::max();
+  unsigned int thread_count = 1;
 
   const option command_line_options[] = {
     { "mode",          required_argument, nullptr, 'm' },
@@ -211,11 +255,14 @@ int main( int argc, char *argv[] )
     { "pixfmt",        required_argument, nullptr, 'p' },
     { "update-rate",   required_argument, nullptr, 'u' },
     { "log-mem-usage", no_argument,       nullptr, 'M' },
+    { "chain-states",  no_argument,       nullptr, 'c' },
+    { "state-budget",  required_argument, nullptr, 'b' },
+    { "threads",       required_argument, nullptr, 'j' },
     { 0, 0, 0, 0 }
   };
 
   while ( true ) {
-    const int opt = getopt_long( argc, argv, "d:p:m:u:", command_line_options, nullptr );
+    const int opt = getopt_long( argc, argv, "d:p:m:u:j:", command_line_options, nullptr );
 
     if ( opt == -1 ) { break; }
 
@@ -243,6 +290,18 @@ int main( int argc, char *argv[] )
       log_mem_usage = true;
       break;
 
+    case 'c':
+      chain_states = true;
+      break;
+
+    case 'b':
+      state_budget = paranoid::stoul( optarg ) * 1024 * 1024;
+      break;
+
+    case 'j':
+      thread_count = paranoid::stoul( optarg );
+      break;
+
     default:
       usage( argv[ 0 ] );
       return EXIT_FAILURE;
@@ -287,7 +346,10 @@ int main( int argc, char *argv[] )
   Encoder base_encoder { camera.display_width(), camera.display_height(),
                          false /* two-pass */, REALTIME_QUALITY };
 
-  const uint32_t initial_state = base_encoder.minihash();
+  /* threads per encode job */
+  base_encoder.set_thread_count( thread_count );
+
+  const uint32_t initial_state = state_name( base_encoder );
 
   /* encoded frame index */
   unsigned int frame_no = 0;
@@ -297,7 +359,7 @@ int main( int argc, char *argv[] )
 
   /* where we keep the outputs of parallel encoding jobs */
   vector<EncodeJob> encode_jobs;
-  vector<future<EncodeOutput>> encode_outputs;
+  vector<future<vector<EncodeOutput>>> encode_outputs;
 
   /* keep the moving average of encoding times */
   AverageEncodingTime avg_encoding_time;
@@ -305,9 +367,18 @@ int main( int argc, char *argv[] )
   /* track the last quantizer used */
   uint8_t last_quantizer = 64;
 
-  /* decoder hash => encoder object */
+  /* decoder hash => decoder state the receiver may be in. the states past
+     the budget are dropped, oldest first; the initial state and the state
+     the receiver last acked are pinned, so they never are. */
   deque<uint32_t> encoder_states;
-  unordered_map<uint32_t, Encoder> encoders { { initial_state, base_encoder } };
+  StateStore encoders { state_budget };
+  encoders.put( initial_state, base_encoder.export_decoder(), true /* pinned */ );
+
+  /* the encoder of the last state sent is kept as it is, since it also
+     remembers the loop filter level it last used. the others (apart from
+     the initial state's) are rebuilt from their decoder state. */
+  uint32_t newest_state = initial_state;
+  Encoder newest_encoder = base_encoder;
 
   /* latest state of the receiver, based on ack packets */
   Optional<uint32_t> receiver_last_acked_state;
@@ -357,7 +428,7 @@ int main( int argc, char *argv[] )
       /* let's cleanup the stored encoders based on the lastest ack */
       if ( receiver_last_acked_state.initialized() and
            receiver_last_acked_state.get() != initial_state and
-           encoders.count( receiver_last_acked_state.get() ) ) {
+           encoders.contains( receiver_last_acked_state.get() ) ) {
         // cleaning up
         auto it = encoder_states.begin();
 
@@ -412,7 +483,19 @@ int main( int argc, char *argv[] )
         }
       }
       else {
-        if ( encoders.count( receiver_last_acked_state.get() ) == 0 ) {
+        if ( not encoders.contains( receiver_last_acked_state.get() ) and
+             find( encoder_states.begin(), encoder_states.end(),
+                   receiver_last_acked_state.get() ) != encoder_states.end() ) {
+          /* the receiver is in a state we sent, but it went over the budget
+             before its ack came back; use a state the receiver is sure to have */
+          if( receiver_complete_states.size() == 0 ) {
+            selected_source_hash = initial_state;
+          }
+          else {
+            selected_source_hash = receiver_complete_states.back();
+          }
+        }
+        else if ( not encoders.contains( receiver_last_acked_state.get() ) ) {
           /* it seems that the receiver is in an invalid state */
 
           /* step 1: let's go into 'conservative' mode; just encode based on a
@@ -439,7 +522,25 @@ int main( int argc, char *argv[] )
         }
       }
       /* end of encoder selection logic */
-      const Encoder & encoder = encoders.at( selected_source_hash );
+
+      if ( selected_source_hash != newest_state and
+           not encoders.contains( selected_source_hash ) ) {
+        /* it went over the budget */
+        selected_source_hash = initial_state;
+      }
+
+      /* base_encoder still has to start with a key frame */
+      Optional<Encoder> restored_encoder;
+
+      if ( selected_source_hash != newest_state and selected_source_hash != initial_state ) {
+        restored_encoder.initialize( encoders.get( selected_source_hash ),
+                                     false /* two-pass */, REALTIME_QUALITY );
+        restored_encoder.get().set_thread_count( thread_count );
+      }
+
+      const Encoder & encoder = restored_encoder.initialized() ? restored_encoder.get()
+                              : ( selected_source_hash == newest_state ) ? newest_encoder
+                              : base_encoder;
 
       const static auto increment_quantizer = []( const uint16_t q, const int8_t inc ) -> uint8_t
         {
@@ -484,16 +585,18 @@ int main( int argc, char *argv[] )
           next_cc_update = system_clock::now() + cc_update_interval;
         }
 
-        encode_jobs.emplace_back( "frame", raster, encoder, CONSTANT_QUANTIZER,
-                                  cc_quantizer, 0  );
+        encode_jobs.emplace_back( raster, encoder, CONSTANT_QUANTIZER,
+                                  vector<pair<string, uint8_t>> { { "frame", cc_quantizer } }, 0 );
       }
       else {
-        /* try various quantizers */
-        encode_jobs.emplace_back( "improve", raster, encoder, CONSTANT_QUANTIZER,
-                                  increment_quantizer( last_quantizer, -17 ), 0 );
-
-        encode_jobs.emplace_back( "fail-small", raster, encoder, CONSTANT_QUANTIZER,
-                                  increment_quantizer( last_quantizer, +23 ), 0 );
+        /* try various quantizers, in one job so they share the motion
+           search. both outputs come from the same future, so they are
+           ready, or lost, together. */
+        encode_jobs.emplace_back( raster, encoder, CONSTANT_QUANTIZER,
+                                  vector<pair<string, uint8_t>> {
+                                    { "improve", increment_quantizer( last_quantizer, -17 ) },
+                                    { "fail-small", increment_quantizer( last_quantizer, +23 ) } },
+                                  0 );
       }
 
       // this thread will spawn all the encoding jobs and will wait on the results
@@ -539,7 +642,7 @@ int main( int argc, char *argv[] )
       avg_encoding_time.add( duration_cast<microseconds>( system_clock::now().time_since_epoch() ) );
 
       if ( not any_of( encode_outputs.cbegin(), encode_outputs.cend(),
-                       [&]( const future<EncodeOutput> & o ) { return o.valid(); } ) ) {
+                       [&]( const future<vector<EncodeOutput>> & o ) { return o.valid(); } ) ) {
         cerr << "All encoding jobs got killed for frame " << frame_no << "\n";
         // no encoding job has ended in time
         return ResultType::Continue;
@@ -560,7 +663,9 @@ int main( int argc, char *argv[] )
 
       for ( auto & out_future : encode_outputs ) {
         if ( out_future.valid() ) {
-          good_outputs.push_back( move( out_future.get() ) );
+          for ( auto & output : out_future.get() ) {
+            good_outputs.push_back( move( output ) );
+          }
         }
       }
 
@@ -597,7 +702,7 @@ int main( int argc, char *argv[] )
 
       auto output = move( good_outputs[ best_output_index ] );
 
-      uint32_t target_minihash = output.encoder.minihash();
+      uint32_t target_minihash = state_name( output.encoder );
 
       /*
       cerr << "Sending frame #" << frame_no << " (size=" << output.frame.size() << " bytes, "
@@ -645,9 +750,12 @@ int main( int argc, char *argv[] )
       /* now we assume that the receiver will successfully get this */
       receiver_assumed_state.reset( target_minihash );
 
-      encoders.insert( make_pair( target_minihash, move( output.encoder ) ) );
+      encoders.put( target_minihash, output.encoder.export_decoder() );
       encoder_states.push_back( target_minihash );
 
+      newest_state = target_minihash;
+      newest_encoder = move( output.encoder );
+
       skipped_count = 0;
       frame_no++;
 
@@ -677,6 +785,15 @@ int main( int argc, char *argv[] )
 
       last_acked = this_ack_seq;
       avg_delay = ack.avg_delay();
+
+      /* move the pin from the previously acked state to this one */
+      if ( receiver_last_acked_state.initialized() and
+           receiver_last_acked_state.get() != initial_state and
+           receiver_last_acked_state.get() != ack.current_state() ) {
+        encoders.set_pinned( receiver_last_acked_state.get(), false );
+      }
+      encoders.set_pinned( ack.current_state(), true );
+
       receiver_last_acked_state.reset( ack.current_state() );
       receiver_complete_states = move( ack.complete_states() );
 
@@ -27,6 +27,7 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <iostream>
+#include <getopt.h>
 
 #include "player.hh"
 
@@ -35,12 +36,33 @@ using namespace std;
 int main( int argc, char *argv[] )
 {
   try {
-    if ( argc != 2 ) {
-      cerr << "Usage: " << argv[ 0 ] << " FILENAME" << endl;
+    unsigned int thread_count = 1;
+
+    while ( true ) {
+      const int opt = getopt( argc, argv, "j:" );
+
+      if ( opt == -1 ) {
+        break;
+      }
+
+      switch ( opt ) {
+      case 'j':
+        thread_count = stoul( optarg );
+        break;
+
+      default:
+        cerr << "Usage: " << argv[ 0 ] << " [-j THREADS] FILENAME" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if ( optind != argc - 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << " [-j THREADS] FILENAME" << endl;
       return EXIT_FAILURE;
     }
 
-    Player player( argv[ 1 ] );
+    Player player( argv[ optind ] );
+    player.set_thread_count( thread_count );
 
     while ( not player.eof() ) {
       RasterHandle raster = player.advance();
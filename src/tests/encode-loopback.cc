@@ -27,11 +27,14 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <random>
+#include <cmath>
 
 #include "exception.hh"
 #include "bool_decoder.hh"
 #include "bool_encoder.hh"
 #include "modemv_data.hh"
+#include "encoder.hh"
+#include "player.hh"
 
 #include "tree.cc"
 #include "encode_tree.cc"
@@ -50,6 +53,203 @@ vector< uint8_t > encode( const vector< pair< Probability, bool > > & bitlist )
   return encoder.finish();
 }
 
+size_t count( const vector< pair< Probability, bool > > & bitlist )
+{
+  BoolEncoder encoder { BoolEncoder::COUNT_ONLY };
+
+  for ( const auto & x : bitlist ) {
+    encoder.put( x.second, x.first );
+  }
+
+  return encoder.finish_size();
+}
+
+/* a moving pattern with some noise, so inter frames have motion to find */
+void fill_frame( VP8Raster & raster, const unsigned int frame_no, default_random_engine & gen )
+{
+  uniform_int_distribution< int > noise( 0, 6 );
+
+  raster.Y().forall_ij( [&] ( uint8_t & pixel, const unsigned int column, const unsigned int row )
+                        { pixel = 128 + 60 * sin( ( column + 3.0 * frame_no ) / 9.0 )
+                                  + 20 * cos( row / 11.0 ) + noise( gen ); } );
+  raster.U().forall_ij( [&] ( uint8_t & pixel, const unsigned int column, const unsigned int )
+                        { pixel = 128 + 40 * sin( ( column + frame_no ) / 7.0 ); } );
+  raster.V().forall_ij( [&] ( uint8_t & pixel, const unsigned int, const unsigned int row )
+                        { pixel = 128 + 40 * cos( ( row + frame_no ) / 5.0 ); } );
+}
+
+/* serialized_size() has to count exactly the bytes that serialize() writes,
+   for a key frame or an inter frame, and with any number of DCT partitions */
+template<class FrameType>
+bool check_serialized_size( DecoderState & decoder_state, const vector< uint8_t > & compressed_frame )
+{
+  const FrameType parsed_frame = decoder_state.parse_and_apply<FrameType>(
+    UncompressedChunk( Chunk( compressed_frame.data(), compressed_frame.size() ),
+                       decoder_state.width, decoder_state.height, false ) );
+
+  for ( const unsigned int thread_count : { 1, 4 } ) {
+    const size_t counted = parsed_frame.serialized_size( decoder_state.probability_tables, thread_count );
+    const size_t written = parsed_frame.serialize( decoder_state.probability_tables, thread_count ).size();
+
+    if ( counted != written or written != compressed_frame.size() ) {
+      cerr << "a frame of " << compressed_frame.size() << " bytes in "
+           << int( parsed_frame.dct_partition_count() ) << " partitions serializes to "
+           << written << " bytes, but serialized_size() counts " << counted << endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool check_serialized_size( DecoderState & decoder_state, const vector< uint8_t > & compressed_frame )
+{
+  const UncompressedChunk uncompressed_frame( Chunk( compressed_frame.data(), compressed_frame.size() ),
+                                              decoder_state.width, decoder_state.height, false );
+
+  if ( uncompressed_frame.key_frame() ) {
+    return check_serialized_size<KeyFrame>( decoder_state, compressed_frame );
+  } else {
+    return check_serialized_size<InterFrame>( decoder_state, compressed_frame );
+  }
+}
+
+/* encoding macroblock rows on several threads writes one partition per
+   thread, but has to decode to the same frames, with the same probability
+   tables, as encoding on one */
+bool check_threaded_encode( default_random_engine & gen )
+{
+  const uint16_t width = 176, height = 144;
+
+  Encoder serial_encoder( width, height, false, REALTIME_QUALITY );
+  Encoder threaded_encoder( width, height, false, REALTIME_QUALITY );
+  threaded_encoder.set_thread_count( 4 );
+
+  FramePlayer serial_player( width, height );
+  FramePlayer threaded_player( width, height );
+
+  DecoderState serial_state( width, height );
+  DecoderState threaded_state( width, height );
+
+  uniform_int_distribution< unsigned int > quantizers( 4, 100 );
+
+  for ( unsigned int frame_no = 0; frame_no < 8; frame_no++ ) {
+    MutableRasterHandle raster( width, height );
+    fill_frame( raster.get(), frame_no, gen );
+
+    const uint8_t quantizer = quantizers( gen );
+
+    const vector< uint8_t > serial_frame = serial_encoder.encode_with_quantizer( raster.get(), quantizer );
+    const vector< uint8_t > threaded_frame = threaded_encoder.encode_with_quantizer( raster.get(), quantizer );
+
+    const Optional< RasterHandle > serial_output = serial_player.decode( Chunk( serial_frame.data(), serial_frame.size() ) );
+    const Optional< RasterHandle > threaded_output = threaded_player.decode( Chunk( threaded_frame.data(), threaded_frame.size() ) );
+
+    if ( not serial_output.initialized() or not threaded_output.initialized() ) {
+      cerr << "frame " << frame_no << " was not shown" << endl;
+      return false;
+    }
+
+    if ( serial_output.get().hash() != threaded_output.get().hash() ) {
+      cerr << "frame " << frame_no << " at quantizer " << int( quantizer )
+           << " decodes differently when encoded on 4 threads" << endl;
+      return false;
+    }
+
+    if ( serial_player.current_state() != threaded_player.current_state() ) {
+      cerr << "frame " << frame_no << " at quantizer " << int( quantizer )
+           << " leaves different probability tables when encoded on 4 threads" << endl;
+      return false;
+    }
+
+    if ( serial_player.current_decoder().minihash() != threaded_encoder.minihash()
+         or serial_encoder.minihash() != threaded_encoder.minihash() ) {
+      cerr << "frame " << frame_no << ": the encoders' states differ" << endl;
+      return false;
+    }
+
+    if ( not check_serialized_size( serial_state, serial_frame )
+         or not check_serialized_size( threaded_state, threaded_frame ) ) {
+      cerr << "frame " << frame_no << ": serialized_size() is wrong" << endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* encode_with_quantizers() shares one motion search between the variants,
+   but each variant has to decode to its encoder's state, and a single
+   variant has to be exactly encode_with_quantizer() */
+bool check_encode_with_quantizers( default_random_engine & gen, const unsigned int thread_count )
+{
+  const uint16_t width = 176, height = 144;
+
+  Encoder encoder( width, height, false, REALTIME_QUALITY );
+  encoder.set_thread_count( thread_count );
+
+  FramePlayer player( width, height );
+
+  uniform_int_distribution< unsigned int > quantizers( 4, 100 );
+
+  for ( unsigned int frame_no = 0; frame_no < 6; frame_no++ ) {
+    MutableRasterHandle raster( width, height );
+    fill_frame( raster.get(), frame_no, gen );
+
+    const vector< uint8_t > y_ac_qis { uint8_t( quantizers( gen ) ), uint8_t( quantizers( gen ) ) };
+
+    Encoder single_encoder = encoder;
+    const vector< uint8_t > single_frame = single_encoder.encode_with_quantizer( raster.get(), y_ac_qis.front() );
+
+    const auto single_variant = encoder.encode_with_quantizers( raster.get(), { y_ac_qis.front() } );
+    if ( single_variant.size() != 1 or single_variant.front().second != single_frame ) {
+      cerr << "frame " << frame_no << ": one variant differs from encode_with_quantizer()" << endl;
+      return false;
+    }
+
+    auto variants = encoder.encode_with_quantizers( raster.get(), y_ac_qis );
+    if ( variants.size() != y_ac_qis.size() ) {
+      cerr << "frame " << frame_no << ": expected " << y_ac_qis.size() << " variants" << endl;
+      return false;
+    }
+
+    vector< FramePlayer > variant_players;
+
+    for ( unsigned int i = 0; i < variants.size(); i++ ) {
+      const Encoder & variant_encoder = variants.at( i ).first;
+      const vector< uint8_t > & variant_frame = variants.at( i ).second;
+
+      variant_players.push_back( player );
+      FramePlayer & variant_player = variant_players.back();
+
+      const Optional< RasterHandle > output = variant_player.decode( Chunk( variant_frame.data(), variant_frame.size() ) );
+
+      const Decoder expected = variant_encoder.export_decoder();
+
+      if ( variant_player.current_state() != expected.get_state()
+           or variant_player.current_decoder().minihash() != variant_encoder.minihash() ) {
+        cerr << "frame " << frame_no << ", variant at quantizer " << int( y_ac_qis.at( i ) )
+             << ": the decoder's state differs from the encoder's" << endl;
+        return false;
+      }
+
+      const VP8Raster & last_reference = expected.get_references().last;
+      if ( not output.initialized() or not ( output.get().get() == last_reference ) ) {
+        cerr << "frame " << frame_no << ", variant at quantizer " << int( y_ac_qis.at( i ) )
+             << ": decodes to a different raster than the encoder's last reference" << endl;
+        return false;
+      }
+    }
+
+    /* go on from either variant */
+    const unsigned int chosen = frame_no % variants.size();
+    encoder = move( variants.at( chosen ).first );
+    player = variant_players.at( chosen );
+  }
+
+  return true;
+}
+
 int main( int argc, char *argv[] )
 {
   try {
@@ -73,6 +273,11 @@ int main( int argc, char *argv[] )
 
       const auto encoded_string = encode( bitlist );
 
+      if ( count( bitlist ) != encoded_string.size() ) {
+        cerr << "counted " << count( bitlist ) << " bytes, encoded " << encoded_string.size() << endl;
+        return EXIT_FAILURE;
+      }
+
       BoolDecoder decoder( Chunk( &encoded_string.front(), encoded_string.size() ) );
 
       for ( const auto & x : bitlist ) {
@@ -110,7 +315,21 @@ int main( int argc, char *argv[] )
         }
       }
     }
-    
+
+    /* And whole frames, on one thread and on several */
+    for ( unsigned int trial = 0; trial < 4; trial++ ) {
+      if ( not check_threaded_encode( gen ) ) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    /* And several quantizers of one frame, sharing the motion search */
+    for ( const unsigned int thread_count : { 1, 2 } ) {
+      if ( not check_encode_with_quantizers( gen, thread_count ) ) {
+        return EXIT_FAILURE;
+      }
+    }
+
   } catch ( const exception & e ) {
     print_exception( argv[ 0 ], e );
     return EXIT_FAILURE;
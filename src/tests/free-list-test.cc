@@ -0,0 +1,283 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "exception.hh"
+#include "free_list.hh"
+
+using namespace std;
+
+/* counts the live objects, and catches an object handed to two takers */
+class Counted
+{
+private:
+  unsigned int width_, height_;
+
+public:
+  static atomic<int> live;
+
+  atomic<bool> in_use { true };
+
+  Counted( const unsigned int width, const unsigned int height )
+    : width_( width ), height_( height )
+  {
+    live++;
+  }
+
+  ~Counted() { live--; }
+
+  unsigned int display_width() const { return width_; }
+  unsigned int display_height() const { return height_; }
+
+  Counted( const Counted & other ) = delete;
+  Counted & operator=( const Counted & other ) = delete;
+};
+
+atomic<int> Counted::live { 0 };
+
+static const size_t OBJECT_BYTES = 1000;
+
+size_t object_bytes( const Counted & )
+{
+  return OBJECT_BYTES;
+}
+
+void check( const bool condition, const string & what )
+{
+  if ( not condition ) {
+    throw runtime_error( "check failed: " + what );
+  }
+}
+
+template <class Pool>
+Counted * take_one( Pool & pool )
+{
+  Counted * object = pool.take();
+
+  if ( object == nullptr ) {
+    return new Counted( 16, 16 );
+  }
+
+  check( not object->in_use.exchange( true ), "an object was handed out twice" );
+  return object;
+}
+
+template <class Pool>
+void give_one( Pool & pool, Counted * object )
+{
+  object->in_use = false;
+  pool.give( object );
+}
+
+/* threads take and give back at random, keeping a few objects each */
+void concurrent_give_take( const unsigned int thread_count, const unsigned int rounds )
+{
+  {
+    FreeList<Counted> list;
+    vector<thread> threads;
+    atomic<bool> failed { false };
+
+    for ( unsigned int t = 0; t < thread_count; t++ ) {
+      threads.emplace_back(
+        [&list, &failed, t, rounds]()
+        {
+          try {
+            default_random_engine rng { t };
+            vector<Counted *> held;
+
+            for ( unsigned int i = 0; i < rounds; i++ ) {
+              if ( held.size() < 32 and ( held.empty() or rng() % 2 ) ) {
+                held.push_back( take_one( list ) );
+              } else {
+                const size_t which = rng() % held.size();
+                give_one( list, held.at( which ) );
+                held.erase( held.begin() + which );
+              }
+            }
+
+            for ( Counted * object : held ) {
+              give_one( list, object );
+            }
+          } catch ( const exception & e ) {
+            print_exception( "free-list-test", e );
+            failed = true;
+          }
+        } );
+    }
+
+    for ( thread & t : threads ) {
+      t.join();
+    }
+
+    check( not failed, "concurrent give and take" );
+
+    /* the threads' caches went back to the list when they exited */
+    const PoolStats stats = list.stats();
+    check( stats.misses == static_cast<uint64_t>( Counted::live ),
+           "one object made per miss" );
+    check( list.shared_size() == static_cast<size_t>( Counted::live ),
+           "every object made is back in the list" );
+  }
+
+  check( Counted::live == 0, "the list deletes its objects" );
+}
+
+/* other threads still cache objects of a list when it is destroyed. one of
+   them then exits, and the other goes on to use a new list. */
+void destroy_while_cached()
+{
+  unique_ptr<FreeList<Counted>> list { new FreeList<Counted> };
+
+  mutex lock_;
+  condition_variable changed;
+  unsigned int cached = 0;
+  bool destroyed = false;
+
+  auto worker = [&]( const bool use_another_list )
+    {
+      for ( unsigned int i = 0; i < 3; i++ ) {
+        give_one( *list, new Counted( 16, 16 ) );
+      }
+
+      unique_lock<mutex> lock { lock_ };
+      cached++;
+      changed.notify_all();
+      changed.wait( lock, [&]() { return destroyed; } );
+      lock.unlock();
+
+      if ( use_another_list ) {
+        FreeList<Counted> another;
+        give_one( another, new Counted( 16, 16 ) );
+      }
+    };
+
+  thread exits { worker, false };
+  thread goes_on { worker, true };
+
+  {
+    unique_lock<mutex> lock { lock_ };
+    changed.wait( lock, [&]() { return cached == 2; } );
+  }
+
+  /* three objects in each thread's cache, none in the shared stack */
+  check( list->shared_size() == 0, "small gifts stay in the giving thread" );
+  list.reset();
+
+  {
+    unique_lock<mutex> lock { lock_ };
+    destroyed = true;
+    changed.notify_all();
+  }
+
+  exits.join();
+  goes_on.join();
+
+  check( Counted::live == 0, "cached objects of a destroyed list are deleted" );
+}
+
+/* giving back more than the budget trims, least recently used size first */
+void budget_trimming()
+{
+  {
+    SizeClassPool<Counted> pool { object_bytes };
+    pool.set_budget( 10 * OBJECT_BYTES );
+
+    vector<Counted *> objects;
+    for ( unsigned int i = 0; i < 64; i++ ) {
+      objects.push_back( new Counted( 16, 16 ) );
+    }
+
+    for ( Counted * object : objects ) {
+      object->in_use = false;
+      pool.give( object );
+      check( pool.idle_bytes() <= pool.budget(), "idle bytes stay within the budget" );
+    }
+
+    check( Counted::live < 64, "objects beyond the budget are deleted" );
+
+    /* a second size, used after the first */
+    this_thread::sleep_for( chrono::milliseconds( 5 ) );
+    for ( unsigned int i = 0; i < 8; i++ ) {
+      pool.give( new Counted( 32, 32 ) );
+    }
+
+    const int before = Counted::live;
+    pool.set_budget( 4 * OBJECT_BYTES );
+    check( pool.idle_bytes() <= 4 * OBJECT_BYTES, "a lower budget trims at once" );
+    check( Counted::live < before, "lowering the budget deletes objects" );
+
+    /* a new thread has no cache of its own, so this comes from the shared stack */
+    bool kept = false;
+    thread taker { [&pool, &kept]()
+        {
+          Counted * object = pool.take( 32, 32 );
+          kept = object != nullptr;
+          if ( kept ) {
+            pool.give( object );
+          }
+        } };
+    taker.join();
+    check( kept, "the most recently used size is trimmed last" );
+
+    pool.trim();
+    check( pool.idle_bytes() == 0, "trim() empties the shared stacks" );
+    check( Counted::live == 0, "trim() also empties this thread's caches" );
+  }
+
+  check( Counted::live == 0, "nothing is left after the pool is destroyed" );
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    concurrent_give_take( 4, 100000 );
+    destroy_while_cached();
+    budget_trimming();
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
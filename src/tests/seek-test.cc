@@ -0,0 +1,147 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "exception.hh"
+#include "player.hh"
+
+using namespace std;
+
+/* what advance() should return after seek() to each frame of the file:
+   the first frame shown at or after it */
+vector<RasterHandle> decode_in_order( const string & filename );
+
+void check_seek( FilePlayer & player, const unsigned int frame_no,
+                 const vector<RasterHandle> & expected, const string & how );
+
+vector<unsigned int> targets( const unsigned int frame_count );
+
+vector<RasterHandle> decode_in_order( const string & filename )
+{
+  FilePlayer player { filename };
+  vector<Optional<RasterHandle>> shown;
+
+  while ( not player.eof() ) {
+    RasterHandle raster = player.advance();
+    shown.resize( player.cur_frame_no() + 1 );
+    shown.back().initialize( raster );
+  }
+
+  vector<RasterHandle> expected;
+  Optional<RasterHandle> next_shown;
+  for ( auto frame = shown.rbegin(); frame != shown.rend(); frame++ ) {
+    if ( frame->initialized() ) {
+      next_shown.reset( frame->get() );
+    }
+
+    if ( not next_shown.initialized() ) {
+      throw runtime_error( filename + ": no frame shown at the end of the file" );
+    }
+
+    expected.insert( expected.begin(), next_shown.get() );
+  }
+
+  return expected;
+}
+
+void check_seek( FilePlayer & player, const unsigned int frame_no,
+                 const vector<RasterHandle> & expected, const string & how )
+{
+  player.seek( frame_no );
+
+  const VP8Raster & decoded = player.advance();
+  const VP8Raster & wanted = expected.at( frame_no );
+
+  if ( not ( decoded == wanted ) ) {
+    throw runtime_error( "seek to frame " + to_string( frame_no ) + " " + how
+                         + " gave a different raster than decoding up to it" );
+  }
+}
+
+/* at most 16 frames, last first, so that every seek goes backwards */
+vector<unsigned int> targets( const unsigned int frame_count )
+{
+  const unsigned int step = ( frame_count + 15 ) / 16;
+
+  vector<unsigned int> ret;
+  for ( unsigned int frame_no = frame_count - 1; frame_no < frame_count; frame_no -= step ) {
+    ret.push_back( frame_no );
+  }
+
+  return ret;
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 2 ) {
+      cerr << "Usage: " << argv[ 0 ] << " IVF" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const string filename { argv[ 1 ] };
+    const vector<RasterHandle> expected = decode_in_order( filename );
+    const unsigned int frame_count = expected.size();
+
+    /* with no checkpoints, every seek back decodes from a key frame */
+    {
+      FilePlayer player { filename };
+      player.set_checkpoint_interval( frame_count + 1 );
+
+      for ( const unsigned int frame_no : targets( frame_count ) ) {
+        check_seek( player, frame_no, expected, "from a key frame" );
+      }
+    }
+
+    /* the first seek to the end leaves a checkpoint every 4 frames, so
+       the seeks back start from those */
+    {
+      FilePlayer player { filename };
+      player.set_checkpoint_interval( 4 );
+
+      for ( const unsigned int frame_no : targets( frame_count ) ) {
+        check_seek( player, frame_no, expected, "from a checkpoint" );
+      }
+
+      /* and forward, from where the player is */
+      player.seek( 0 );
+      for ( unsigned int frame_no = 0; frame_no < frame_count; frame_no += 3 ) {
+        check_seek( player, frame_no, expected, "forward" );
+      }
+    }
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "decoder.hh"
+#include "exception.hh"
+#include "raster_handle.hh"
+#include "state_store.hh"
+
+using namespace std;
+
+const uint16_t width = 64;
+const uint16_t height = 48;
+
+void check( const bool condition, const string & what );
+RasterHandle solid_raster( const uint8_t value );
+Decoder make_decoder( const uint8_t last, const uint8_t golden, const uint8_t alternative );
+
+void interning( void );
+void lookup( void );
+void eviction( const StateStore::EvictionPolicy policy );
+void pinning( void );
+
+void check( const bool condition, const string & what )
+{
+  if ( not condition ) {
+    throw runtime_error( "check failed: " + what );
+  }
+}
+
+RasterHandle solid_raster( const uint8_t value )
+{
+  MutableRasterHandle raster { width, height };
+  raster.get().Y().fill( value );
+  raster.get().U().fill( value );
+  raster.get().V().fill( value );
+  return RasterHandle( move( raster ) );
+}
+
+Decoder make_decoder( const uint8_t last, const uint8_t golden, const uint8_t alternative )
+{
+  return Decoder( DecoderState( width, height ),
+                  References( solid_raster( last ), solid_raster( golden ),
+                              solid_raster( alternative ) ) );
+}
+
+/* states that have tables and rasters in common store them once */
+void interning( void )
+{
+  StateStore store;
+
+  store.put( 1, make_decoder( 1, 2, 3 ) );
+  const size_t one_state = store.bytes();
+  check( store.stats().shared == 0, "nothing is shared within a state of distinct rasters" );
+
+  store.put( 2, make_decoder( 1, 2, 4 ) );
+  check( store.stats().shared == 3, "the tables and two rasters are shared" );
+  check( store.bytes() < 2 * one_state, "shared objects are counted once" );
+
+  /* putting a name again keeps the first state */
+  store.put( 2, make_decoder( 5, 6, 7 ) );
+  check( store.get( 2 ) == make_decoder( 1, 2, 4 ), "a stored state is kept as it is" );
+
+  store.erase( 1 );
+  check( store.size() == 1, "erase() removes the state" );
+  check( store.bytes() == one_state, "erase() keeps what the other state still uses" );
+
+  store.erase( 2 );
+  check( store.bytes() == 0, "erasing every state frees everything" );
+}
+
+/* get() gives back an equal decoder, and throws for a name it doesn't have */
+void lookup( void )
+{
+  StateStore store;
+
+  const Decoder decoder = make_decoder( 10, 20, 30 );
+  store.put( 7, decoder );
+
+  check( store.contains( 7 ) and not store.contains( 8 ), "contains()" );
+  check( store.get( 7 ) == decoder, "get() returns the state that was put" );
+  check( store.get( 7 ).minihash() == decoder.minihash(), "the minihash survives the store" );
+
+  bool threw = false;
+  try {
+    store.get( 8 );
+  } catch ( const Invalid & ) {
+    threw = true;
+  }
+  check( threw, "get() throws for a missing state" );
+
+  const StateStore::Stats stats = store.stats();
+  check( stats.hits == 2 and stats.misses == 1, "hits and misses are counted" );
+}
+
+/* over the budget, the unpinned states go in the order of the policy, but
+   never the newest one */
+void eviction( const StateStore::EvictionPolicy policy )
+{
+  size_t state_bytes;
+  {
+    StateStore sizing;
+    sizing.put( 0, make_decoder( 0, 0, 0 ) );
+    state_bytes = sizing.bytes();
+  }
+
+  /* room for the pinned state and two more, all of distinct rasters */
+  StateStore store { 3 * state_bytes, policy };
+
+  store.put( 0, make_decoder( 0, 0, 0 ), true /* pinned */ );
+  store.put( 1, make_decoder( 1, 1, 1 ) );
+  store.put( 2, make_decoder( 2, 2, 2 ) );
+  check( store.size() == 3 and store.stats().evictions == 0, "states within the budget stay" );
+
+  store.get( 1 );
+  store.put( 3, make_decoder( 3, 3, 3 ) );
+
+  check( store.size() == 3 and store.stats().evictions == 1, "one state is evicted" );
+  check( store.contains( 0 ), "a pinned state is never evicted" );
+  check( store.contains( 3 ), "the newest state is never evicted" );
+
+  if ( policy == StateStore::EvictionPolicy::OLDEST_FIRST ) {
+    check( not store.contains( 1 ) and store.contains( 2 ), "the oldest state goes first" );
+  }
+  else {
+    check( store.contains( 1 ) and not store.contains( 2 ), "the least recently used state goes first" );
+  }
+
+  /* even a budget of nothing keeps the pinned and the newest state */
+  store.set_budget( 0 );
+  check( store.size() == 2 and store.contains( 0 ) and store.contains( 3 ),
+         "a lower budget evicts at once" );
+}
+
+/* a state can be pinned after it was put, and unpinned again */
+void pinning( void )
+{
+  StateStore store;
+
+  store.put( 1, make_decoder( 1, 1, 1 ) );
+  store.put( 2, make_decoder( 2, 2, 2 ) );
+  store.put( 3, make_decoder( 3, 3, 3 ) );
+
+  store.set_pinned( 1, true );
+  store.set_pinned( 9, true );
+  check( store.pinned( 1 ) and not store.pinned( 2 ) and not store.pinned( 9 ), "pinned()" );
+
+  store.set_budget( 0 );
+  check( store.contains( 1 ) and not store.contains( 2 ) and store.contains( 3 ),
+         "a state pinned later is not evicted" );
+
+  store.set_pinned( 1, false );
+  store.put( 4, make_decoder( 4, 4, 4 ) );
+  check( store.size() == 1 and store.contains( 4 ), "an unpinned state can be evicted again" );
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    interning();
+    lookup();
+    eviction( StateStore::EvictionPolicy::OLDEST_FIRST );
+    eviction( StateStore::EvictionPolicy::LEAST_RECENTLY_USED );
+    pinning();
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -36,34 +36,68 @@
 
 #include "optional.hh"
 
+/* margin of extra elements kept on every side of a TwoDStorage */
+struct TwoDBorder
+{
+  unsigned int width;
+};
+
 /* simple two-dimensional container */
 template <class T>
 class TwoDStorage
 {
 private:
   unsigned int width_, height_;
+  unsigned int border_, stride_;
+
+  /* index of element (0, 0) within storage_ */
+  size_t origin_;
+
   std::vector< T > storage_;
 
 public:
   using const_iterator = typename std::vector< T >::const_iterator;
 
-  struct Context
+  /* an element's position; its neighbours are looked up by index when asked
+     for, so building one costs no more than storing the position */
+  class Context
   {
+  private:
+    const TwoDStorage * self_;
+
+    /* how far away the "above" and "left" neighbours are (normally adjacent) */
+    unsigned int above_distance_ { 1 }, left_distance_ { 1 };
+
+  public:
     unsigned int column, row;
-    unsigned int width, height;
-    Optional< const T * > left, above_left, above, above_right;
 
     Context( const unsigned int s_column, const unsigned int s_row,
-             const unsigned int width, const unsigned int height,
              const TwoDStorage & self )
-      : column( s_column ), row( s_row ),
-        width( width ), height( height ),
-        left(        self.maybe_at( column - 1, row ) ),
-        above_left(  self.maybe_at( column - 1, row - 1 ) ),
-        above(       self.maybe_at( column,     row - 1 ) ),
-        above_right( self.maybe_at( column + 1, row - 1 ) )
+      : self_( &self ), column( s_column ), row( s_row )
     {}
 
+    unsigned int width( void ) const { return self_->width(); }
+    unsigned int height( void ) const { return self_->height(); }
+
+    Optional< const T * > left( void ) const { return self_->maybe_at( column - left_distance_, row ); }
+    Optional< const T * > above_left( void ) const { return self_->maybe_at( column - 1, row - 1 ); }
+    Optional< const T * > above( void ) const { return self_->maybe_at( column, row - above_distance_ ); }
+    Optional< const T * > above_right( void ) const { return self_->maybe_at( column + 1, row - 1 ); }
+
+    /* make "above" the element in row `above_row` of the same column, or none */
+    void set_above( const Optional< unsigned int > & above_row )
+    {
+      assert( not above_row.initialized() or above_row.get() < row );
+      above_distance_ = above_row.initialized() ? row - above_row.get() : row + 1;
+    }
+
+    /* make "left" the element in column `left_column` of the same row, or none */
+    void set_left( const Optional< unsigned int > & left_column )
+    {
+      assert( not left_column.initialized() or left_column.get() < column );
+      left_distance_ = left_column.initialized() ? column - left_column.get() : column + 1;
+    }
+
     // Seems like when copying a TwoD, copying the potentially
     // incorrect pointers is never the right thing to do
     const Context & operator=( const Context & ) { return *this; }
@@ -71,7 +105,8 @@ public:
 
   template< typename... Targs >
   TwoDStorage( const unsigned int width, const unsigned int height, Targs&&... Fargs )
-    : width_( width ), height_( height ), storage_()
+    : width_( width ), height_( height ), border_( 0 ), stride_( width ), origin_( 0 ),
+      storage_()
   {
     assert( width > 0 );
     assert( height > 0 );
@@ -81,22 +116,33 @@ public:
     /* we want to construct each member separately */
     for ( unsigned int row = 0; row < height; row++ ) {
       for ( unsigned int column = 0; column < width; column++ ) {
-        const Context c( column, row, width, height, *this );
-        storage_.emplace_back( c, Fargs... );
+        storage_.emplace_back( Context( column, row, *this ), Fargs... );
       }
     }
   }
 
+  /* the border is value-initialized and never visited by at() or forall();
+     it is only reachable by pointer arithmetic from the elements inside */
+  TwoDStorage( const unsigned int width, const unsigned int height, const TwoDBorder border )
+    : width_( width ), height_( height ), border_( border.width ),
+      stride_( width + 2 * border.width ),
+      origin_( size_t( border.width ) * stride_ + border.width ),
+      storage_( size_t( stride_ ) * ( height + 2 * border.width ) )
+  {
+    assert( width > 0 );
+    assert( height > 0 );
+  }
+
   T & at( const unsigned int column, const unsigned int row )
   {
     assert( column < width_ and row < height_ );
-    return storage_[ row * width_ + column ];
+    return storage_[ origin_ + row * stride_ + column ];
   }
 
   const T & at( const unsigned int column, const unsigned int row ) const
   {
     assert( column < width_ and row < height_ );
-    return storage_[ row * width_ + column ];
+    return storage_[ origin_ + row * stride_ + column ];
   }
 
   Optional<const T *> maybe_at( const unsigned int column, const unsigned int row ) const
@@ -110,7 +156,12 @@ public:
 
   unsigned int width( void ) const { return width_; }
   unsigned int height( void ) const { return height_; }
+  unsigned int border( void ) const { return border_; }
+
+  /* distance in elements between the starts of successive rows */
+  unsigned int stride( void ) const { return stride_; }
 
+  /* iterate over the raw storage, including any border */
   const_iterator begin( void ) const
   {
     return storage_.begin();
@@ -188,6 +239,7 @@ public:
   {
     assert( width_ == other.width_ );
     assert( height_ == other.height_ );
+    assert( border_ == other.border_ );
     memcpy( &storage_[ 0 ], &other.storage_[ 0 ], sizeof( T ) * storage_.size() );
   }
 
@@ -218,6 +270,8 @@ public:
 
   unsigned int width( void ) const { return storage_->width(); }
   unsigned int height( void ) const { return storage_->height(); }
+  unsigned int border( void ) const { return storage_->border(); }
+  unsigned int stride( void ) const { return storage_->stride(); }
 
   template <class lambda>
   void forall( const lambda & f ) { storage_->forall( f ); }
@@ -410,7 +464,7 @@ public:
     }
   }
 
-  unsigned int stride( void ) const { return master_->width(); }
+  unsigned int stride( void ) const { return master_->stride(); }
 };
 
 #endif /* TWOD_HH */
@@ -0,0 +1,113 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "cpu_features.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+SIMDLevel cpu_features::detected_level()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+
+  if ( not __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) ) {
+    return SIMDLevel::C;
+  }
+
+  if ( not ( edx & bit_SSE2 ) ) {
+    return SIMDLevel::C;
+  }
+
+  if ( not ( ecx & bit_SSSE3 ) ) {
+    return SIMDLevel::SSE2;
+  }
+
+  /* AVX2 needs the AVX state enabled by the OS (XCR0 bits 1 and 2) */
+  const bool os_saves_ymm = [&]()
+    {
+      if ( not ( ecx & bit_OSXSAVE ) or not ( ecx & bit_AVX ) ) {
+        return false;
+      }
+
+      uint32_t xcr0_low, xcr0_high;
+      asm volatile( "xgetbv" : "=a" ( xcr0_low ), "=d" ( xcr0_high ) : "c" ( 0 ) );
+      return ( xcr0_low & 6 ) == 6;
+    }();
+
+  if ( os_saves_ymm
+       and __get_cpuid_max( 0, nullptr ) >= 7 ) {
+    __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+    if ( ebx & bit_AVX2 ) {
+      return SIMDLevel::AVX2;
+    }
+  }
+
+  return SIMDLevel::SSSE3;
+#else
+  return SIMDLevel::C;
+#endif
+}
+
+SIMDLevel cpu_features::selected_level()
+{
+  const SIMDLevel detected = detected_level();
+
+  const char * cap = getenv( "ALFALFA_SIMD" );
+  if ( cap == nullptr ) {
+    return detected;
+  }
+
+  for ( const SIMDLevel level : { SIMDLevel::C, SIMDLevel::SSE2, SIMDLevel::SSSE3, SIMDLevel::AVX2 } ) {
+    if ( strcasecmp( cap, name( level ) ) == 0 ) {
+      return level < detected ? level : detected;
+    }
+  }
+
+  return detected;
+}
+
+const char * cpu_features::name( const SIMDLevel level )
+{
+  switch ( level ) {
+  case SIMDLevel::C: return "c";
+  case SIMDLevel::SSE2: return "sse2";
+  case SIMDLevel::SSSE3: return "ssse3";
+  case SIMDLevel::AVX2: return "avx2";
+  }
+
+  return "unknown";
+}
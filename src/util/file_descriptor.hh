@@ -30,9 +30,13 @@
 #define FILE_DESCRIPTOR_HH
 
 #include <string>
+#include <vector>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <algorithm>
+#include <climits>
 #include <cstdio>
 #include <cassert>
 
@@ -49,6 +53,43 @@ private:
 
   unsigned int read_count_, write_count_;
 
+  /* hands all of the buffers to `vector_write` (writev or vmsplice), IOV_MAX at a time */
+  template <class VectorWrite>
+  void write_all( const std::vector<Chunk> & buffers, VectorWrite && vector_write )
+  {
+    std::vector<iovec> iovecs;
+    iovecs.reserve( buffers.size() );
+
+    for ( const Chunk & buffer : buffers ) {
+      if ( buffer.size() > 0 ) {
+        iovecs.push_back( { const_cast<uint8_t *>( buffer.buffer() ), buffer.size() } );
+      }
+    }
+
+    size_t first = 0;
+    while ( first < iovecs.size() ) {
+      const size_t count = std::min( iovecs.size() - first, size_t( IOV_MAX ) );
+      size_t bytes_written = vector_write( &iovecs[ first ], count );
+
+      if ( bytes_written == 0 ) {
+        throw internal_error( "write", "returned 0" );
+      }
+
+      register_write();
+
+      /* skip over what was written, which may end partway into a buffer */
+      while ( first < iovecs.size() and bytes_written >= iovecs[ first ].iov_len ) {
+        bytes_written -= iovecs[ first ].iov_len;
+        first++;
+      }
+
+      if ( bytes_written > 0 ) {
+        iovecs[ first ].iov_base = static_cast<uint8_t *>( iovecs[ first ].iov_base ) + bytes_written;
+        iovecs[ first ].iov_len -= bytes_written;
+      }
+    }
+  }
+
 protected:
   void register_read( void ) { read_count_++; }
   void register_write( void ) { write_count_++; }
@@ -138,6 +179,41 @@ public:
     register_write();
   }
 
+  /* gathers the buffers into as few writev() calls as it can */
+  void write( const std::vector<Chunk> & buffers )
+  {
+    write_all( buffers,
+      [&]( const iovec * iov, const size_t count )
+      {
+        return SystemCall( "writev", ::writev( fd_, iov, count ) );
+      } );
+  }
+
+  /* like write(), but for pipes: the pipe takes references to the pages
+     holding the buffers instead of copying them, so the caller must not
+     modify or free them until the reader has consumed them */
+  void vmsplice( const std::vector<Chunk> & buffers )
+  {
+    write_all( buffers,
+      [&]( const iovec * iov, const size_t count )
+      {
+        return SystemCall( "vmsplice", ::vmsplice( fd_, iov, count, 0 ) );
+      } );
+  }
+
+  bool is_pipe( void ) const
+  {
+    struct stat file_info;
+    SystemCall( "fstat", fstat( fd_, &file_info ) );
+    return S_ISFIFO( file_info.st_mode );
+  }
+
+  /* how many bytes the pipe can hold */
+  size_t pipe_capacity( void ) const
+  {
+    return SystemCall( "fcntl", fcntl( fd_, F_GETPIPE_SZ ) );
+  }
+
   std::string getline()
   {
     std::string ret;
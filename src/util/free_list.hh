@@ -0,0 +1,513 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef FREE_LIST_HH
+#define FREE_LIST_HH
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+/* allocation counters of a pool, for monitoring */
+struct PoolStats
+{
+  uint64_t hits;     /* requests served with a recycled object */
+  uint64_t misses;   /* requests that had to allocate a new one */
+};
+
+/* a list of unused heap objects that any thread can take from or give back
+   to without a lock. each thread keeps a few objects of its own and trades
+   them with a shared stack in batches, so most calls touch no shared state.
+
+   the shared stack is only ever emptied as a whole (an exchange), never
+   popped one node at a time, so it has no ABA problem. the list owns the
+   objects in it and deletes them when it is destroyed; objects still cached
+   by a thread are deleted when that thread exits (or next uses a FreeList).
+   no thread can reach into another's cache, so release() and
+   release_local() leave those alone. */
+template <class T>
+class FreeList
+{
+private:
+  /* objects a thread keeps before handing half of them to the shared stack */
+  static constexpr size_t LOCAL_CAPACITY = 8;
+
+  /* hits a thread counts on its own before adding them to the shared total */
+  static constexpr uint64_t LOCAL_HITS = 64;
+
+  struct Batch
+  {
+    std::vector<T *> objects;
+    Batch * next;
+  };
+
+  struct Shared
+  {
+    std::atomic<Batch *> head { nullptr };
+    std::atomic<size_t> size { 0 };   /* objects in the stack */
+    std::atomic<uint64_t> hits { 0 }, misses { 0 };
+
+    Shared() {}
+
+    /* push the chain first..last (linked through `next`), holding `count` objects */
+    void push( Batch * first, Batch * last, const size_t count )
+    {
+      size.fetch_add( count, std::memory_order_relaxed );
+      last->next = head.load( std::memory_order_relaxed );
+      while ( not head.compare_exchange_weak( last->next, first,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed ) ) {}
+    }
+
+    Batch * take_all( void )
+    {
+      return head.exchange( nullptr, std::memory_order_acquire );
+    }
+
+    ~Shared()
+    {
+      for ( Batch * batch = take_all(); batch != nullptr; ) {
+        for ( T * object : batch->objects ) {
+          delete object;
+        }
+        Batch * next = batch->next;
+        delete batch;
+        batch = next;
+      }
+    }
+
+    Shared( const Shared & other ) = delete;
+    Shared & operator=( const Shared & other ) = delete;
+  };
+
+  struct LocalCache
+  {
+    std::weak_ptr<Shared> owner;
+    const Shared * key;
+    std::vector<T *> objects;
+    uint64_t hits;
+  };
+
+  /* every FreeList<T> this thread has used */
+  struct LocalCaches
+  {
+    std::vector<LocalCache> caches {};
+
+    LocalCaches() {}
+
+    ~LocalCaches()
+    {
+      for ( LocalCache & cache : caches ) {
+        const std::shared_ptr<Shared> owner = cache.owner.lock();
+        if ( owner ) {
+          owner->hits.fetch_add( cache.hits, std::memory_order_relaxed );
+        }
+
+        if ( owner and not cache.objects.empty() ) {
+          Batch * batch = new Batch { std::move( cache.objects ), nullptr };
+          owner->push( batch, batch, batch->objects.size() );
+        }
+        else {
+          for ( T * object : cache.objects ) {
+            delete object;
+          }
+        }
+      }
+    }
+
+    LocalCaches( const LocalCaches & other ) = delete;
+    LocalCaches & operator=( const LocalCaches & other ) = delete;
+  };
+
+  static thread_local LocalCaches local_caches_;
+
+  std::shared_ptr<Shared> shared_ { std::make_shared<Shared>() };
+
+  LocalCache & local( void )
+  {
+    std::vector<LocalCache> & caches = local_caches_.caches;
+
+    for ( LocalCache & cache : caches ) {
+      if ( cache.key == shared_.get() and not cache.owner.expired() ) {
+        return cache;
+      }
+    }
+
+    /* forget lists that no longer exist before adding this one */
+    for ( LocalCache & cache : caches ) {
+      if ( cache.owner.expired() ) {
+        for ( T * object : cache.objects ) {
+          delete object;
+        }
+        cache.objects.clear();
+      }
+    }
+    caches.erase( std::remove_if( caches.begin(), caches.end(),
+                                  [] ( const LocalCache & cache ) { return cache.owner.expired(); } ),
+                  caches.end() );
+    caches.push_back( LocalCache { shared_, shared_.get(), {}, 0 } );
+    caches.back().objects.reserve( LOCAL_CAPACITY );
+    return caches.back();
+  }
+
+  /* put a chain taken with take_all() back, minus the `taken` objects removed from it */
+  void put_back( Batch * first, const size_t taken )
+  {
+    shared_->size.fetch_sub( taken, std::memory_order_relaxed );
+
+    if ( first == nullptr ) {
+      return;
+    }
+
+    Batch * last = first;
+    while ( last->next != nullptr ) {
+      last = last->next;
+    }
+    shared_->push( first, last, 0 );
+  }
+
+  /* move one batch from the shared stack into `cache`; false if there was none */
+  bool refill( LocalCache & cache )
+  {
+    Batch * batch = shared_->take_all();
+
+    if ( batch == nullptr ) {
+      return false;
+    }
+
+    /* keep the first batch, and put any others back in one step */
+    put_back( batch->next, batch->objects.size() );
+
+    cache.objects.insert( cache.objects.end(), batch->objects.begin(), batch->objects.end() );
+    delete batch;
+    return true;
+  }
+
+public:
+  FreeList() {}
+
+  /* an unused object, or nullptr if the caller has to make a new one */
+  T * take( void )
+  {
+    LocalCache & cache = local();
+
+    if ( cache.objects.empty() and not refill( cache ) ) {
+      shared_->misses.fetch_add( 1, std::memory_order_relaxed );
+      return nullptr;
+    }
+
+    if ( ++cache.hits == LOCAL_HITS ) {
+      shared_->hits.fetch_add( cache.hits, std::memory_order_relaxed );
+      cache.hits = 0;
+    }
+
+    T * object = cache.objects.back();
+    cache.objects.pop_back();
+    return object;
+  }
+
+  /* returns true if this moved objects to the shared stack */
+  bool give( T * object )
+  {
+    LocalCache & cache = local();
+    cache.objects.push_back( object );
+
+    if ( cache.objects.size() < LOCAL_CAPACITY ) {
+      return false;
+    }
+
+    const size_t keep = LOCAL_CAPACITY / 2;
+    Batch * batch = new Batch { std::vector<T *>( cache.objects.begin() + keep, cache.objects.end() ),
+                                nullptr };
+    cache.objects.resize( keep );
+    shared_->push( batch, batch, batch->objects.size() );
+    return true;
+  }
+
+  /* objects in the shared stack (threads' own caches are not counted) */
+  size_t shared_size( void ) const { return shared_->size.load( std::memory_order_relaxed ); }
+
+  /* delete up to `count` objects from the shared stack; returns how many it deleted */
+  size_t release( const size_t count )
+  {
+    Batch * first = shared_->take_all();
+    size_t released = 0;
+
+    while ( first != nullptr and released < count ) {
+      std::vector<T *> & objects = first->objects;
+      while ( not objects.empty() and released < count ) {
+        delete objects.back();
+        objects.pop_back();
+        released++;
+      }
+
+      if ( objects.empty() ) {
+        Batch * next = first->next;
+        delete first;
+        first = next;
+      }
+    }
+
+    put_back( first, released );
+    return released;
+  }
+
+  /* delete the objects the calling thread keeps for this list; returns how many */
+  size_t release_local( void )
+  {
+    for ( LocalCache & cache : local_caches_.caches ) {
+      if ( cache.key == shared_.get() and not cache.owner.expired() ) {
+        const size_t released = cache.objects.size();
+        for ( T * object : cache.objects ) {
+          delete object;
+        }
+        cache.objects.clear();
+        return released;
+      }
+    }
+
+    return 0;
+  }
+
+  /* hits are added up per thread, so the count can lag a little */
+  PoolStats stats( void ) const
+  {
+    return { shared_->hits.load( std::memory_order_relaxed ),
+             shared_->misses.load( std::memory_order_relaxed ) };
+  }
+
+  /* forbid copying and moving */
+  FreeList( const FreeList & other ) = delete;
+  FreeList & operator=( const FreeList & other ) = delete;
+};
+
+template <class T>
+thread_local typename FreeList<T>::LocalCaches FreeList<T>::local_caches_;
+
+/* unused objects of any number of sizes (by display_width() x display_height()),
+   each size in its own FreeList. when the idle objects in the shared stacks
+   take more than the byte budget, the least recently used sizes are trimmed
+   first. threads' own caches are small and are not counted. */
+template <class T>
+class SizeClassPool
+{
+public:
+  typedef size_t ObjectBytes( const T & object );
+
+private:
+  struct SizeClass
+  {
+    const unsigned int width, height;
+    SizeClass * const next;
+
+    /* set when the first object is given back */
+    std::atomic<size_t> bytes { 0 };
+
+    /* milliseconds on the steady clock */
+    std::atomic<uint64_t> last_used { 0 };
+
+    FreeList<T> unused {};
+
+    SizeClass( const unsigned int s_width, const unsigned int s_height, SizeClass * const s_next )
+      : width( s_width ), height( s_height ), next( s_next )
+    {}
+
+    SizeClass( const SizeClass & other ) = delete;
+    SizeClass & operator=( const SizeClass & other ) = delete;
+
+    size_t idle_bytes( void ) const
+    {
+      return unused.shared_size() * bytes.load( std::memory_order_relaxed );
+    }
+
+    void touch( void )
+    {
+      const uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+      /* only write when the time has moved, to keep the line mostly read-only */
+      if ( last_used.load( std::memory_order_relaxed ) != now ) {
+        last_used.store( now, std::memory_order_relaxed );
+      }
+    }
+  };
+
+  ObjectBytes * const object_bytes_;
+
+  /* size classes are only ever added (at the front), so readers need no lock */
+  std::atomic<SizeClass *> classes_ { nullptr };
+  std::mutex adding_ {};
+
+  std::atomic<size_t> budget_ { std::numeric_limits<size_t>::max() };
+
+  SizeClass * find( const unsigned int width, const unsigned int height,
+                    SizeClass * const first ) const
+  {
+    for ( SizeClass * size_class = first; size_class != nullptr; size_class = size_class->next ) {
+      if ( size_class->width == width and size_class->height == height ) {
+        return size_class;
+      }
+    }
+    return nullptr;
+  }
+
+  SizeClass & size_class( const unsigned int width, const unsigned int height )
+  {
+    SizeClass * found = find( width, height, classes_.load( std::memory_order_acquire ) );
+
+    if ( found == nullptr ) {
+      std::unique_lock<std::mutex> lock { adding_ };
+
+      SizeClass * const first = classes_.load( std::memory_order_relaxed );
+      found = find( width, height, first );
+      if ( found == nullptr ) {
+        found = new SizeClass( width, height, first );
+        classes_.store( found, std::memory_order_release );
+      }
+    }
+
+    found->touch();
+    return *found;
+  }
+
+public:
+  SizeClassPool( ObjectBytes * const object_bytes )
+    : object_bytes_( object_bytes )
+  {}
+
+  ~SizeClassPool()
+  {
+    for ( SizeClass * size_class = classes_.load(); size_class != nullptr; ) {
+      SizeClass * next = size_class->next;
+      delete size_class;
+      size_class = next;
+    }
+  }
+
+  /* an unused object of this size, or nullptr if the caller has to make one */
+  T * take( const unsigned int width, const unsigned int height )
+  {
+    return size_class( width, height ).unused.take();
+  }
+
+  void give( T * object )
+  {
+    SizeClass & pool = size_class( object->display_width(), object->display_height() );
+
+    if ( pool.bytes.load( std::memory_order_relaxed ) == 0 ) {
+      pool.bytes.store( object_bytes_( *object ), std::memory_order_relaxed );
+    }
+
+    if ( pool.unused.give( object ) and idle_bytes() > budget() ) {
+      trim( budget() );
+    }
+  }
+
+  /* bytes held by idle objects in the shared stacks */
+  size_t idle_bytes( void ) const
+  {
+    size_t total = 0;
+    for ( const SizeClass * size_class = classes_.load( std::memory_order_acquire );
+          size_class != nullptr; size_class = size_class->next ) {
+      total += size_class->idle_bytes();
+    }
+    return total;
+  }
+
+  size_t budget( void ) const { return budget_.load( std::memory_order_relaxed ); }
+
+  void set_budget( const size_t bytes )
+  {
+    budget_.store( bytes, std::memory_order_relaxed );
+    trim( bytes );
+  }
+
+  /* delete idle objects, least recently used sizes first, until at most
+     `target` bytes are idle. trimming to zero also empties the calling
+     thread's own caches; other threads keep theirs (at most 7 objects
+     of each size) until they exit. */
+  void trim( const size_t target = 0 )
+  {
+    if ( target == 0 ) {
+      for ( SizeClass * size_class = classes_.load( std::memory_order_acquire );
+            size_class != nullptr; size_class = size_class->next ) {
+        size_class->unused.release_local();
+      }
+    }
+
+    std::vector<SizeClass *> by_age;
+    for ( SizeClass * size_class = classes_.load( std::memory_order_acquire );
+          size_class != nullptr; size_class = size_class->next ) {
+      by_age.push_back( size_class );
+    }
+
+    std::sort( by_age.begin(), by_age.end(),
+               [] ( const SizeClass * a, const SizeClass * b )
+               { return a->last_used.load( std::memory_order_relaxed )
+                   < b->last_used.load( std::memory_order_relaxed ); } );
+
+    size_t idle = idle_bytes();
+
+    for ( SizeClass * size_class : by_age ) {
+      const size_t bytes = size_class->bytes.load( std::memory_order_relaxed );
+      if ( idle <= target ) {
+        break;
+      }
+      if ( bytes == 0 ) {
+        continue;
+      }
+
+      const size_t excess = ( idle - target + bytes - 1 ) / bytes;
+      const size_t released = size_class->unused.release( excess );
+      idle -= std::min( idle, released * bytes );
+    }
+  }
+
+  PoolStats stats( void ) const
+  {
+    PoolStats total { 0, 0 };
+    for ( const SizeClass * size_class = classes_.load( std::memory_order_acquire );
+          size_class != nullptr; size_class = size_class->next ) {
+      const PoolStats counts = size_class->unused.stats();
+      total.hits += counts.hits;
+      total.misses += counts.misses;
+    }
+    return total;
+  }
+
+  /* forbid copying and moving */
+  SizeClassPool( const SizeClassPool & other ) = delete;
+  SizeClassPool & operator=( const SizeClassPool & other ) = delete;
+};
+
+#endif /* FREE_LIST_HH */
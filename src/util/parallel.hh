@@ -0,0 +1,197 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <exception>
+#include <functional>
+
+/* per-row completion counters for wavefront-style passes over a grid
+   (typically macroblock rows). a worker advances its row as it finishes
+   each column, and a worker on a later row waits on the rows it depends on. */
+class RowProgress
+{
+private:
+  std::vector< std::atomic<unsigned int> > completed_;
+  std::atomic<bool> aborted_ { false };
+
+public:
+  /* thrown out of wait() once another worker has failed */
+  struct Aborted {};
+
+  RowProgress( const unsigned int height )
+    : completed_( height )
+  {}
+
+  unsigned int height( void ) const { return completed_.size(); }
+
+  /* record that the first `columns` entries of `row` are done */
+  void advance( const unsigned int row, const unsigned int columns )
+  {
+    completed_[ row ].store( columns, std::memory_order_release );
+  }
+
+  /* block until the first `columns` entries of `row` are done.
+     rows outside the grid (e.g. the row above row 0) are always done. */
+  void wait( const unsigned int row, const unsigned int columns ) const
+  {
+    if ( row >= completed_.size() ) {
+      return;
+    }
+
+    unsigned int spins = 0;
+    while ( completed_[ row ].load( std::memory_order_acquire ) < columns ) {
+      if ( aborted_.load( std::memory_order_relaxed ) ) {
+        throw Aborted();
+      }
+
+      if ( ++spins > 64 ) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void reset( void )
+  {
+    for ( auto & row : completed_ ) {
+      row.store( 0, std::memory_order_relaxed );
+    }
+    aborted_ = false;
+  }
+
+  void abort( void ) { aborted_ = true; }
+
+  /* forbid copying */
+  RowProgress( const RowProgress & other ) = delete;
+  RowProgress & operator=( const RowProgress & other ) = delete;
+};
+
+/* run worker( 0 ) ... worker( count - 1 ) concurrently, with worker 0 on
+   the calling thread, and rethrow the first exception any of them threw.
+   if a worker fails, `progress` is aborted so that nobody waits forever
+   on a row that will never be finished. */
+template <class lambda>
+void run_workers( const unsigned int count, RowProgress & progress, const lambda & worker )
+{
+  auto guarded = [&]( const unsigned int index )
+    {
+      try {
+        worker( index );
+      } catch ( ... ) {
+        progress.abort();
+        throw;
+      }
+    };
+
+  if ( count <= 1 ) {
+    worker( 0 );
+    return;
+  }
+
+  std::vector< std::future<void> > helpers;
+  helpers.reserve( count - 1 );
+
+  for ( unsigned int index = 1; index < count; index++ ) {
+    helpers.emplace_back( std::async( std::launch::async, guarded, index ) );
+  }
+
+  std::exception_ptr first_error;
+
+  auto collect = [&]( const std::function<void()> & f )
+    {
+      try {
+        f();
+      } catch ( const RowProgress::Aborted & ) {
+        /* secondary failure; the root cause is reported instead */
+      } catch ( ... ) {
+        if ( not first_error ) {
+          first_error = std::current_exception();
+        }
+      }
+    };
+
+  collect( [&]() { guarded( 0 ); } );
+
+  for ( auto & helper : helpers ) {
+    collect( [&]() { helper.get(); } );
+  }
+
+  if ( first_error ) {
+    std::rethrow_exception( first_error );
+  }
+}
+
+/* run independent jobs concurrently (no row dependencies between them) */
+template <class lambda>
+void run_workers( const unsigned int count, const lambda & worker )
+{
+  RowProgress unused { 0 };
+  run_workers( count, unused, worker );
+}
+
+/* visit every cell of a width x height grid as a row wavefront over `count`
+   workers: worker w takes rows w, w + count, ... in order, and each cell waits
+   until the row above is two cells ahead of it (far enough for a macroblock's
+   above-right neighbour). calls f( column, row, worker ). */
+template <class lambda>
+void run_wavefront( const unsigned int count, const unsigned int width,
+                    const unsigned int height, const lambda & f )
+{
+  const unsigned int worker_count = std::min( count, height );
+
+  if ( worker_count <= 1 ) {
+    for ( unsigned int row = 0; row < height; row++ ) {
+      for ( unsigned int column = 0; column < width; column++ ) {
+        f( column, row, 0 );
+      }
+    }
+    return;
+  }
+
+  RowProgress progress( height );
+
+  run_workers( worker_count, progress,
+               [&]( const unsigned int worker )
+               {
+                 for ( unsigned int row = worker; row < height; row += worker_count ) {
+                   for ( unsigned int column = 0; column < width; column++ ) {
+                     progress.wait( row - 1, std::min( column + 2, width ) );
+                     f( column, row, worker );
+                     progress.advance( row, column + 1 );
+                   }
+                 }
+               } );
+}
+
+#endif /* PARALLEL_HH */
@@ -26,8 +26,10 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <algorithm>
 #include <boost/functional/hash.hpp>
 #include <cstdio>
+#include <cstring>
 
 #include "exception.hh"
 #include "raster.hh"
@@ -36,9 +38,9 @@
 using namespace std;
 
 BaseRaster::BaseRaster( const uint16_t display_width, const uint16_t display_height,
-  const uint16_t width, const uint16_t height)
+  const uint16_t width, const uint16_t height, const uint16_t border )
   : display_width_( display_width ), display_height_( display_height ),
-    width_( width ), height_( height )
+    width_( width ), height_( height ), border_( border )
 {
   if ( display_width_ > width_ ) {
     throw Invalid( "display_width is greater than width." );
@@ -49,13 +51,136 @@ BaseRaster::BaseRaster( const uint16_t display_width, const uint16_t display_hei
   }
 }
 
+/* a 64-bit multiply-rotate hash (the xxHash64 round) over four
+   independent lanes, so the multiplies of neighbouring words overlap */
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+inline uint64_t rotate_left( const uint64_t value, const unsigned int bits )
+{
+  return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+inline uint64_t mix( const uint64_t lane, const uint64_t word )
+{
+  return rotate_left( lane + word * PRIME2, 31 ) * PRIME1;
+}
+
+inline uint64_t load64( const uint8_t * bytes )
+{
+  uint64_t word;
+  memcpy( &word, bytes, sizeof( word ) );
+  return word;
+}
+
+class BandHasher
+{
+private:
+  uint64_t lanes_[ 4 ];
+
+public:
+  BandHasher( const uint64_t seed )
+    : lanes_ { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 }
+  {}
+
+  void add_row( const uint8_t * row, const unsigned int width )
+  {
+    unsigned int i = 0;
+
+    for ( ; i + 32 <= width; i += 32 ) {
+      lanes_[ 0 ] = mix( lanes_[ 0 ], load64( row + i ) );
+      lanes_[ 1 ] = mix( lanes_[ 1 ], load64( row + i + 8 ) );
+      lanes_[ 2 ] = mix( lanes_[ 2 ], load64( row + i + 16 ) );
+      lanes_[ 3 ] = mix( lanes_[ 3 ], load64( row + i + 24 ) );
+    }
+
+    for ( unsigned int lane = 0; i + 8 <= width; i += 8, lane++ ) {
+      lanes_[ lane ] = mix( lanes_[ lane ], load64( row + i ) );
+    }
+
+    for ( ; i < width; i++ ) {
+      lanes_[ 3 ] = mix( lanes_[ 3 ], row[ i ] );
+    }
+  }
+
+  void add_rows( const TwoD< uint8_t > & plane, const unsigned int first_row,
+                 const unsigned int row_count )
+  {
+    const unsigned int last_row = std::min( first_row + row_count, plane.height() );
+
+    for ( unsigned int row = first_row; row < last_row; row++ ) {
+      add_row( &plane.at( 0, row ), plane.width() );
+    }
+  }
+
+  uint64_t value( void ) const
+  {
+    uint64_t hash = rotate_left( lanes_[ 0 ], 1 ) + rotate_left( lanes_[ 1 ], 7 )
+      + rotate_left( lanes_[ 2 ], 12 ) + rotate_left( lanes_[ 3 ], 18 );
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+
+    return hash;
+  }
+};
+
+}
+
+unsigned int BaseRaster::hash_band_count( void ) const
+{
+  return ( height_ + HASH_BAND_HEIGHT - 1 ) / HASH_BAND_HEIGHT;
+}
+
+/* the border is left out */
+size_t BaseRaster::band_hash( const unsigned int band ) const
+{
+  BandHasher hasher( band );
+
+  hasher.add_rows( Y_, band * HASH_BAND_HEIGHT, HASH_BAND_HEIGHT );
+  hasher.add_rows( U_, band * HASH_BAND_HEIGHT / 2, HASH_BAND_HEIGHT / 2 );
+  hasher.add_rows( V_, band * HASH_BAND_HEIGHT / 2, HASH_BAND_HEIGHT / 2 );
+
+  return hasher.value();
+}
+
+size_t BaseRaster::combine_band_hashes( size_t hash_val, const size_t band_hash_val )
+{
+  boost::hash_combine( hash_val, band_hash_val );
+  return hash_val;
+}
+
 size_t BaseRaster::raw_hash( void ) const
 {
   size_t hash_val = 0;
 
-  boost::hash_range( hash_val, Y_.begin(), Y_.end() );
-  boost::hash_range( hash_val, U_.begin(), U_.end() );
-  boost::hash_range( hash_val, V_.begin(), V_.end() );
+  for ( unsigned int band = 0; band < hash_band_count(); band++ ) {
+    hash_val = combine_band_hashes( hash_val, band_hash( band ) );
+  }
+
+  return hash_val;
+}
+
+/* hashing row by row leaves the border out, and gives the same value
+   as hashing the whole plane in one range */
+static void hash_plane( size_t & hash_val, const TwoD< uint8_t > & plane )
+{
+  for ( unsigned int row = 0; row < plane.height(); row++ ) {
+    const uint8_t * row_start = &plane.at( 0, row );
+    boost::hash_range( hash_val, row_start, row_start + plane.width() );
+  }
+}
+
+size_t BaseRaster::stable_hash( void ) const
+{
+  size_t hash_val = 0;
+
+  hash_plane( hash_val, Y_ );
+  hash_plane( hash_val, U_ );
+  hash_plane( hash_val, V_ );
 
   return hash_val;
 }
@@ -82,24 +207,60 @@ void BaseRaster::copy_from( const BaseRaster & other )
   V_.copy_from( other.V_ );
 }
 
-vector<Chunk> BaseRaster::display_rectangle_as_planar() const
+static void extend_plane( TwoD< uint8_t > & plane )
 {
-  vector<Chunk> ret;
+  const unsigned int border = plane.border();
+  const unsigned int stride = plane.stride();
 
-  /* write Y */
-  for ( uint16_t row = 0; row < display_height(); row++ ) {
-    ret.emplace_back( &Y().at( 0, row ), display_width() );
+  if ( border == 0 ) {
+    return;
   }
 
-  /* write U */
-  for ( uint16_t row = 0; row < chroma_display_height(); row++ ) {
-    ret.emplace_back( &U().at( 0, row ), chroma_display_width() );
+  /* left and right of each row */
+  for ( unsigned int row = 0; row < plane.height(); row++ ) {
+    uint8_t * row_start = &plane.at( 0, row );
+    memset( row_start - border, row_start[ 0 ], border );
+    memset( row_start + plane.width(), row_start[ plane.width() - 1 ], border );
   }
 
-  /* write V */
-  for ( uint16_t row = 0; row < chroma_display_height(); row++ ) {
-    ret.emplace_back( &V().at( 0, row ), chroma_display_width() );
+  /* then whole padded rows above and below, which fills in the corners */
+  uint8_t * first_row = &plane.at( 0, 0 ) - border;
+  uint8_t * last_row = &plane.at( 0, plane.height() - 1 ) - border;
+
+  for ( unsigned int i = 1; i <= border; i++ ) {
+    memcpy( first_row - i * stride, first_row, stride );
+    memcpy( last_row + i * stride, last_row, stride );
   }
+}
+
+void BaseRaster::extend_borders( void )
+{
+  extend_plane( Y_ );
+  extend_plane( U_ );
+  extend_plane( V_ );
+}
+
+vector<Chunk> BaseRaster::display_rectangle_as_planar() const
+{
+  vector<Chunk> ret;
+
+  auto add_plane = [&ret]( const TwoD< uint8_t > & plane, const uint16_t display_width,
+                           const uint16_t display_height )
+    {
+      if ( plane.stride() == display_width ) {
+        /* no border and nothing to crop on the right: the rows are contiguous */
+        ret.emplace_back( &plane.at( 0, 0 ), size_t( display_width ) * display_height );
+        return;
+      }
+
+      for ( uint16_t row = 0; row < display_height; row++ ) {
+        ret.emplace_back( &plane.at( 0, row ), display_width );
+      }
+    };
+
+  add_plane( Y(), display_width(), display_height() );
+  add_plane( U(), chroma_display_width(), chroma_display_height() );
+  add_plane( V(), chroma_display_width(), chroma_display_height() );
 
   return ret;
 }
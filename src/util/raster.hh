@@ -39,7 +39,8 @@
 template<>
 template< typename... Targs >
 TwoDStorage<uint8_t>::TwoDStorage( const unsigned int width, const unsigned int height, Targs&&... Fargs )
-  : width_( width ), height_( height ), storage_( width * height, Fargs... )
+  : width_( width ), height_( height ), border_( 0 ), stride_( width ), origin_( 0 ),
+    storage_( width * height, Fargs... )
 {
   assert( width > 0 );
   assert( height > 0 );
@@ -50,16 +51,19 @@ class BaseRaster
 protected:
   uint16_t display_width_, display_height_;
   uint16_t width_, height_;
+  uint16_t border_;
 
-  TwoD< uint8_t > Y_ { width_, height_ },
-    U_ { width_ / 2, height_ / 2 },
-    V_ { width_ / 2, height_ / 2 };
+  TwoD< uint8_t > Y_ { width_, height_, TwoDBorder { border_ } },
+    U_ { width_ / 2, height_ / 2, TwoDBorder { border_ } },
+    V_ { width_ / 2, height_ / 2, TwoDBorder { border_ } };
 
   size_t raw_hash( void ) const;
 
+  static size_t combine_band_hashes( size_t hash_val, const size_t band_hash_val );
+
 public:
   BaseRaster( const uint16_t display_width, const uint16_t display_height,
-    const uint16_t width, const uint16_t height );
+    const uint16_t width, const uint16_t height, const uint16_t border = 0 );
 
   TwoD< uint8_t > & Y( void ) { return Y_; }
   TwoD< uint8_t > & U( void ) { return U_; }
@@ -77,6 +81,16 @@ public:
   uint16_t chroma_display_width() const { return (1 + display_width_) / 2; }
   uint16_t chroma_display_height() const { return (1 + display_height_) / 2; }
 
+  /* raw_hash() combines the hashes of bands of 16 rows of Y and 8 of U and V
+     (a macroblock row), so a band can be hashed as soon as it is final */
+  static constexpr unsigned int HASH_BAND_HEIGHT = 16;
+  unsigned int hash_band_count( void ) const;
+  size_t band_hash( const unsigned int band ) const;
+
+  /* the byte-by-byte hash that raw_hash() used to be. the decoder minihash
+     that IVF headers carry is built from it, so it must not change. */
+  size_t stable_hash( void ) const;
+
   // SSIM as determined by libx264
   double quality( const BaseRaster & other ) const;
 
@@ -85,6 +99,9 @@ public:
 
   void copy_from( const BaseRaster & other );
 
+  /* replicate the outermost pixels of each plane across its border */
+  void extend_borders( void );
+
   std::vector<Chunk> display_rectangle_as_planar() const;
   void dump( FILE * file ) const; /* only used for debugging */
 };
@@ -61,9 +61,8 @@ double ssim( const TwoD<uint8_t> & image, const TwoD<uint8_t> & other_image )
    // Buffer size calculation taken from x264
    tmp_buffer.resize( 8 * ( image.width() / 4 + 3 ) * sizeof( int ) );
 
-   // No padding so stride = width
-   double ssim = x264_pixel_ssim_wxh( &x264_funcs, &image.at( 0, 0 ), image.width(),
-                                      &other_image.at( 0, 0 ), other_image.width(),
+   double ssim = x264_pixel_ssim_wxh( &x264_funcs, &image.at( 0, 0 ), image.stride(),
+                                      &other_image.at( 0, 0 ), other_image.stride(),
                                       image.width(), image.height(),
                                       tmp_buffer.data(), &count );
 